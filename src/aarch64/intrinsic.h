@@ -160,6 +160,49 @@ static ALWAYS_INLINE void arch_tlbi_vmalle1is()
     arch_fence();
 }
 
+/* Flush TLB entries of a page of all ASIDs. */
+static ALWAYS_INLINE void arch_tlbi_vaae1is(u64 va)
+{
+    arch_fence();
+    asm volatile("tlbi vaae1is, %[x]" : : [x] "r"((va >> 12) & 0xfffffffffff));
+    arch_fence();
+}
+
+/* Flush TLB entries of this cpu. */
+static ALWAYS_INLINE void arch_tlbi_vmalle1()
+{
+    arch_fence();
+    asm volatile("tlbi vmalle1");
+    arch_fence();
+}
+
+/* Flush non-global TLB entries of an ASID. */
+static ALWAYS_INLINE void arch_tlbi_aside1is(u64 asid)
+{
+    arch_fence();
+    asm volatile("tlbi aside1is, %[x]" : : [x] "r"(asid << 48));
+    arch_fence();
+}
+
+/* Flush TLB entries of a page of an ASID. */
+static ALWAYS_INLINE void arch_tlbi_vae1is(u64 va, u64 asid)
+{
+    arch_fence();
+    asm volatile("tlbi vae1is, %[x]"
+                 :
+                 : [x] "r"((asid << 48) | ((va >> 12) & 0xfffffffffff)));
+    arch_fence();
+}
+
+/* Set Translation Table Base Register 0 (EL1) with an ASID.
+ * Entries of other ASIDs stay in the TLB. */
+static ALWAYS_INLINE void arch_set_ttbr0_asid(u64 addr, u64 asid)
+{
+    arch_fence();
+    asm volatile("msr ttbr0_el1, %[x]" : : [x] "r"(addr | (asid << 48)));
+    arch_isb();
+}
+
 /* Set Translation Table Base Register 0 (EL1). */
 static ALWAYS_INLINE void arch_set_ttbr0(u64 addr)
 {
@@ -279,6 +322,18 @@ static ALWAYS_INLINE void set_cntv_tval_el0(u64 t)
     asm volatile("msr cntv_tval_el0, %0" : : "r"(t));
 }
 
+static ALWAYS_INLINE u64 get_cntkctl_el1()
+{
+    u64 c;
+    asm volatile("mrs %0, cntkctl_el1" : "=r"(c));
+    return c;
+}
+
+static ALWAYS_INLINE void set_cntkctl_el1(u64 c)
+{
+    asm volatile("msr cntkctl_el1, %0" : : "r"(c));
+}
+
 static inline WARN_RESULT bool _arch_enable_trap()
 {
     u64 t;
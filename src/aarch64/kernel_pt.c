@@ -771,9 +771,17 @@ __attribute__((__aligned__(PAGE_SIZE))) PTEntries _kernel_pt_lv2_ram = {
     0x7fc00000 | PTE_KERNEL_DATA, 0x7fe00000 | PTE_KERNEL_DATA
 };
 
+/**
+ * Bits used to index: 29:21
+ * Size per entry: 2MB, level 3 tables are allocated by vmalloc
+ * Address Span: [VMALLOC_START, VMALLOC_END)
+ */
+__attribute__((__aligned__(PAGE_SIZE))) PTEntries _kernel_pt_lv2_vmalloc = { 0 };
+
 __attribute__((__aligned__(PAGE_SIZE))) PTEntries _kernel_pt_level1 = {
-    K2P(_kernel_pt_lv2_dev) + PTE_TABLE,
-    K2P(_kernel_pt_lv2_ram) + PTE_TABLE,
+    [0] = K2P(_kernel_pt_lv2_dev) + PTE_TABLE,
+    [1] = K2P(_kernel_pt_lv2_ram) + PTE_TABLE,
+    [VA_PART1(VMALLOC_START)] = K2P(_kernel_pt_lv2_vmalloc) + PTE_TABLE,
 };
 
 __attribute__((__aligned__(PAGE_SIZE))) PTEntries kernel_pt_level0 = {
@@ -32,17 +32,31 @@ typedef unsigned long long u64;
 #define PTE_USER (1 << 6)
 #define PTE_RO (1 << 7)
 #define PTE_RW (0 << 7)
+// not global: the TLB entry is tagged with the ASID in TTBR0.
+#define PTE_NG (1 << 11)
 
 #define PTE_KERNEL_DATA (PTE_KERNEL | PTE_NORMAL | PTE_BLOCK)
 #define PTE_KERNEL_DEVICE (PTE_KERNEL | PTE_DEVICE | PTE_BLOCK)
-#define PTE_USER_DATA (PTE_USER | PTE_NORMAL | PTE_PAGE)
+#define PTE_USER_DATA (PTE_USER | PTE_NORMAL | PTE_PAGE | PTE_NG)
+#define PTE_KERNEL_PAGE (PTE_KERNEL | PTE_NORMAL | PTE_PAGE)
 
 #define N_PTE_PER_TABLE 512
 
 #define PTE_HIGH_NX (1LL << 54)
+// APTable[1] of a table entry: no writes to anything mapped below it.
+// fork() shares last-level tables with it set, see pgdir_clone().
+#define PTE_TABLE_RO (1ULL << 62)
 
 #define KSPACE_MASK 0xFFFF000000000000
 
+/**
+ * Kernel virtual areas of vmalloc: 1GB at 8GB of the kernel space,
+ * far above the RAM mapped by the kernel page table.
+ */
+#define VMALLOC_START KSPACE(0x200000000)
+#define VMALLOC_SIZE 0x40000000
+#define VMALLOC_END (VMALLOC_START + VMALLOC_SIZE)
+
 // convert kernel address into physical address.
 #define K2P(addr) ((u64)(addr) - (KSPACE_MASK))
 
@@ -11,7 +11,7 @@
 // if trap from user space:
 // returns 0 if pgfault is handled successfully,
 // else should kill user process
-static int pgfault_handler(UserContext *ctx, u64 faddr);
+static int pgfault_handler(UserContext *ctx, u64 faddr, bool write);
 
 /** Returns true if trap is from user space */
 static inline int trap_from_user(UserContext *context)
@@ -68,8 +68,6 @@ void trap_global_handler(UserContext *context)
     u64 iss = esr & ESR_ISS_MASK;
     u64 ir = esr & ESR_IR_MASK;
 
-    (void)iss;
-
     arch_reset_esr();
 
     switch (ec) {
@@ -88,7 +86,9 @@ void trap_global_handler(UserContext *context)
     case ESR_EC_DABORT_EL0:
     case ESR_EC_DABORT_EL1: {
         u64 faddr = arch_get_far();
-        if (pgfault_handler(context, faddr) < 0) {
+        bool write = (ec == ESR_EC_DABORT_EL0 || ec == ESR_EC_DABORT_EL1) &&
+                     (iss & ESR_ISS_WNR);
+        if (pgfault_handler(context, faddr, write) < 0) {
             printk("User program %d segfault! Killed\n", thisproc()->pid);
             thisproc()->killed = 1;
         }
@@ -114,18 +114,11 @@ NO_RETURN void trap_error_handler(u64 type)
     PANIC();
 }
 
-static int pgfault_handler(UserContext *ctx, u64 faddr)
+static int pgfault_handler(UserContext *ctx, u64 faddr, bool write)
 {
-    struct pgdir *pd = &thisproc()->pgdir;
     faddr = round_down(faddr, PAGE_SIZE);
     if (trap_from_user(ctx)) {
-        struct section *sec = section_search(pd, faddr);
-        if (sec == NULL) {
-            // fail
-            return -1;
-        }
-
-        return section_install(pd, sec, faddr);
+        return section_fault(faddr, write);
     }
 
     else {
@@ -5,6 +5,8 @@
 #define ESR_EC_SHIFT 26
 #define ESR_ISS_MASK 0xFFFFFF
 #define ESR_IR_MASK (1 << 25)
+// WnR of a data abort: caused by a write.
+#define ESR_ISS_WNR (1 << 6)
 
 #define ESR_EC_UNKNOWN 0x00
 #define ESR_EC_SVC64 0x15
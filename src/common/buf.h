@@ -1,7 +1,7 @@
 #pragma once
 
 #include <common/defines.h>
-#include <common/sem.h>
+#include <common/waitq.h>
 
 #define BSIZE 512
 #define B_VALID 0x2 // Buffer has been read from disk.
@@ -13,5 +13,5 @@ typedef struct {
     u32 block_no;
 
     /* @todo: It depends on you to add other necessary elements. */
-    Semaphore sem;
+    WaitQueue wq; // sleepers on the disk request, under disk.lk
 } Buf;
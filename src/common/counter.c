@@ -0,0 +1,23 @@
+#include <common/counter.h>
+
+void init_pcpu_counter(PercpuCounter *c)
+{
+    for (int i = 0; i < NCPU; i++) {
+        __atomic_store_n(&c->slot[i].val, 0, __ATOMIC_RELAXED);
+    }
+}
+
+isize pcpu_counter_read(PercpuCounter *c)
+{
+    isize ret = 0;
+    for (int i = 0; i < NCPU; i++) {
+        ret += __atomic_load_n(&c->slot[i].val, __ATOMIC_RELAXED);
+    }
+    return ret;
+}
+
+isize pcpu_counter_read_cpu(PercpuCounter *c, int cpu)
+{
+    ASSERT(cpu >= 0 && cpu < NCPU);
+    return __atomic_load_n(&c->slot[cpu].val, __ATOMIC_RELAXED);
+}
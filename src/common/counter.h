@@ -0,0 +1,38 @@
+#pragma once
+
+#include <common/defines.h>
+#include <aarch64/intrinsic.h>
+#include <fdutil/stddef.h>
+
+/**
+ * Per-cpu statistics counters.
+ *
+ * Every cpu adds to a slot in its own cache line, so hot counters do
+ * not bounce a shared line between cores; readers fold all slots.
+ * Kernel code runs with traps disabled, so a cpu updates its slot
+ * without atomic read-modify-write. A fold that races with updates may
+ * be slightly stale, but it is exact once the updates have finished.
+ */
+typedef struct {
+    struct {
+        isize val;
+    } __attribute__((aligned(64))) slot[NCPU];
+} PercpuCounter;
+
+void init_pcpu_counter(PercpuCounter *);
+
+static INLINE void pcpu_counter_add(PercpuCounter *c, isize n)
+{
+    isize *val = &c->slot[cpuid()].val;
+    // a single store, so that readers never see a torn value.
+    __atomic_store_n(val, *val + n, __ATOMIC_RELAXED);
+}
+
+#define pcpu_counter_inc(c) pcpu_counter_add(c, 1)
+#define pcpu_counter_dec(c) pcpu_counter_add(c, -1)
+
+/** @return the sum of all cpus. */
+WARN_RESULT isize pcpu_counter_read(PercpuCounter *);
+
+/** @return the part of cpu only. */
+WARN_RESULT isize pcpu_counter_read_cpu(PercpuCounter *, int cpu);
@@ -0,0 +1,94 @@
+#include <common/mutex.h>
+#include <common/counter.h>
+#include <kernel/sched.h>
+
+static PercpuCounter nfast, nspin, nsleep;
+
+void init_mutex(Mutex *m)
+{
+    m->owner = NULL;
+    m->nwait = 0;
+    init_spinlock(&m->lock);
+    init_waitq(&m->wq);
+}
+
+static INLINE bool cas_owner(Mutex *m, Proc *p)
+{
+    Proc *expected = NULL;
+    return __atomic_compare_exchange_n(&m->owner, &expected, p, false,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+bool try_acquire_mutex(Mutex *m)
+{
+    return m->owner == NULL && cas_owner(m, thisproc());
+}
+
+/** Spin while the owner runs on another cpu.
+ * @return true if acquired. */
+static bool spin_on_owner(Mutex *m, Proc *me)
+{
+    while (1) {
+        Proc *owner = __atomic_load_n(&m->owner, __ATOMIC_RELAXED);
+        if (owner == NULL) {
+            if (cas_owner(m, me)) {
+                return true;
+            }
+            continue;
+        }
+        // racy, but the owner cannot go away while it holds m, and a
+        // wrong guess only costs a spin or a sleep.
+        if (owner->state != RUNNING) {
+            return false;
+        }
+        arch_yield();
+    }
+}
+
+void acquire_mutex(Mutex *m)
+{
+    Proc *me = thisproc();
+    ASSERT(m->owner != me);
+    if (cas_owner(m, me)) {
+        pcpu_counter_inc(&nfast);
+        return;
+    }
+    if (spin_on_owner(m, me)) {
+        pcpu_counter_inc(&nspin);
+        return;
+    }
+
+    acquire_spinlock(&m->lock);
+    // announce before trying again, release_mutex() checks nwait
+    // after it clears owner, so one of them sees the other.
+    __atomic_store_n(&m->nwait, m->nwait + 1, __ATOMIC_SEQ_CST);
+    while (!cas_owner(m, me)) {
+        ASSERT(waitq_sleep(&m->wq, &m->lock, false));
+    }
+    __atomic_store_n(&m->nwait, m->nwait - 1, __ATOMIC_RELAXED);
+    release_spinlock(&m->lock);
+    pcpu_counter_inc(&nsleep);
+}
+
+void release_mutex(Mutex *m)
+{
+    ASSERT(m->owner == thisproc());
+    __atomic_store_n(&m->owner, NULL, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&m->nwait, __ATOMIC_SEQ_CST) > 0) {
+        acquire_spinlock(&m->lock);
+        waitq_wake_one(&m->wq);
+        release_spinlock(&m->lock);
+    }
+}
+
+bool holding_mutex(Mutex *m)
+{
+    return m->owner == thisproc();
+}
+
+void mutex_stat(struct mutex_stat *st)
+{
+    st->nfast = pcpu_counter_read(&nfast);
+    st->nspin = pcpu_counter_read(&nspin);
+    st->nsleep = pcpu_counter_read(&nsleep);
+}
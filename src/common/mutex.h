@@ -0,0 +1,38 @@
+#pragma once
+
+#include <common/spinlock.h>
+#include <common/waitq.h>
+
+struct Proc;
+
+/**
+ * Adaptive sleeping mutex.
+ *
+ * It records its owner. A contended acquire spins as long as the owner
+ * is running on another cpu, since it is likely to release soon, and
+ * only sleeps when the owner is not running. An uncontended acquire
+ * or release is a single atomic operation on owner.
+ *
+ * Unlike SleepLock, acquiring is not alertable.
+ */
+typedef struct {
+    struct Proc *volatile owner; // NULL if free
+    int nwait; // procs about to sleep or sleeping on wq
+    SpinLock lock; // protects wq
+    WaitQueue wq;
+} Mutex;
+
+void init_mutex(Mutex *);
+WARN_RESULT bool try_acquire_mutex(Mutex *);
+void acquire_mutex(Mutex *);
+void release_mutex(Mutex *);
+/** @return true if the current proc holds it. */
+WARN_RESULT bool holding_mutex(Mutex *);
+
+struct mutex_stat {
+    isize nfast; // acquired at once
+    isize nspin; // acquired after spinning on a running owner
+    isize nsleep; // slept before acquired
+};
+
+void mutex_stat(struct mutex_stat *st);
@@ -0,0 +1,92 @@
+#include <common/rwlock.h>
+#include <common/counter.h>
+#include <kernel/sched.h>
+
+static PercpuCounter nread, nwrite, nrsleep, nwsleep;
+
+void init_rwlock(RWLock *l, bool prefer_writer)
+{
+    init_spinlock(&l->lock);
+    l->nreader = 0;
+    l->nwwait = 0;
+    l->writer = NULL;
+    l->prefer_writer = prefer_writer;
+    init_waitq(&l->rwq);
+    init_waitq(&l->wwq);
+}
+
+static INLINE bool reader_blocked(RWLock *l)
+{
+    return l->writer != NULL || (l->prefer_writer && l->nwwait > 0);
+}
+
+void acquire_rwlock_read(RWLock *l)
+{
+    acquire_spinlock(&l->lock);
+    ASSERT(l->writer != thisproc());
+    if (reader_blocked(l)) {
+        pcpu_counter_inc(&nrsleep);
+        do {
+            ASSERT(waitq_sleep(&l->rwq, &l->lock, false));
+        } while (reader_blocked(l));
+    }
+    l->nreader++;
+    release_spinlock(&l->lock);
+    pcpu_counter_inc(&nread);
+}
+
+void release_rwlock_read(RWLock *l)
+{
+    acquire_spinlock(&l->lock);
+    ASSERT(l->nreader > 0);
+    if (--l->nreader == 0) {
+        waitq_wake_one(&l->wwq);
+    }
+    release_spinlock(&l->lock);
+}
+
+void acquire_rwlock_write(RWLock *l)
+{
+    Proc *me = thisproc();
+    acquire_spinlock(&l->lock);
+    ASSERT(l->writer != me);
+    if (l->writer != NULL || l->nreader > 0) {
+        pcpu_counter_inc(&nwsleep);
+        l->nwwait++;
+        do {
+            ASSERT(waitq_sleep(&l->wwq, &l->lock, false));
+        } while (l->writer != NULL || l->nreader > 0);
+        l->nwwait--;
+    }
+    l->writer = me;
+    release_spinlock(&l->lock);
+    pcpu_counter_inc(&nwrite);
+}
+
+void release_rwlock_write(RWLock *l)
+{
+    acquire_spinlock(&l->lock);
+    ASSERT(l->writer == thisproc());
+    l->writer = NULL;
+    // hand over to the next writer first if writers are preferred,
+    // otherwise let all sleeping readers in at once.
+    if (l->prefer_writer && l->nwwait > 0) {
+        waitq_wake_one(&l->wwq);
+    } else if (waitq_wake_all(&l->rwq) == 0) {
+        waitq_wake_one(&l->wwq);
+    }
+    release_spinlock(&l->lock);
+}
+
+bool holding_rwlock_write(RWLock *l)
+{
+    return l->writer == thisproc();
+}
+
+void rwlock_stat(struct rwlock_stat *st)
+{
+    st->nread = pcpu_counter_read(&nread);
+    st->nwrite = pcpu_counter_read(&nwrite);
+    st->nrsleep = pcpu_counter_read(&nrsleep);
+    st->nwsleep = pcpu_counter_read(&nwsleep);
+}
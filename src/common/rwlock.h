@@ -0,0 +1,43 @@
+#pragma once
+
+#include <common/spinlock.h>
+#include <common/waitq.h>
+
+struct Proc;
+
+/**
+ * Sleeping reader-writer lock.
+ *
+ * Any number of readers, or a single writer, may hold it. Readers and
+ * writers sleep on separate queues. With prefer_writer, a reader does
+ * not enter while a writer waits, so that writers cannot be starved by
+ * a stream of readers. Otherwise readers enter as long as no writer
+ * holds the lock.
+ *
+ * A reader cannot upgrade to a writer, and acquiring is not alertable.
+ */
+typedef struct {
+    SpinLock lock; // protects all below
+    int nreader; // active readers
+    int nwwait; // writers sleeping on wwq
+    struct Proc *writer; // NULL if no writer holds it
+    bool prefer_writer;
+    WaitQueue rwq, wwq;
+} RWLock;
+
+void init_rwlock(RWLock *, bool prefer_writer);
+void acquire_rwlock_read(RWLock *);
+void release_rwlock_read(RWLock *);
+void acquire_rwlock_write(RWLock *);
+void release_rwlock_write(RWLock *);
+/** @return true if the current proc holds the write side. */
+WARN_RESULT bool holding_rwlock_write(RWLock *);
+
+struct rwlock_stat {
+    isize nread; // read acquires
+    isize nwrite; // write acquires
+    isize nrsleep; // readers that slept
+    isize nwsleep; // writers that slept
+};
+
+void rwlock_stat(struct rwlock_stat *st);
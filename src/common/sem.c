@@ -1,14 +1,11 @@
 #include <common/sem.h>
-#include <kernel/mem.h>
-#include <kernel/sched.h>
 #include <kernel/printk.h>
-#include <common/list.h>
 
 void init_sem(Semaphore *sem, int val)
 {
     sem->val = val;
     init_spinlock(&sem->lock);
-    init_list_node(&sem->sleeplist);
+    init_waitq(&sem->wq);
 }
 
 void _lock_sem(Semaphore *sem)
@@ -65,32 +62,18 @@ bool _wait_sem(Semaphore *sem, bool alertable)
         release_spinlock(&sem->lock);
         return true;
     }
-    WaitData *wait = kalloc(sizeof(WaitData));
-    wait->proc = thisproc();
-    wait->up = false;
-    _insert_into_list(&sem->sleeplist, &wait->slnode);
-    acquire_sched_lock();
-    release_spinlock(&sem->lock);
-    sched(alertable ? SLEEPING : DEEPSLEEPING);
-    acquire_spinlock(&sem->lock); // also the lock for waitdata
-    if (!wait->up) // wakeup by other sources
-    {
+    bool ret = waitq_sleep(&sem->wq, &sem->lock, alertable);
+    if (!ret) {
+        // woken up by other sources, give back the count.
         ASSERT(++sem->val <= 0);
-        _detach_from_list(&wait->slnode);
     }
     release_spinlock(&sem->lock);
-    bool ret = wait->up;
-    kfree(wait);
     return ret;
 }
 
 void _post_sem(Semaphore *sem)
 {
     if (++sem->val <= 0) {
-        ASSERT(!_empty_list(&sem->sleeplist));
-        auto wait = container_of(sem->sleeplist.prev, WaitData, slnode);
-        wait->up = true;
-        _detach_from_list(&wait->slnode);
-        activate_proc(wait->proc);
+        ASSERT(waitq_wake_one(&sem->wq));
     }
-}
\ No newline at end of file
+}
@@ -1,19 +1,11 @@
 #pragma once
 
-#include <common/list.h>
-
-struct Proc;
-
-typedef struct {
-    bool up;
-    struct Proc *proc;
-    ListNode slnode;
-} WaitData;
+#include <common/waitq.h>
 
 typedef struct {
     SpinLock lock;
     int val;
-    ListNode sleeplist;
+    WaitQueue wq; // protected by lock
 } Semaphore;
 
 void init_sem(Semaphore *, int val);
@@ -1,28 +1,162 @@
 #include <aarch64/intrinsic.h>
 #include <common/spinlock.h>
 
+#ifdef LOCK_STAT
+#include <kernel/printk.h>
+
+/** Size of the table of acquisition sites, a power of 2 */
+#define NSITE 512
+
+/** Statistics of the locks taken at one site */
+struct lock_site {
+    const void *site; // caller of acquire, NULL if the slot is free
+    u64 nacq; // acquisitions
+    u64 ncont; // acquisitions that had to wait
+    u64 spin; // timer ticks spent waiting
+    u64 maxhold; // longest hold, in timer ticks
+};
+
+/** Open addressing by site, slots are claimed and never freed */
+static struct lock_site sites[NSITE];
+/** Acquisitions not recorded as the table was full */
+static u64 nlost;
+
+static struct lock_site *site_of(const void *site)
+{
+    u64 h = ((u64)site >> 2) * 0x9e3779b97f4a7c15ul;
+    for (int i = 0; i < NSITE; i++) {
+        struct lock_site *s = &sites[(h + i) & (NSITE - 1)];
+        const void *key = __atomic_load_n(&s->site, __ATOMIC_ACQUIRE);
+        if (key == NULL &&
+            __atomic_compare_exchange_n(&s->site, &key, site, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            return s;
+        }
+        if (key == site) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+/** Called with lock held. */
+static void stat_acquired(SpinLock *lock, u64 start, bool waited,
+                          const void *site)
+{
+    u64 now = get_timestamp();
+    struct lock_site *s = site_of(site);
+    lock->site = s;
+    lock->since = now;
+    if (s == NULL) {
+        __atomic_fetch_add(&nlost, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    __atomic_fetch_add(&s->nacq, 1, __ATOMIC_RELAXED);
+    if (waited) {
+        __atomic_fetch_add(&s->ncont, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&s->spin, now - start, __ATOMIC_RELAXED);
+    }
+}
+
+static void stat_released(SpinLock *lock)
+{
+    struct lock_site *s = lock->site;
+    if (s == NULL) {
+        return;
+    }
+    u64 hold = get_timestamp() - lock->since;
+    u64 max = __atomic_load_n(&s->maxhold, __ATOMIC_RELAXED);
+    while (hold > max &&
+           !__atomic_compare_exchange_n(&s->maxhold, &max, hold, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+#endif
+
 void init_spinlock(SpinLock *lock)
 {
-    lock->locked = 0;
+    __atomic_store_n(&lock->val, 0, __ATOMIC_RELAXED);
 }
 
 bool try_acquire_spinlock(SpinLock *lock)
 {
-    if (!lock->locked &&
-        !__atomic_test_and_set(&lock->locked, __ATOMIC_ACQUIRE)) {
-        return true;
-    } else {
+    u32 v = __atomic_load_n(&lock->val, __ATOMIC_RELAXED);
+    // free only if the next ticket is being served.
+    if ((v & 0xffff) != (v >> 16) ||
+        !__atomic_compare_exchange_n(&lock->val, &v, v + 0x10000, false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
         return false;
     }
+#ifdef LOCK_STAT
+    stat_acquired(lock, 0, false, __builtin_return_address(0));
+#endif
+    return true;
 }
 
 void acquire_spinlock(SpinLock *lock)
 {
-    while (!try_acquire_spinlock(lock))
+#ifdef LOCK_STAT
+    u64 start = get_timestamp();
+    bool waited = false;
+#endif
+    u16 ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+    while (__atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE) != ticket) {
+#ifdef LOCK_STAT
+        waited = true;
+#endif
         arch_yield();
+    }
+#ifdef LOCK_STAT
+    stat_acquired(lock, start, waited, __builtin_return_address(0));
+#endif
 }
 
 void release_spinlock(SpinLock *lock)
 {
-    __atomic_clear(&lock->locked, __ATOMIC_RELEASE);
+#ifdef LOCK_STAT
+    stat_released(lock);
+#endif
+    // only the holder writes owner.
+    __atomic_store_n(&lock->owner, lock->owner + 1, __ATOMIC_RELEASE);
+}
+
+#ifdef LOCK_STAT
+void lock_stat_dump(int n, bool reset)
+{
+    // select the top n one by one. Racy, and sites that tie with
+    // a printed one are skipped, which is fine for statistics.
+    u64 bound = (u64)-1;
+    printk("lock sites waited longest(ticks), %lld not recorded:\n",
+           (i64)nlost);
+    for (int i = 0; i < n; i++) {
+        struct lock_site *top = NULL;
+        for (int j = 0; j < NSITE; j++) {
+            struct lock_site *s = &sites[j];
+            if (s->site != NULL && s->spin < bound &&
+                (top == NULL || s->spin > top->spin)) {
+                top = s;
+            }
+        }
+        if (top == NULL || top->nacq == 0) {
+            break;
+        }
+        printk("  %p: %lld acquisitions, %lld contended, spin %lld, "
+               "max hold %lld\n",
+               top->site, (i64)top->nacq, (i64)top->ncont, (i64)top->spin,
+               (i64)top->maxhold);
+        bound = top->spin;
+    }
+    if (reset) {
+        for (int j = 0; j < NSITE; j++) {
+            sites[j].nacq = sites[j].ncont = 0;
+            sites[j].spin = sites[j].maxhold = 0;
+        }
+        nlost = 0;
+    }
+}
+#else
+void lock_stat_dump(int n __attribute__((unused)),
+                    bool reset __attribute__((unused)))
+{
 }
+#endif
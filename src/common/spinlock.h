@@ -3,11 +3,41 @@
 #include <common/defines.h>
 #include <aarch64/intrinsic.h>
 
-typedef struct {
-    volatile bool locked;
+/**
+ * Ticket spinlock: waiters take a ticket and are served in order, so
+ * the lock is fair and a release does not start a stampede of atomic
+ * writes on the lock. A zeroed lock is unlocked.
+ *
+ * Build with LOCK_STAT(cmake -DLOCK_STAT=ON) to record contention per
+ * acquisition site, i.e. the caller of acquire_spinlock(): acquisitions,
+ * contended acquisitions, cycles spent spinning and the longest hold.
+ * The statistics live in a fixed table rather than in the locks, so
+ * locks may be freed with their objects, see lock_stat_dump().
+ */
+
+#ifdef LOCK_STAT
+struct lock_site;
+#endif
+
+typedef struct SpinLock {
+    union {
+        volatile u32 val;
+        struct {
+            volatile u16 owner; // ticket being served
+            volatile u16 next; // next ticket to hand out
+        };
+    };
+#ifdef LOCK_STAT
+    u64 since; // when it was acquired
+    struct lock_site *site; // where it was acquired
+#endif
 } SpinLock;
 
 void init_spinlock(SpinLock *);
 WARN_RESULT bool try_acquire_spinlock(SpinLock *);
 void acquire_spinlock(SpinLock *);
 void release_spinlock(SpinLock *);
+
+/** Print the n acquisition sites that waited longest, and reset all
+ * counters if reset is true. Does nothing without LOCK_STAT. */
+void lock_stat_dump(int n, bool reset);
@@ -0,0 +1,46 @@
+#include <common/waitq.h>
+#include <kernel/sched.h>
+
+void init_waitq(WaitQueue *wq)
+{
+    init_list_node(&wq->sleeplist);
+}
+
+bool waitq_sleep(WaitQueue *wq, SpinLock *lock, bool alertable)
+{
+    WaitData wait;
+    wait.proc = thisproc();
+    wait.up = false;
+    _insert_into_list(&wq->sleeplist, &wait.slnode);
+    acquire_sched_lock();
+    release_spinlock(lock);
+    sched(alertable ? SLEEPING : DEEPSLEEPING);
+    acquire_spinlock(lock); // also the lock for wait
+    if (!wait.up) {
+        // woken up by other sources, still on the queue.
+        _detach_from_list(&wait.slnode);
+    }
+    return wait.up;
+}
+
+bool waitq_wake_one(WaitQueue *wq)
+{
+    if (_empty_list(&wq->sleeplist)) {
+        return false;
+    }
+    // inserted after the head, so the earliest is at the tail.
+    WaitData *wait = container_of(wq->sleeplist.prev, WaitData, slnode);
+    wait->up = true;
+    _detach_from_list(&wait->slnode);
+    activate_proc(wait->proc);
+    return true;
+}
+
+int waitq_wake_all(WaitQueue *wq)
+{
+    int ret = 0;
+    while (waitq_wake_one(wq)) {
+        ret++;
+    }
+    return ret;
+}
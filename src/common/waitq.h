@@ -0,0 +1,42 @@
+#pragma once
+
+#include <common/list.h>
+
+struct Proc;
+
+/** A sleeping proc. It lives on the stack of the sleeper, so that
+ * sleeping never allocates.
+ */
+typedef struct {
+    bool up; // woken up by waitq_wake_*, rather than alerted
+    struct Proc *proc;
+    ListNode slnode;
+} WaitData;
+
+/** A FIFO queue of sleeping procs. It has no lock of its own: it is
+ * protected by a spinlock of its user, which must be held by all
+ * operations below.
+ */
+typedef struct {
+    ListNode sleeplist;
+} WaitQueue;
+
+void init_waitq(WaitQueue *wq);
+
+/** Sleep on wq. lock protects wq, it is released while sleeping and
+ * held again on return.
+ * @return true if woken up by waitq_wake_*, false if alerted.
+ */
+WARN_RESULT bool waitq_sleep(WaitQueue *wq, SpinLock *lock, bool alertable);
+
+/** Wake up the earliest sleeper.
+ * @return false if nobody sleeps on wq.
+ */
+bool waitq_wake_one(WaitQueue *wq);
+
+/** Wake up all sleepers.
+ * @return number of procs woken up.
+ */
+int waitq_wake_all(WaitQueue *wq);
+
+#define waitq_empty(wq) _empty_list(&(wq)->sleeplist)
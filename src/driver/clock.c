@@ -12,6 +12,9 @@ static struct {
 
 void init_clock()
 {
+    // EL0VCTEN: let user programs read cntvct_el0 and cntfrq_el0,
+    // so they can time themselves.
+    set_cntkctl_el1(get_cntkctl_el1() | 2);
     // reserve one second for the first time.
     enable_timer();
     reset_clock(10);
@@ -19,8 +22,10 @@ void init_clock()
 
 void reset_clock(u64 interval_ms)
 {
-    u64 interval_clk = interval_ms * get_clock_frequency() / 1000;
-    ASSERT(interval_clk <= 0x7fffffff);
+    // the timer value is a signed 32-bit count down.
+    const u64 max_ms = 0x7fffffffull * 1000 / get_clock_frequency();
+    u64 interval_clk =
+            MIN(interval_ms, max_ms) * get_clock_frequency() / 1000;
     set_cntv_tval_el0(interval_clk);
 }
 
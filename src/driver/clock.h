@@ -6,6 +6,10 @@ typedef void (*ClockHandler)(void);
 
 WARN_RESULT u64 get_timestamp_ms();
 void init_clock();
+/** The clock fires at the latest about every 30s(its range), which
+ * is as good as never for a cpu that has no timer. */
+#define CLOCK_FOREVER ((u64)-1)
+/** Fire the clock interrupt after interval_ms, at most its range. */
 void reset_clock(u64 interval_ms);
 void set_clock_handler(ClockHandler handler);
 void invoke_clock_handler();
@@ -74,6 +74,11 @@ static inline void w_icc_eoir1_el1(u32 x)
     asm volatile("msr S3_0_C12_C12_1, %0" : : "r"(x));
 }
 
+static inline void w_icc_sgi1r_el1(u64 x)
+{
+    asm volatile("msr S3_0_C12_C11_5, %0" : : "r"(x));
+}
+
 static inline u32 icc_sre_el1()
 {
     u32 x;
@@ -248,6 +253,7 @@ void gicv3_init_percpu()
     gic_redist_init(cpu);
 
     gic_setup_ppi(cpuid(), TIMER_IRQ, 0);
+    gic_setup_ppi(cpuid(), RESCHED_IRQ, 0);
 
     gic_enable();
 }
@@ -279,6 +285,16 @@ void gic_eoi(u32 iar)
     w_icc_eoir1_el1(iar);
 }
 
+void gic_send_sgi(u32 cpu, u32 intid)
+{
+    ASSERT(intid < 16 && cpu < 16);
+    // all cpus are in cluster 0, Aff0 is the cpuid.
+    // make the stores before visible to the target first.
+    asm volatile("dsb ishst" ::: "memory");
+    w_icc_sgi1r_el1(((u64)intid << 24) | (1ull << cpu));
+    arch_isb();
+}
+
 static bool is_sgi_ppi(u32 id)
 {
     if (id < 32)
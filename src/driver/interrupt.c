@@ -8,6 +8,11 @@
 
 static InterruptHandler int_handler[NUM_IRQ_TYPES];
 
+/** Interrupts taken by each cpu, by intid */
+static struct {
+    u64 cnt[NUM_IRQ_TYPES];
+} __attribute__((aligned(64))) nirq[NCPU];
+
 static void default_handler(u32 intid)
 {
     printk("[Error CPU %lld]: Interrupt %d not implemented.", cpuid(), intid);
@@ -26,6 +31,12 @@ void set_interrupt_handler(InterruptType type, InterruptHandler handler)
     int_handler[type] = handler;
 }
 
+void send_ipi(int cpu, InterruptType type)
+{
+    ASSERT(type < 16);
+    gic_send_sgi((u32)cpu, (u32)type);
+}
+
 void interrupt_global_handler()
 {
     u32 iar = gic_iar();
@@ -38,10 +49,38 @@ void interrupt_global_handler()
     }
 
     gic_eoi(iar);
+    nirq[cpuid()].cnt[intid]++;
 
     if (int_handler[intid])
         int_handler[intid](intid);
-    if (intid == TIMER_IRQ) {
+    if (intid == TIMER_IRQ || intid == RESCHED_IRQ) {
         yield();
     }
 }
+
+u64 interrupt_count(int cpu, InterruptType type)
+{
+    ASSERT(cpu >= 0 && cpu < NCPU && type < NUM_IRQ_TYPES);
+    // racy, which is fine for statistics.
+    return nirq[cpu].cnt[type];
+}
+
+void interrupt_dump()
+{
+    static const struct {
+        InterruptType type;
+        const char *name;
+    } types[] = {
+        { RESCHED_IRQ, "resched" }, { TIMER_IRQ, "timer" },
+        { UART_IRQ, "uart" },       { PCIE_IRQ, "pcie" },
+        { VIRTIO_BLK_IRQ, "blk" },
+    };
+    for (int i = 0; i < NCPU; i++) {
+        printk("cpu %d:", i);
+        for (usize j = 0; j < sizeof(types) / sizeof(types[0]); j++) {
+            printk(" %s %lld", types[j].name,
+                   (i64)interrupt_count(i, types[j].type));
+        }
+        printk("\n");
+    }
+}
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <common/defines.h>
+
 #define NUM_IRQ_TYPES 64
 
 typedef enum {
+    RESCHED_IRQ = 1, // SGI, kicks an idle cpu to look at its run queue
     TIMER_IRQ = 27,
     UART_IRQ = 33,
     PCIE_IRQ = 36,
@@ -14,3 +17,10 @@ typedef void (*InterruptHandler)();
 void init_interrupt();
 void interrupt_global_handler();
 void set_interrupt_handler(InterruptType type, InterruptHandler handler);
+/** Send an inter-processor interrupt, type must be a SGI. */
+void send_ipi(int cpu, InterruptType type);
+
+/** Interrupts of type taken by cpu so far. */
+u64 interrupt_count(int cpu, InterruptType type);
+/** Print the interrupt counts of each cpu. */
+void interrupt_dump();
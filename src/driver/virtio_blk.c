@@ -2,7 +2,7 @@
 #include <driver/virtio.h>
 #include <driver/interrupt.h>
 #include <common/buf.h>
-#include <common/sem.h>
+#include <common/waitq.h>
 #include <common/string.h>
 #include <fdutil/stdint.h>
 #include <kernel/mem.h>
@@ -66,7 +66,7 @@ int virtio_blk_rw(Buf *b)
     if (b->flags & B_DIRTY)
         op = DWRITE;
 
-    init_sem(&b->sem, 0);
+    init_waitq(&b->wq);
 
     u64 sector = b->block_no;
     struct virtio_blk_req_hdr hdr;
@@ -118,17 +118,12 @@ int virtio_blk_rw(Buf *b)
     arch_fence();
 
     while (!disk.virtq.info[d0].done) {
-        /* Take the semaphore lock, and then release the disk lock.
-          There's no deadlocks for disk.lk is always held first. */
-        _lock_sem(&b->sem);
-        release_spinlock(&disk.lk);
-        /* Will unlock b->sem.lock */
-        if (!_wait_sem(&b->sem, false)) {
+        /* Sleep on the buffer, disk.lk is released while sleeping. */
+        if (!waitq_sleep(&b->wq, &disk.lk, false)) {
             // failure
-            _unlock_sem(&b->sem);
+            release_spinlock(&disk.lk);
             return 1;
         }
-        acquire_spinlock(&disk.lk);
     }
     /* LAB 4 TODO 1 BEGIN */
 
@@ -163,7 +158,7 @@ static void virtio_blk_intr()
         // void *offset = &(((Buf *)0x0)->data);
         baddr -= offset_of(Buf, data);
         Buf *buf = (Buf *)baddr;
-        post_sem(&buf->sem);
+        waitq_wake_all(&buf->wq);
         /* LAB 4 TODO 2 BEGIN */
 
         /* LAB 4 TODO 2 END */
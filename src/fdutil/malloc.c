@@ -4,10 +4,37 @@
 #include "lst.h"
 #include <common/spinlock.h>
 #include <common/string.h>
-#include <common/rc.h>
+#include <common/counter.h>
+#include <common/list.h>
+#include <aarch64/intrinsic.h>
 
 /** For testing */
-extern RefCount kalloc_page_cnt;
+extern PercpuCounter kalloc_page_cnt;
+
+/** A free block in a per-cpu cache */
+struct mobj {
+    struct mobj *nxt;
+};
+
+/** Maximum number of blocks in a per-cpu cache */
+#define MC_MAX 64
+
+/**
+ * Per-cpu cache of free blocks of a descriptor. Only its cpu
+ * touches nobj and objs, so no lock is needed(the kernel does not
+ * sleep or take traps inside malloc/free). Blocks freed by other 
+ * cpus are pushed onto the lock-free remote queue instead.
+ */
+struct mcache {
+    struct mobj *objs; // cached free blocks
+    uint32_t nobj; // length of objs
+    uint32_t nremote; // approximate length of remote
+    QueueNode *remote; // blocks freed by other cpus
+} __attribute__((aligned(64)));
+
+/**< Statistics of the per-cpu caches, over all descriptors */
+static PercpuCounter mc_nhit; // allocations served by objs
+static PercpuCounter mc_nrefill; // batches taken from the descriptor
 
 /** A descriptor */
 struct desc {
@@ -17,6 +44,10 @@ struct desc {
     /** Immutable members */
     uint32_t bsz; // size of blocks
     uint32_t bpa; // blocks per arena
+    uint32_t ncache; // capacity of a per-cpu cache
+    uint32_t nbatch; // blocks moved to/from flst at a time
+
+    struct mcache caches[NCPU];
 };
 
 /** Add a page of blocks to descriptor d. 
@@ -26,8 +57,9 @@ static int add_blocks(struct desc *d);
 
 /** An arena */
 struct arena {
-    struct desc *desc; // descriptor
-    uint32_t nfr; // number of free block
+    struct desc *desc; // descriptor, NULL for a large block
+    uint16_t nfr; // number of free block(pages of a large block)
+    uint16_t cpu; // cpu whose cache its blocks are freed to
     uint32_t magic; // magic number
 };
 
@@ -64,6 +96,23 @@ static inline struct arena *block2arena(void *blk);
 /** Free the space of an arena */
 static void arena_free(struct arena *a);
 
+/** Move up to d->nbatch blocks from d->flst to mc.
+ * @return number of blocks moved.
+ */
+static uint32_t cache_refill(struct desc *d, struct mcache *mc);
+
+/** Move n blocks from mc back to d->flst. */
+static void cache_drain(struct desc *d, struct mcache *mc, uint32_t n);
+
+/** Put a block back to d->flst. Must hold d->lock. */
+static void block_put(struct desc *d, void *blk);
+
+/** Allocate a block of multiple pages. */
+static void *large_alloc(size_t nb);
+
+/** Free a block from large_alloc(). */
+static void large_free(struct arena *a);
+
 /** Descriptors(private) */
 static struct desc descs[NDESC];
 
@@ -76,6 +125,7 @@ static struct palloc_intf pintf;
 void malloc_init(void)
 {
     STATIC_ASSERT(sizeof(struct arena) % 8 == 0);
+    STATIC_ASSERT(sizeof(struct arena) == 16);
     // initialize 8 descriptors, each handles memory
     // block of size:
     // 16, 32, 64, 128, 256
@@ -95,14 +145,21 @@ void malloc_init(void)
         init_spinlock(&descs[i].lock);
         list_init(&descs[i].flst);
         ASSERT(list_empty(&descs[i].flst));
+
+        // do not let each cpu hold more than 2 arenas.
+        descs[i].ncache = MIN((uint32_t)MC_MAX, descs[i].bpa * 2);
+        descs[i].nbatch = (descs[i].ncache + 1) / 2;
+        memset(descs[i].caches, 0, sizeof(descs[i].caches));
     }
+    init_pcpu_counter(&mc_nhit);
+    init_pcpu_counter(&mc_nrefill);
 
     /** Directly use pallocator interface */
     pintf.get = palloc_get;
     pintf.free = palloc_free;
-    /** Do not support alloc/free multiple pages */
-    pintf.getmult = NULL;
-    pintf.freemult = NULL;
+    /** Blocks larger than a page come from the buddy allocator */
+    pintf.getmult = palloc_get_mult;
+    pintf.freemult = palloc_free_mult;
 }
 
 /** Initialize malloc with a different allocator 
@@ -125,7 +182,6 @@ void *malloc(size_t nb)
     }
     // round nb up to power of 2.
     struct desc *d = NULL;
-    void *ret;
 
     for (int i = 0; i < NDESC; i++) {
         if (nb <= descs[i].bsz) {
@@ -136,29 +192,22 @@ void *malloc(size_t nb)
 
     // no fitting descriptor.
     if (d == NULL) {
-        return NULL;
+        return large_alloc(nb);
     }
 
-    acquire_spinlock(&d->lock);
-    if (list_empty(&d->flst)) {
-        // fetch another page, and put its blocks
-        // onto the free list of the descriptor.
-        // must hold the lock when doing so.
-        if (add_blocks(d) == 0) {
+    struct mcache *mc = &d->caches[cpuid()];
+    if (mc->nobj == 0) {
+        if (cache_refill(d, mc) == 0) {
             // allocation failure
-            // release the lock, return null.
-            release_spinlock(&d->lock);
             return NULL;
         }
+    } else {
+        pcpu_counter_inc(&mc_nhit);
     }
-    ASSERT(!list_empty(&d->flst));
-
-    ret = (void *)list_pop_front(&d->flst);
-    struct arena *ar = block2arena(ret);
-    ASSERT(ar->nfr > 0);
-    ar->nfr--;
 
-    release_spinlock(&d->lock);
+    struct mobj *ret = mc->objs;
+    mc->objs = ret->nxt;
+    mc->nobj--;
     return ret;
 }
 
@@ -172,23 +221,163 @@ void free(void *pt __attribute__((unused)))
     // get arena and descriptor
     struct arena *ar = block2arena(pt);
     struct desc *d = ar->desc;
-    ASSERT(d != NULL);
+    if (d == NULL) {
+        large_free(ar);
+        return;
+    }
+    ASSERT(ar->cpu < NCPU);
+
+    // make it easier to trigger use-after-free
+    memset(pt, 0xcc, d->bsz);
+
+    const int cpu = cpuid();
+    if (ar->cpu != cpu) {
+        // remote free: hand it to the cpu that owns the arena,
+        // so that arenas do not migrate between cpus.
+        struct mcache *home = &d->caches[ar->cpu];
+        if (__atomic_add_fetch(&home->nremote, 1, __ATOMIC_RELAXED) <=
+            d->ncache) {
+            add_to_queue(&home->remote, (QueueNode *)pt);
+            return;
+        }
+
+        // the owner is not allocating, put it back directly.
+        __atomic_sub_fetch(&home->nremote, 1, __ATOMIC_RELAXED);
+        acquire_spinlock(&d->lock);
+        block_put(d, pt);
+        release_spinlock(&d->lock);
+        return;
+    }
+
+    struct mcache *mc = &d->caches[cpu];
+    if (mc->nobj >= d->ncache) {
+        // cache is full, give a batch back.
+        cache_drain(d, mc, d->nbatch);
+    }
+    struct mobj *obj = pt;
+    obj->nxt = mc->objs;
+    mc->objs = obj;
+    mc->nobj++;
+}
+
+void malloc_drain(void)
+{
+    const int cpu = cpuid();
+    for (int i = 0; i < NDESC; i++) {
+        struct desc *d = &descs[i];
+        struct mcache *mc = &d->caches[cpu];
+        acquire_spinlock(&d->lock);
+
+        // blocks freed by other cpus.
+        QueueNode *q = fetch_all_from_queue(&mc->remote);
+        while (q != NULL) {
+            QueueNode *nxt = q->next;
+            __atomic_sub_fetch(&mc->nremote, 1, __ATOMIC_RELAXED);
+            block_put(d, q);
+            q = nxt;
+        }
+
+        // blocks cached by this cpu.
+        while (mc->nobj > 0) {
+            struct mobj *obj = mc->objs;
+            mc->objs = obj->nxt;
+            mc->nobj--;
+            block_put(d, obj);
+        }
+        release_spinlock(&d->lock);
+    }
+}
+
+void malloc_stat(int cpu, struct malloc_stat *st)
+{
+    ASSERT(cpu >= 0 && cpu < NCPU && st != NULL);
+    memset(st, 0, sizeof(*st));
+    for (int i = 0; i < NDESC; i++) {
+        struct mcache *mc = &descs[i].caches[cpu];
+        st->nobj += mc->nobj;
+        st->nremote += mc->nremote;
+    }
+    st->nhit = pcpu_counter_read_cpu(&mc_nhit, cpu);
+    st->nrefill = pcpu_counter_read_cpu(&mc_nrefill, cpu);
+}
+
+static uint32_t cache_refill(struct desc *d, struct mcache *mc)
+{
+    ASSERT(mc->nobj == 0);
+
+    // first take back the blocks freed by other cpus.
+    QueueNode *q = fetch_all_from_queue(&mc->remote);
+    if (q != NULL) {
+        uint32_t n = 0;
+        while (q != NULL) {
+            QueueNode *nxt = q->next;
+            struct mobj *obj = (struct mobj *)q;
+            obj->nxt = mc->objs;
+            mc->objs = obj;
+            n++;
+            q = nxt;
+        }
+        __atomic_sub_fetch(&mc->nremote, n, __ATOMIC_RELAXED);
+        mc->nobj += n;
+        return n;
+    }
+
     acquire_spinlock(&d->lock);
+    uint32_t n = 0;
+    while (n < d->nbatch) {
+        if (list_empty(&d->flst)) {
+            // fetch another page, and put its blocks
+            // onto the free list of the descriptor.
+            // must hold the lock when doing so.
+            if (add_blocks(d) == 0) {
+                // allocation failure
+                break;
+            }
+        }
+        ASSERT(!list_empty(&d->flst));
+
+        struct mobj *obj = (struct mobj *)list_pop_front(&d->flst);
+        struct arena *ar = block2arena(obj);
+        ASSERT(ar->nfr > 0);
+        ar->nfr--;
+        obj->nxt = mc->objs;
+        mc->objs = obj;
+        n++;
+    }
+    release_spinlock(&d->lock);
+
+    mc->nobj += n;
+    if (n != 0) {
+        pcpu_counter_inc(&mc_nrefill);
+    }
+    return n;
+}
+
+static void cache_drain(struct desc *d, struct mcache *mc, uint32_t n)
+{
+    ASSERT(n <= mc->nobj);
+    acquire_spinlock(&d->lock);
+    for (uint32_t i = 0; i < n; i++) {
+        struct mobj *obj = mc->objs;
+        mc->objs = obj->nxt;
+        block_put(d, obj);
+    }
+    release_spinlock(&d->lock);
+    mc->nobj -= n;
+}
+
+static void block_put(struct desc *d, void *blk)
+{
+    struct arena *ar = block2arena(blk);
+    ASSERT(ar->desc == d);
     ASSERT(ar->nfr < d->bpa);
     ar->nfr++;
 
-    // make it easier to trigger use-after-free
-    memset(pt, 0xcc, d->bsz);
-    list_push_back(&d->flst, (struct list_elem *)pt);
+    list_push_back(&d->flst, (struct list_elem *)blk);
     if (ar->nfr == d->bpa) {
         // free the arena.
         arena_free(ar);
-        ar = NULL;
-    } else {
-        // add the block to its free list.
-        // done.
     }
-    release_spinlock(&d->lock);
 }
 
 static int add_blocks(struct desc *d)
@@ -199,13 +388,14 @@ static int add_blocks(struct desc *d)
     if (pg == NULL) {
         return 0;
     }
-    increment_rc(&kalloc_page_cnt);
+    pcpu_counter_inc(&kalloc_page_cnt);
     ASSERT(pg != NULL);
 
-    /* Build an arena */
+    /* Build an arena, owned by the cpu that carves it. */
     struct arena *a = pg;
     a->magic = ARENA_MAGIC;
     a->nfr = d->bpa;
+    a->cpu = cpuid();
     a->desc = d;
 
     /* Put the rest of blocks on the free list. */
@@ -256,5 +446,36 @@ static void arena_free(struct arena *a)
     }
 
     pintf.free(a);
-    decrement_rc(&kalloc_page_cnt);
+    pcpu_counter_dec(&kalloc_page_cnt);
+}
+
+static void *large_alloc(size_t nb)
+{
+    if (pintf.getmult == NULL) {
+        // not supported.
+        return NULL;
+    }
+
+    const size_t npg = (nb + sizeof(struct arena) + PGSIZE - 1) / PGSIZE;
+    struct arena *a = pintf.getmult(npg);
+    if (a == NULL) {
+        return NULL;
+    }
+    pcpu_counter_add(&kalloc_page_cnt, npg);
+
+    // a large block is an arena without descriptor.
+    a->magic = ARENA_MAGIC;
+    a->nfr = npg;
+    a->cpu = cpuid();
+    a->desc = NULL;
+    return (void *)a + sizeof(struct arena);
+}
+
+static void large_free(struct arena *a)
+{
+    ASSERT(a->desc == NULL && pintf.freemult != NULL);
+    const uint32_t npg = a->nfr;
+    a->magic = 0;
+    pintf.freemult(a, npg);
+    pcpu_counter_add(&kalloc_page_cnt, -(isize)npg);
 }
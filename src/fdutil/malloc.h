@@ -15,4 +15,17 @@ void malloc_mod_intf(struct palloc_intf intf);
 void *malloc(size_t nb);
 void free(void *pt);
 
+/** Statistics of the per-cpu caches of a cpu */
+struct malloc_stat {
+    size_t nobj; // blocks cached
+    size_t nremote; // blocks freed by other cpus, not yet taken back
+    size_t nhit; // allocations served without a lock
+    size_t nrefill; // batches taken from the descriptors
+};
+
+void malloc_stat(int cpu, struct malloc_stat *st);
+
+/** Give all blocks cached by this cpu back to the descriptors. */
+void malloc_drain(void);
+
 #endif // __FDUTIL_MALLOC_
@@ -1,14 +1,20 @@
 #include "palloc.h"
 #include "stddef.h"
+#include "lst.h"
+#include <common/counter.h>
 #include <common/debug.h>
 #include <common/spinlock.h>
 #include <common/string.h>
 #include <driver/memlayout.h>
 #include <driver/base.h>
+#include <aarch64/intrinsic.h>
 
-/** Organize pages in singly-linked list. */
+/** Organize free pages in lists. */
 struct page {
-    struct page *nxt;
+    union {
+        struct page *nxt; /* on a per-cpu magazine */
+        struct list_elem elem; /* on a buddy free list */
+    };
     char fre[0];
 };
 
@@ -16,12 +22,18 @@ struct page {
 // If too wide, will waste some pages.
 typedef u8 refcnt_t;
 
+/** A page whose count reaches MAX_REF_CNT keeps its real count
+ * in the overflow table, see struct ovftable. */
 #define MAX_REF_CNT ((refcnt_t) - 1)
 
-/** Page allocator(O(1) for all operations) */
+/** Order of a page that is not the head of a free block */
+#define PG_INUSE ((u8)0xff)
+
+/** Buddy page allocator(O(PALLOC_MAX_ORDER) for all operations) */
 struct pallocator {
-    struct page *frepg; /* pointer to free page. */
-    size_t nalloc; /* Number of allocated pages(debug, test) */
+    struct list frelst[PALLOC_NORDER]; /* free blocks of each order */
+    size_t nfree[PALLOC_NORDER]; /* length of each frelst */
+    size_t nalloc; /* Number of pages not on frelst(debug, test) */
     SpinLock lock; /* lock */
 
     /**< Immutable members(don't acquire lock) */
@@ -29,11 +41,66 @@ struct pallocator {
     void *start; /* Start address */
     void *end; /* End address */
     refcnt_t *refcnts; /* Reference count */
+    u8 *orders; /* order of a free block at its head page, or PG_INUSE */
 };
 
 // physical page manager.
 static struct pallocator allocator;
 
+/** Capacity of a per-cpu page magazine */
+#define PCP_MAX 64
+/** Number of pages moved between a magazine and the
+ * global free list at a time. */
+#define PCP_BATCH 32
+
+/**
+ * Per-cpu page magazine. Pages cached here have ref count 0 and
+ * are owned by a single cpu, so no lock is needed to touch them.
+ * This is safe because the kernel runs with traps disabled and
+ * never sleeps inside palloc_get/palloc_free, hence cpuid() cannot
+ * change under our feet.
+ * 
+ * Aligned to cache line size to avoid false sharing.
+ */
+struct pcpcache {
+    struct page *frepg; /* cached free pages */
+    size_t npg; /* number of cached pages */
+} __attribute__((aligned(64)));
+
+static struct pcpcache pcps[NCPU];
+
+/**< Statistics of the magazines */
+static PercpuCounter pcp_nhit; /* allocations served by the magazine */
+static PercpuCounter pcp_nrefill; /* refills from the global list */
+static PercpuCounter pcp_ndrain; /* drains to the global list */
+
+/** Slots of the overflow table */
+#define OVF_NSLOT 1024
+/** Key of an empty/deleted slot */
+#define OVF_EMPTY 0
+#define OVF_TOMB ((usize)-1)
+
+/**
+ * Reference counts of pages shared more than MAX_REF_CNT - 1 times.
+ * Such pages have MAX_REF_CNT in their byte, and only the holder of
+ * lock may move a byte to or from MAX_REF_CNT. An open-addressing
+ * hash table keyed by page index + 1, with tombstones.
+ */
+struct ovftable {
+    SpinLock lock;
+    struct ovfslot {
+        usize key;
+        u64 cnt;
+    } slots[OVF_NSLOT];
+    size_t nused; /* pages in the table */
+
+    /**< Statistics */
+    size_t nops; /* shares/frees served by the table */
+    size_t ncopy; /* shares that copied because the table is full */
+};
+
+static struct ovftable ovf;
+
 /** Check for heap buffer overflow */
 #define CHECK_PA(pa)                                       \
     do {                                                   \
@@ -45,22 +112,62 @@ static struct pallocator allocator;
 // Hint: if CHECK_PA fires, use gdb watch point to find out when
 // the page allocator is corrupted.
 
-static INLINE refcnt_t *pg2refcnt(void *pg)
+static INLINE usize pg2idx(void *pg)
 {
     ASSERT(pg_off(pg) == 0);
     ASSERT(pg >= allocator.start && pg < allocator.end);
-    const usize idx = (pg - allocator.start) / PAGE_SIZE;
-    return &allocator.refcnts[idx];
+    return (pg - allocator.start) / PAGE_SIZE;
+}
+
+static INLINE struct page *idx2pg(usize idx)
+{
+    ASSERT(idx < allocator.npage);
+    return allocator.start + idx * PAGE_SIZE;
+}
+
+/** Returns true if pg can be the head of a block of the order. */
+static INLINE bool pg_idx_aligned(void *pg, unsigned int order)
+{
+    return (pg2idx(pg) & ((1UL << order) - 1)) == 0;
+}
+
+static INLINE refcnt_t *pg2refcnt(void *pg)
+{
+    return &allocator.refcnts[pg2idx(pg)];
 }
 
 /** Initialize the page allocator, Will hold lock */
 static void pallocator_init(struct pallocator *pa, void *start, size_t npage);
 
-/** Get a page from allocator. Will hold lock */
-static void *pallocator_get(struct pallocator *pa);
+/** Move at most n pages from allocator to pc. Will hold lock.
+ * @return number of pages moved.
+ */
+static size_t pallocator_get(struct pallocator *pa, struct pcpcache *pc,
+                             size_t n);
+
+/** Move n pages from pc back to allocator. Will hold lock */
+static void pallocator_free(struct pallocator *pa, struct pcpcache *pc,
+                            size_t n);
 
-/** Free a page to allocator(must from pallocator_get) */
-static void pallocator_free(struct pallocator *pa, void *pg);
+/** Take a block of 2^order pages off the free lists. Must hold lock.
+ * @return NULL if no such block.
+ */
+static void *buddy_get(struct pallocator *pa, unsigned int order);
+
+/** Put a block of 2^order pages back, merging it with its 
+ * buddies. Must hold lock. */
+static void buddy_put(struct pallocator *pa, void *pg, unsigned int order);
+
+/** Drop a reference of pg.
+ * @return true if it is the last reference.
+ */
+static bool pg_put(void *pg);
+static bool ovf_put(void *pg);
+
+/** Take a reference of pg whose count is about to overflow.
+ * @return false if the overflow table is full.
+ */
+static bool ovf_share(void *pg);
 
 void palloc_init(void)
 {
@@ -80,30 +187,90 @@ void palloc_init(void)
     ASSERT(first < last && pg_off(first) == 0 && pg_off(last) == 0);
     const size_t npgs = (last - first) / PGSIZE;
 
-    // leave pages for refcnt.
-    // nrf = round_up(npgs, 4096)
-    const size_t nrf = (npgs * sizeof(refcnt_t) + PAGE_SIZE - 1) / PAGE_SIZE;
+    // leave pages for refcnt and buddy orders.
+    // nrf = round_up(npgs * 2, 4096)
+    const size_t nrf =
+            (npgs * (sizeof(refcnt_t) + sizeof(u8)) + PAGE_SIZE - 1) /
+            PAGE_SIZE;
     ASSERT(nrf < npgs);
-    // init refcount area.
-    memset(first, 0, PAGE_SIZE * nrf);
+    // init refcount area, no page is free yet.
+    memset(first, 0, npgs * sizeof(refcnt_t));
+    memset(first + npgs * sizeof(refcnt_t), PG_INUSE, npgs * sizeof(u8));
 
     // update first.
     allocator.refcnts = (refcnt_t *)first;
+    allocator.orders = (u8 *)(first + npgs * sizeof(refcnt_t));
     first += nrf * PAGE_SIZE;
 
     // init pallocator.
     pallocator_init(&allocator, first, npgs - nrf);
+
+    // all magazines start empty.
+    memset(pcps, 0, sizeof(pcps));
+    init_pcpu_counter(&pcp_nhit);
+    init_pcpu_counter(&pcp_nrefill);
+    init_pcpu_counter(&pcp_ndrain);
+
+    // no page is shared that much yet.
+    memset(&ovf, 0, sizeof(ovf));
+    init_spinlock(&ovf.lock);
 }
 
 void *palloc_get(void)
 {
-    void *ret = pallocator_get(&allocator);
+    struct pcpcache *pc = &pcps[cpuid()];
+    if (pc->npg == 0) {
+        // slow path: refill from the global list.
+        if (pallocator_get(&allocator, pc, PCP_BATCH) == 0) {
+            // no page available!
+            return NULL;
+        }
+    } else {
+        pcpu_counter_inc(&pcp_nhit);
+    }
+
+    // extract the first cached page
+    struct page *ret = pc->frepg;
+    pc->frepg = ret->nxt;
+    pc->npg--;
+
+    // update ref count, no one else can see this page.
+    refcnt_t *rc = pg2refcnt(ret);
+    ASSERT(*rc == (refcnt_t)0);
+    __atomic_store_n(rc, 1, __ATOMIC_RELEASE);
     return ret;
 }
 
 void palloc_free(void *pg)
 {
-    return pallocator_free(&allocator, pg);
+    // check that pa is valid
+    CHECK_PA((&allocator));
+
+    // validate pg
+    if (pg == NULL) {
+        // it is valid to free nullptr.
+        return;
+    }
+    ASSERT(pg_off(pg) == 0);
+    ASSERT(pg >= allocator.start && pg < allocator.end);
+
+    if (!pg_put(pg)) {
+        // it is used by someone else, do NOT free
+        return;
+    }
+
+    // fill with junks, to detect use-after-free.
+    memset(pg, 0xcc, PGSIZE);
+
+    struct pcpcache *pc = &pcps[cpuid()];
+    if (pc->npg >= PCP_MAX) {
+        // magazine is full, give a batch back.
+        pallocator_free(&allocator, pc, PCP_BATCH);
+    }
+    struct page *p = pg;
+    p->nxt = pc->frepg;
+    pc->frepg = p;
+    pc->npg++;
 }
 
 void *palloc_share(void *pg)
@@ -112,31 +279,359 @@ void *palloc_share(void *pg)
     ASSERT(pg_off(pg) == 0);
 
     // fast path: the page count does not overflow.
-    acquire_spinlock(&allocator.lock);
     refcnt_t *rc = pg2refcnt(pg);
-    ASSERT(*rc > (refcnt_t)0);
-    if (*rc != MAX_REF_CNT) {
-        *rc = *rc + 1;
-        // just give the page back.
-        release_spinlock(&allocator.lock);
+    refcnt_t old = __atomic_load_n(rc, __ATOMIC_ACQUIRE);
+    while (old < MAX_REF_CNT - 1) {
+        ASSERT(old > (refcnt_t)0);
+        if (__atomic_compare_exchange_n(rc, &old, old + 1, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            // just give the page back.
+            return pg;
+        }
+    }
+
+    // slow path: keep counting in the overflow table.
+    if (ovf_share(pg)) {
         return pg;
     }
-    release_spinlock(&allocator.lock);
 
-    // slow path: should allocate a new page
+    // the table is full: allocate a new page
     // with the same context
-    void *ret = pallocator_get(&allocator);
+    void *ret = palloc_get();
     if (ret != NULL) {
         memcpy(ret, pg, PAGE_SIZE);
     }
     return ret;
 }
 
-static INLINE void push_page(struct pallocator *pa, void *pg)
+bool palloc_exclusive(void *pg)
+{
+    ASSERT(pg >= allocator.start && pg < allocator.end);
+    return __atomic_load_n(pg2refcnt(pg), __ATOMIC_ACQUIRE) == 1;
+}
+
+bool palloc_unshare(void *pg)
+{
+    ASSERT(pg >= allocator.start && pg < allocator.end);
+    refcnt_t *rc = pg2refcnt(pg);
+    refcnt_t old = __atomic_load_n(rc, __ATOMIC_ACQUIRE);
+    while (1) {
+        ASSERT(old > (refcnt_t)0);
+        if (old == 1) {
+            return false;
+        }
+        if (old != MAX_REF_CNT) {
+            if (__atomic_compare_exchange_n(rc, &old, old - 1, false,
+                                            __ATOMIC_ACQ_REL,
+                                            __ATOMIC_ACQUIRE)) {
+                return true;
+            }
+            continue;
+        }
+        // the count lives in the overflow table, where it is at least
+        // MAX_REF_CNT, so the drop cannot be the last.
+        if (ovf_put(pg)) {
+            return true;
+        }
+        old = __atomic_load_n(rc, __ATOMIC_ACQUIRE);
+    }
+}
+
+size_t palloc_used(void)
+{
+    acquire_spinlock(&allocator.lock);
+    size_t ret = allocator.nalloc;
+    release_spinlock(&allocator.lock);
+
+    // pages in magazines are free, too.
+    // The result is racy, which is fine for statistics.
+    for (int i = 0; i < NCPU; i++) {
+        ret -= __atomic_load_n(&pcps[i].npg, __ATOMIC_RELAXED);
+    }
+    return ret;
+}
+
+size_t palloc_nfree(void)
+{
+    // lock-free, called on every allocation to check watermarks.
+    size_t ret = allocator.npage -
+                 __atomic_load_n(&allocator.nalloc, __ATOMIC_RELAXED);
+    for (int i = 0; i < NCPU; i++) {
+        ret += __atomic_load_n(&pcps[i].npg, __ATOMIC_RELAXED);
+    }
+    return ret;
+}
+
+size_t palloc_npage(void)
+{
+    return allocator.npage;
+}
+
+void palloc_pcpstat(int cpu, struct palloc_pcpstat *st)
+{
+    ASSERT(cpu >= 0 && cpu < NCPU && st != NULL);
+    struct pcpcache *pc = &pcps[cpu];
+    st->npg = pc->npg;
+    st->nhit = pcpu_counter_read_cpu(&pcp_nhit, cpu);
+    st->nrefill = pcpu_counter_read_cpu(&pcp_nrefill, cpu);
+    st->ndrain = pcpu_counter_read_cpu(&pcp_ndrain, cpu);
+}
+
+void palloc_ovfstat(struct palloc_ovfstat *st)
+{
+    ASSERT(st != NULL);
+    acquire_spinlock(&ovf.lock);
+    st->npg = ovf.nused;
+    st->nops = ovf.nops;
+    st->ncopy = ovf.ncopy;
+    release_spinlock(&ovf.lock);
+}
+
+void palloc_drain(void)
+{
+    struct pcpcache *pc = &pcps[cpuid()];
+    if (pc->npg != 0) {
+        pallocator_free(&allocator, pc, pc->npg);
+    }
+}
+
+static unsigned int npg2order(unsigned int npg)
+{
+    unsigned int order = 0;
+    while ((1U << order) < npg) {
+        order++;
+    }
+    return order;
+}
+
+void *palloc_get_order(unsigned int order)
+{
+    if (order > PALLOC_MAX_ORDER) {
+        return NULL;
+    }
+    if (order == 0) {
+        // fast path.
+        return palloc_get();
+    }
+
+    acquire_spinlock(&allocator.lock);
+    void *ret = buddy_get(&allocator, order);
+    release_spinlock(&allocator.lock);
+    if (ret == NULL) {
+        return NULL;
+    }
+
+    // every page of the block is in use.
+    for (usize i = 0; i < (1UL << order); i++) {
+        refcnt_t *rc = pg2refcnt(ret + i * PGSIZE);
+        ASSERT(*rc == (refcnt_t)0);
+        __atomic_store_n(rc, 1, __ATOMIC_RELEASE);
+    }
+    return ret;
+}
+
+void palloc_free_order(void *pg, unsigned int order)
+{
+    CHECK_PA((&allocator));
+    if (pg == NULL) {
+        return;
+    }
+    ASSERT(order <= PALLOC_MAX_ORDER);
+    if (order == 0) {
+        palloc_free(pg);
+        return;
+    }
+    ASSERT(pg_idx_aligned(pg, order));
+
+    // multi-page blocks are never shared.
+    for (usize i = 0; i < (1UL << order); i++) {
+        refcnt_t *rc = pg2refcnt(pg + i * PGSIZE);
+        ASSERT(*rc == (refcnt_t)1);
+        __atomic_store_n(rc, 0, __ATOMIC_RELEASE);
+    }
+    memset(pg, 0xcc, PGSIZE << order);
+
+    acquire_spinlock(&allocator.lock);
+    buddy_put(&allocator, pg, order);
+    release_spinlock(&allocator.lock);
+}
+
+void *palloc_get_mult(unsigned int npg)
+{
+    return palloc_get_order(npg2order(npg));
+}
+
+void palloc_free_mult(void *pg, unsigned int npg)
+{
+    palloc_free_order(pg, npg2order(npg));
+}
+
+void palloc_buddystat(size_t nfree[PALLOC_NORDER])
+{
+    acquire_spinlock(&allocator.lock);
+    for (int i = 0; i < PALLOC_NORDER; i++) {
+        nfree[i] = allocator.nfree[i];
+    }
+    release_spinlock(&allocator.lock);
+}
+
+/** Find the slot of page idx in the overflow table. Must hold ovf.lock.
+ * @return NULL if not found.
+ */
+static struct ovfslot *ovf_find(usize idx)
+{
+    const usize key = idx + 1;
+    for (usize i = 0; i < OVF_NSLOT; i++) {
+        struct ovfslot *slot = &ovf.slots[(key + i) % OVF_NSLOT];
+        if (slot->key == OVF_EMPTY) {
+            return NULL;
+        }
+        if (slot->key == key) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+/** Find a slot to insert page idx. Must hold ovf.lock.
+ * @return NULL if the table is full.
+ */
+static struct ovfslot *ovf_insert(usize idx)
+{
+    // leave an empty slot, so that lookups terminate.
+    if (ovf.nused >= OVF_NSLOT - 1) {
+        return NULL;
+    }
+    const usize key = idx + 1;
+    for (usize i = 0; i < OVF_NSLOT; i++) {
+        struct ovfslot *slot = &ovf.slots[(key + i) % OVF_NSLOT];
+        if (slot->key == OVF_EMPTY || slot->key == OVF_TOMB) {
+            slot->key = key;
+            ovf.nused++;
+            return slot;
+        }
+    }
+    PANIC("overflow table corrupted");
+}
+
+static bool ovf_share(void *pg)
+{
+    refcnt_t *rc = pg2refcnt(pg);
+    bool ret = true;
+
+    acquire_spinlock(&ovf.lock);
+    refcnt_t old = __atomic_load_n(rc, __ATOMIC_ACQUIRE);
+    while (1) {
+        ASSERT(old > (refcnt_t)0);
+        if (old == MAX_REF_CNT) {
+            // already in the table.
+            struct ovfslot *slot = ovf_find(pg2idx(pg));
+            ASSERT(slot != NULL);
+            slot->cnt++;
+            ovf.nops++;
+            break;
+        }
+
+        if (old < MAX_REF_CNT - 1) {
+            // someone dropped a reference meanwhile.
+            if (__atomic_compare_exchange_n(rc, &old, old + 1, false,
+                                            __ATOMIC_ACQ_REL,
+                                            __ATOMIC_ACQUIRE)) {
+                break;
+            }
+            continue;
+        }
+
+        // move the count into the table.
+        struct ovfslot *slot = ovf_insert(pg2idx(pg));
+        if (slot == NULL) {
+            ovf.ncopy++;
+            ret = false;
+            break;
+        }
+        if (!__atomic_compare_exchange_n(rc, &old, MAX_REF_CNT, false,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            // lost to a drop of reference, retry.
+            slot->key = OVF_TOMB;
+            ovf.nused--;
+            continue;
+        }
+        slot->cnt = MAX_REF_CNT;
+        ovf.nops++;
+        break;
+    }
+    release_spinlock(&ovf.lock);
+    return ret;
+}
+
+/** Drop a reference whose count lives in the overflow table.
+ * @return false if the byte left MAX_REF_CNT before we got the lock,
+ * in which case nothing is dropped.
+ */
+static bool ovf_put(void *pg)
+{
+    refcnt_t *rc = pg2refcnt(pg);
+    acquire_spinlock(&ovf.lock);
+    // another holder may have moved the count back into the byte
+    // between our read of it and the lock.
+    if (__atomic_load_n(rc, __ATOMIC_ACQUIRE) != MAX_REF_CNT) {
+        release_spinlock(&ovf.lock);
+        return false;
+    }
+    struct ovfslot *slot = ovf_find(pg2idx(pg));
+    ASSERT(slot != NULL && slot->cnt >= MAX_REF_CNT);
+    slot->cnt--;
+    ovf.nops++;
+    if (slot->cnt < MAX_REF_CNT) {
+        // small enough for the byte again.
+        slot->key = OVF_TOMB;
+        ovf.nused--;
+        __atomic_store_n(rc, MAX_REF_CNT - 1, __ATOMIC_RELEASE);
+    }
+    release_spinlock(&ovf.lock);
+    return true;
+}
+
+static bool pg_put(void *pg)
+{
+    refcnt_t *rc = pg2refcnt(pg);
+    refcnt_t old = __atomic_load_n(rc, __ATOMIC_ACQUIRE);
+    while (1) {
+        ASSERT(old > (refcnt_t)0);
+        if (old == MAX_REF_CNT) {
+            // the count is at least MAX_REF_CNT, not the last one.
+            if (ovf_put(pg)) {
+                return false;
+            }
+            old = __atomic_load_n(rc, __ATOMIC_ACQUIRE);
+            continue;
+        }
+        if (__atomic_compare_exchange_n(rc, &old, old - 1, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            return old == 1;
+        }
+    }
+}
+
+/** Put a free block onto its list. Must hold lock. */
+static INLINE void push_block(struct pallocator *pa, void *pg,
+                              unsigned int order)
 {
     struct page *p = pg;
-    p->nxt = pa->frepg;
-    pa->frepg = p;
+    list_push_front(&pa->frelst[order], &p->elem);
+    pa->nfree[order]++;
+    pa->orders[pg2idx(pg)] = order;
+}
+
+/** Take a free block off its list. Must hold lock. */
+static INLINE void pop_block(struct pallocator *pa, struct page *p,
+                             unsigned int order)
+{
+    ASSERT(pa->orders[pg2idx(p)] == order);
+    list_remove(&p->elem);
+    ASSERT(pa->nfree[order] > 0);
+    pa->nfree[order]--;
+    pa->orders[pg2idx(p)] = PG_INUSE;
 }
 
 /**
@@ -152,84 +647,118 @@ static void pallocator_init(struct pallocator *pa, void *start, size_t npage)
     init_spinlock(&pa->lock);
 
     // initially no free page.
-    pa->frepg = NULL;
+    for (int i = 0; i < PALLOC_NORDER; i++) {
+        list_init(&pa->frelst[i]);
+        pa->nfree[i] = 0;
+    }
 
-    // put all pages onto free list.
-    void *pg = start;
-    for (size_t i = 0; i < npage; i++) {
-        push_page(&allocator, pg);
-        pg += PGSIZE;
+    // put all pages onto free lists, as the largest
+    // aligned blocks that fit.
+    size_t idx = 0;
+    while (idx < npage) {
+        unsigned int order = PALLOC_MAX_ORDER;
+        while ((idx & ((1UL << order) - 1)) != 0 ||
+               idx + (1UL << order) > npage) {
+            order--;
+        }
+        push_block(pa, idx2pg(idx), order);
+        idx += (1UL << order);
     }
 
     CHECK_PA(pa);
 }
 
-static void *pallocator_get(struct pallocator *pa)
+static void *buddy_get(struct pallocator *pa, unsigned int order)
 {
-    // check that pa is valid
-    CHECK_PA(pa);
-    ASSERT(pg_off(pa->frepg) == 0);
-    acquire_spinlock(&pa->lock);
-
-    // no page available!
-    if (pa->frepg == NULL) {
-        release_spinlock(&pa->lock);
+    // find the smallest block that is large enough.
+    unsigned int k = order;
+    while (k <= PALLOC_MAX_ORDER && list_empty(&pa->frelst[k])) {
+        k++;
+    }
+    if (k > PALLOC_MAX_ORDER) {
+        // no page available!
         return NULL;
     }
 
-    // extract the first free page
-    void *ret = pa->frepg;
-    pa->frepg = pa->frepg->nxt;
-    pa->nalloc++;
+    struct page *p = list_entry(list_front(&pa->frelst[k]), struct page, elem);
+    pop_block(pa, p, k);
 
-    // update ref count
-    refcnt_t *rc = pg2refcnt(ret);
-    ASSERT(*rc == (refcnt_t)0);
-    *rc = *rc + 1;
+    // split, and give the upper halves back.
+    while (k > order) {
+        k--;
+        push_block(pa, (void *)p + (PGSIZE << k), k);
+    }
+    pa->nalloc += (1UL << order);
+    return p;
+}
 
-    // return
-    release_spinlock(&pa->lock);
-    ASSERT(ret >= pa->start && ret < pa->end);
-    ASSERT(pg_off(pa->frepg) == 0);
-    return ret;
+static void buddy_put(struct pallocator *pa, void *pg, unsigned int order)
+{
+    ASSERT(pg_idx_aligned(pg, order));
+    ASSERT(pa->nalloc >= (1UL << order));
+    pa->nalloc -= (1UL << order);
+
+    // coalesce with free buddies.
+    size_t idx = pg2idx(pg);
+    while (order < PALLOC_MAX_ORDER) {
+        const size_t bidx = idx ^ (1UL << order);
+        if (bidx + (1UL << order) > pa->npage ||
+            pa->orders[bidx] != order) {
+            // buddy is out of range or not free.
+            break;
+        }
+        pop_block(pa, idx2pg(bidx), order);
+        idx &= ~(1UL << order);
+        order++;
+    }
+    push_block(pa, idx2pg(idx), order);
 }
 
-static void pallocator_free(struct pallocator *pa, void *pg)
+static size_t pallocator_get(struct pallocator *pa, struct pcpcache *pc,
+                             size_t n)
 {
     // check that pa is valid
     CHECK_PA(pa);
+    acquire_spinlock(&pa->lock);
 
-    // validate pg
-    if (pg == NULL) {
-        // it is valid to free nullptr.
-        return;
+    // move up to n pages onto the magazine.
+    size_t cnt = 0;
+    struct page *p;
+    while (cnt < n && (p = buddy_get(pa, 0)) != NULL) {
+        ASSERT((void *)p >= pa->start && (void *)p < pa->end);
+        p->nxt = pc->frepg;
+        pc->frepg = p;
+        cnt++;
     }
-    ASSERT(pg_off(pg) == 0);
-    ASSERT(pg >= pa->start && pg < pa->end);
 
-    // deal with refcount
-    acquire_spinlock(&pa->lock);
-    refcnt_t *rc = pg2refcnt(pg);
-    ASSERT(*rc > (refcnt_t)0x0);
-    *rc = *rc - 1;
-    if (*rc > 0) {
-        // it is used by someone else, do NOT free
-        release_spinlock(&pa->lock);
-        return;
-    }
+    // release the lock, done.
     release_spinlock(&pa->lock);
+    pc->npg += cnt;
+    if (cnt != 0) {
+        pcpu_counter_inc(&pcp_nrefill);
+    }
+    return cnt;
+}
 
-    // fill with junks, to detect use-after-free.
-    memset(pg, 0xcc, PGSIZE);
+static void pallocator_free(struct pallocator *pa, struct pcpcache *pc,
+                            size_t n)
+{
+    // check that pa is valid
+    CHECK_PA(pa);
+    ASSERT(n <= pc->npg);
+    if (n == 0) {
+        return;
+    }
+    pcpu_counter_inc(&pcp_ndrain);
 
-    // take the lock
+    // take the lock, give the pages back one by one.
     acquire_spinlock(&pa->lock);
-
-    struct page *p = pg;
-    p->nxt = pa->frepg;
-    pa->frepg = p;
-    ASSERT(pa->nalloc > 0);
-    pa->nalloc--;
+    for (size_t i = 0; i < n; i++) {
+        struct page *p = pc->frepg;
+        pc->frepg = p->nxt;
+        buddy_put(pa, p, 0);
+    }
+    pc->npg -= n;
 
     // release the lock, done.
     release_spinlock(&pa->lock);
@@ -31,18 +31,87 @@ static inline void *pg_round_up(void *addr)
 /** Initialize palloc module */
 void palloc_init(void);
 
-/** Get a single page. */
+/** Get a single page.
+ * Served from the per-cpu magazine, which is refilled 
+ * from the global free list in batches.
+ */
 void *palloc_get(void);
 
-/** Free a page. */
+/** Free a page(to the per-cpu magazine). */
 void palloc_free(void *pg);
 
 /**
- * @return the shared page with pg if page count does not overflow,
- *  else another page with same content.
+ * Take another reference of pg. Counts beyond the per-page byte 
+ * are kept in an overflow table.
+ * @return pg, or another page with same content if the overflow
+ *  table is full.
  */
 void *palloc_share(void *pg);
 
+/** @return true if the caller holds the only reference of pg. */
+bool palloc_exclusive(void *pg);
+
+/**
+ * Drop a reference of pg, unless it is the only one.
+ * @return false, dropping nothing, if the caller holds the only
+ *  reference, so that it may keep using pg alone.
+ */
+bool palloc_unshare(void *pg);
+
+/** Statistics of the overflow table of page counts */
+struct palloc_ovfstat {
+    size_t npg; // pages whose count is in the table
+    size_t nops; // shares/frees that went through the table
+    size_t ncopy; // shares that copied the page as the table is full
+};
+
+void palloc_ovfstat(struct palloc_ovfstat *st);
+
+/** Largest order of a multi-page block(4 MiB). */
+#define PALLOC_MAX_ORDER 10
+/** Number of block orders */
+#define PALLOC_NORDER (PALLOC_MAX_ORDER + 1)
+
+/** Get 2^order physically contiguous pages.
+ * @return NULL if order is too large or no such block.
+ */
+void *palloc_get_order(unsigned int order);
+
+/** Free a block from palloc_get_order(order). */
+void palloc_free_order(void *pg, unsigned int order);
+
+/** Get npg contiguous pages(rounded up to power of 2). */
+void *palloc_get_mult(unsigned int npg);
+
+/** Free a block from palloc_get_mult(npg). */
+void palloc_free_mult(void *pg, unsigned int npg);
+
+/** Read the number of free blocks of each order. */
+void palloc_buddystat(size_t nfree[PALLOC_NORDER]);
+
+/** Number of pages in use(debug, test). */
+size_t palloc_used(void);
+
+/** Number of free pages, approximate but lock-free. */
+size_t palloc_nfree(void);
+
+/** Number of pages managed. */
+size_t palloc_npage(void);
+
+/** Statistics of a per-cpu page magazine */
+struct palloc_pcpstat {
+    size_t npg; // pages cached
+    size_t nhit; // allocations served without the global lock
+    size_t nrefill; // batches taken from the global list
+    size_t ndrain; // batches given back to the global list
+};
+
+/** Read the magazine statistics of a cpu. */
+void palloc_pcpstat(int cpu, struct palloc_pcpstat *st);
+
+/** Give all pages cached on this cpu back to the global list. */
+void palloc_drain(void);
+
 /** Interface of an page allocator */
 struct palloc_intf {
     void *(*get)(); // get a single page
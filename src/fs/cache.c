@@ -7,9 +7,6 @@
 #include <common/sem.h>
 #include <common/string.h>
 
-#undef acquire_sleeplock
-#define acquire_sleeplock unalertable_acquire_sleeplock
-
 // clang-format off
 /*-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
  *                       CONDVAR IMPLEMENTATION
@@ -128,7 +125,7 @@ static INLINE void device_write(Block *block)
 struct logcache {
     // Must acquire lock
     u8 data[BLOCK_SIZE];
-    SleepLock lock;
+    Mutex lock;
 };
 
 /** All log blocks reside in memory */
@@ -139,7 +136,7 @@ static inline struct logcache *lcache_acquire(int idx)
 {
     ASSERT((size_t)idx <= header.num_blocks && (size_t)idx <= LOG_MAX_SIZE);
     struct logcache *ret = &lcache[idx];
-    acquire_sleeplock(&ret->lock);
+    acquire_mutex(&ret->lock);
     return ret;
 }
 
@@ -152,7 +149,7 @@ static inline void lcache_write(int idx)
 /** Release a log cache acquired before.  */
 static inline void lcache_release(struct logcache *lc)
 {
-    release_sleeplock(&lc->lock);
+    release_mutex(&lc->lock);
     return;
 }
 
@@ -374,7 +371,7 @@ static void init_block(Block *block)
     block->acquired = false;
     block->pinned = 0;
 
-    init_sleeplock(&block->lock);
+    init_mutex(&block->lock);
     block->valid = false;
     block->timestamp = 0;
     memset(block->data, 0, sizeof(block->data));
@@ -450,7 +447,7 @@ static Block *cache_acquire(usize block_no)
         release_spinlock(&cache_lock);
 
         ASSERT(ret->block_no == block_no);
-        acquire_sleeplock(&ret->lock);
+        acquire_mutex(&ret->lock);
 
         // if not valid, read the content from disk
         if (!ret->valid) {
@@ -468,7 +465,7 @@ static Block *cache_acquire(usize block_no)
 static void cache_release(Block *block)
 {
     // TODO
-    release_sleeplock(&block->lock);
+    release_mutex(&block->lock);
 
     // unpin the block
     acquire_spinlock(&cache_lock);
@@ -498,7 +495,7 @@ void init_bcache(const SuperBlock *_sblock, const BlockDevice *_device)
 
     // initialize logger cache
     for (size_t i = 0; i < LOG_MAX_SIZE; i++) {
-        init_sleeplock(&lcache[i].lock);
+        init_mutex(&lcache[i].lock);
     }
 
     // read header and initialize logger
@@ -1,6 +1,7 @@
 #pragma once
 #include <common/list.h>
 #include <common/sem.h>
+#include <common/mutex.h>
 #include <fs/block_device.h>
 #include <fs/defines.h>
 
@@ -38,8 +39,8 @@ typedef struct {
      */
     u32 pinned;
 
-    /** the sleep lock protecting `valid` and `data`. */
-    SleepLock lock;
+    /** the mutex protecting `valid` and `data`. */
+    Mutex lock;
 
     /** is the block already acquired by some thread or process?
      *  note: should be protected by the global lock of the block cache.
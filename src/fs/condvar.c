@@ -2,35 +2,25 @@
 
 void cond_wait(struct condvar *cv, SpinLock *lock)
 {
-    _lock_sem(&cv->sema);
-    // incr # waiting
-    cv->waitcnt++;
-    // release holding lock, and goto sleep
+    // queue up before releasing lock, so that no signal is lost.
+    acquire_spinlock(&cv->lock);
     release_spinlock(lock);
-    // unalertable_wait_sem(&cv->sema);
-    ASSERT(_wait_sem(&cv->sema, false));
+    ASSERT(waitq_sleep(&cv->wq, &cv->lock, false));
+    release_spinlock(&cv->lock);
     // reacquire lock
     acquire_spinlock(lock);
 }
 
 void cond_signal(struct condvar *cv)
 {
-    _lock_sem(&cv->sema);
-    if (cv->waitcnt == 0) {
-        _unlock_sem(&cv->sema);
-        return;
-    }
-    cv->waitcnt--;
-    _post_sem(&cv->sema);
-    _unlock_sem(&cv->sema);
+    acquire_spinlock(&cv->lock);
+    waitq_wake_one(&cv->wq);
+    release_spinlock(&cv->lock);
 }
 
 void cond_broadcast(struct condvar *cv)
 {
-    _lock_sem(&cv->sema);
-    for (u32 i = 0; i < cv->waitcnt; i++) {
-        _post_sem(&cv->sema);
-    }
-    cv->waitcnt = 0;
-    _unlock_sem(&cv->sema);
+    acquire_spinlock(&cv->lock);
+    waitq_wake_all(&cv->wq);
+    release_spinlock(&cv->lock);
 }
@@ -2,19 +2,19 @@
 #ifndef _FS_CONDVAR_
 #define _FS_CONDVAR_
 
-#include <common/sem.h>
+#include <common/waitq.h>
 #include <common/spinlock.h>
 #include <common/defines.h>
 
 struct condvar {
-    u32 waitcnt; // number of waiting threads
-    Semaphore sema;
+    SpinLock lock; // protects wq
+    WaitQueue wq; // waiting threads
 };
 
 static inline void cond_init(struct condvar *cv)
 {
-    init_sem(&cv->sema, 0);
-    cv->waitcnt = 0;
+    init_spinlock(&cv->lock);
+    init_waitq(&cv->wq);
 }
 
 // wait till cond_signal or cond_broadcast
@@ -1,4 +1,5 @@
 #include "file1206.h"
+#include <kernel/slab.h>
 
 #ifndef STAND_ALONE
 // these prototypes is not added to copyin, copyout
@@ -211,6 +212,25 @@ int sys_inode(int fd, InodeEntry *entr)
 
 #endif // STAND_ALONE
 
+static KmemCache file_cache = KMEM_CACHE_INIT("file", File, NULL);
+
+File *falloc(void)
+{
+    File *fobj = kmem_cache_alloc(&file_cache);
+    if (fobj != NULL) {
+        fobj->type = FD_NONE;
+        fobj->ref = 1;
+        fobj->readable = fobj->writable = false;
+        fobj->off = 0;
+    }
+    return fobj;
+}
+
+void ffree(File *fobj)
+{
+    kmem_cache_free(&file_cache, fobj);
+}
+
 /** Walk on the directory tree.
  * @param[out] buf leave the last level.
  * @param alloc if true, will allocate directories along the path.
@@ -237,9 +257,9 @@ static Inode *walk(Inode *start, const char *path, char *buf)
         return start;
     }
 
-    inodes.lock(start);
+    inodes.lock_shared(start);
     usize nextno = inodes.lookup(start, buf, NULL);
-    inodes.unlock(start);
+    inodes.unlock_shared(start);
     Inode *next;
     if (nextno == 0) {
         // fail to find dir.
@@ -248,9 +268,9 @@ static Inode *walk(Inode *start, const char *path, char *buf)
         return NULL;
     } else {
         next = inodes.get(nextno);
-        inodes.lock(next);
-        inodes.sync(NULL, next, false);
-        inodes.unlock(next);
+        // the shared side loads the inode if needed.
+        inodes.lock_shared(next);
+        inodes.unlock_shared(next);
         ASSERT(next->valid);
     }
 
@@ -319,14 +339,12 @@ File *fopen(const char *path, int flags)
     }
 
     /// allocate memory for file
-    struct file *fobj = kalloc(sizeof(struct file));
+    struct file *fobj = falloc();
     if (fobj == NULL) {
         // fail
         kfree(buf);
         return NULL;
     }
-    fobj->ref = 1;
-    fobj->off = 0;
     fobj->type = FD_INODE;
 
     // walk from start
@@ -352,20 +370,22 @@ File *fopen(const char *path, int flags)
     Inode *ino = walk(start, path, buf);
     if (ino == NULL) {
         // fail
+        ffree(fobj);
         kfree(buf);
         return NULL;
     }
 
     // lookup in the dir
     Inode *fino;
-    inodes.lock(ino);
+    inodes.lock_shared(ino);
     usize no = inodes.lookup(ino, buf, NULL);
-    inodes.unlock(ino);
+    inodes.unlock_shared(ino);
 
     if (no == 0) {
         if ((flags & F_CREATE) == 0) {
             // fail
             inodes.put(NULL, ino);
+            ffree(fobj);
             kfree(buf);
             return NULL;
         }
@@ -375,9 +395,8 @@ File *fopen(const char *path, int flags)
         ASSERT(fino->entry.num_links == 1);
     } else {
         fino = inodes.get(no);
-        inodes.lock(fino);
-        inodes.sync(NULL, fino, false);
-        inodes.unlock(fino);
+        inodes.lock_shared(fino);
+        inodes.unlock_shared(fino);
         if ((flags & F_TRUNC) && (flags & F_WRITE) &&
             fino->entry.type == INODE_REGULAR) {
             // truncate the regular file
@@ -431,7 +450,7 @@ void fclose(File *fobj)
     ASSERT(fobj->ref > 0);
     fobj->ref--;
     if (fobj->ref == 0) {
-        kfree(fobj);
+        ffree(fobj);
     }
 }
 
@@ -448,6 +467,17 @@ static inline isize file_read(File *fobj, char *buf, u64 count)
         return 0;
     }
 
+    // the lock also guards off. A file object with a single reference
+    // has a private offset, so readers of a regular file can share the
+    // inode. Devices keep the exclusive side, their drivers expect it.
+    if (ino->entry.type == INODE_REGULAR && fobj->ref == 1) {
+        inodes.lock_shared(ino);
+        isize ret = inodes.read(ino, (u8 *)buf, fobj->off, count);
+        fobj->off += ret;
+        inodes.unlock_shared(ino);
+        return ret;
+    }
+
     inodes.lock(ino);
     isize ret = inodes.read(ino, (u8 *)buf, fobj->off, count);
     fobj->off += ino->entry.type == INODE_DEVICE ? 0 : ret;
@@ -690,10 +720,10 @@ int sys_mkdir(const char *path)
         return -1;
     }
 
-    inodes.lock(ino);
+    inodes.lock_shared(ino);
     // lookup in the dir first.
     usize no = inodes.lookup(ino, buf, NULL);
-    inodes.unlock(ino);
+    inodes.unlock_shared(ino);
 
     if (no != 0) {
         // fail: already exists
@@ -795,9 +825,9 @@ int sys_chdir(const char *path)
     ASSERT(ino->valid);
     ASSERT(*buf != '/');
 
-    inodes.lock(ino);
+    inodes.lock_shared(ino);
     usize dno = inodes.lookup(ino, buf, NULL);
-    inodes.unlock(ino);
+    inodes.unlock_shared(ino);
     inodes.put(NULL, ino);
     if (dno == 0) {
         // path not exist
@@ -809,9 +839,8 @@ int sys_chdir(const char *path)
     Inode *dir = inodes.get(dno);
     ASSERT(dir->inode_no == dno);
     ASSERT(dir->rc.count > 0);
-    inodes.lock(dir);
-    inodes.sync(NULL, dir, false);
-    inodes.unlock(dir);
+    inodes.lock_shared(dir);
+    inodes.unlock_shared(dir);
     if (dir->entry.type != INODE_DIRECTORY) {
         // not a directory, fail
         // proc->cwd does not change.
@@ -1004,9 +1033,9 @@ int sys_unlink(const char *target)
 
     // number of dest inode
     usize idx = 0;
-    inodes.lock(ino);
+    inodes.lock_shared(ino);
     usize no = inodes.lookup(ino, buf, &idx);
-    inodes.unlock(ino);
+    inodes.unlock_shared(ino);
     kfree(buf);
     buf = NULL;
 
@@ -1050,9 +1079,9 @@ int sys_unlink(const char *target)
             inodes.sync(ctx, tgt, true);
 
             // should find the parent number
-            inodes.lock(tgt);
+            inodes.lock_shared(tgt);
             usize pno = inodes.lookup(tgt, "..", NULL);
-            inodes.unlock(tgt);
+            inodes.unlock_shared(tgt);
             ASSERT(pno != no);
 
             // parent inode of tgt
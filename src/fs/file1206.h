@@ -54,7 +54,8 @@ typedef struct file {
 
     // reviewer may be concerned about concurrent access to
     // off and ref. But we ensure that must hold inode's lock when
-    // accessing off. Others like pipe and socket is not seekable,
+    // accessing off, where the shared side suffices for a reader if
+    // ref is 1. Others like pipe and socket is not seekable,
     // so off is not used.
 } File;
 
@@ -66,6 +67,14 @@ struct oftable {
 // console device(r,w)
 extern File *console;
 
+/** Allocate a file struct with ref 1 and type FD_NONE.
+ * @return NULL if out of memory.
+ */
+File *falloc(void);
+
+/** Free a file struct from falloc() whose ref dropped to 0. */
+void ffree(File *fobj);
+
 /*-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
  *                          File Syscalls
  -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+*/
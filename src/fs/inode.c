@@ -1,7 +1,9 @@
 #include <common/string.h>
 #include <fs/inode.h>
 #include <kernel/mem.h>
+#include <kernel/slab.h>
 #include <kernel/printk.h>
+#include <kernel/pgcache.h>
 
 /**
     @brief the private reference to the super block.
@@ -131,16 +133,23 @@ void init_inodes(const SuperBlock *_sblock, const BlockCache *_cache)
         printk("(warn) init_inodes: no root inode.\n");
 }
 
-// initialize in-memory inode.
-static void init_inode(Inode *inode)
+// initialize in-memory inode, constructor of inode_cache.
+// An inode goes back to the cache unlocked and with rc 0.
+static void init_inode(void *obj)
 {
-    init_sleeplock(&inode->lock);
+    Inode *inode = obj;
+    // prefer writers, so that a file being read over and over can
+    // still be written.
+    init_rwlock(&inode->lock, true);
     init_rc(&inode->rc);
     init_list_node(&inode->node);
     inode->inode_no = 0;
     inode->valid = false;
+    inode->pages = NULL;
 }
 
+static KmemCache inode_cache = KMEM_CACHE_INIT("inode", Inode, init_inode);
+
 // see `inode.h`.
 /**
     @brief allocate a new zero-initialized inode on disk.
@@ -222,7 +231,7 @@ static void inode_lock(Inode *inode)
 {
     ASSERT(inode->rc.count >= 0);
     // TODO
-    unalertable_acquire_sleeplock(&inode->lock);
+    acquire_rwlock_write(&inode->lock);
     if (!inode->valid) {
         // load from disk.
         Block *block = cache->acquire(to_block_no(inode->inode_no));
@@ -238,13 +247,32 @@ static void inode_lock(Inode *inode)
 
 // see `inode.h`.
 /**
-    @brief release the sleep lock of `inode`.
+    @brief release the mutex of `inode`.
     @see `lock` - the counterpart of this method.
  */
 static void inode_unlock(Inode *inode)
 {
     // TODO
-    release_sleeplock(&inode->lock);
+    release_rwlock_write(&inode->lock);
+}
+
+// see `inode.h`.
+static void inode_lock_shared(Inode *inode)
+{
+    ASSERT(inode->rc.count >= 0);
+    if (!inode->valid) {
+        // loading writes the entry, do it on the exclusive side.
+        // valid never goes back to false while we hold a reference.
+        inode_lock(inode);
+        inode_unlock(inode);
+    }
+    acquire_rwlock_read(&inode->lock);
+}
+
+// see `inode.h`.
+static void inode_unlock_shared(Inode *inode)
+{
+    release_rwlock_read(&inode->lock);
 }
 
 // see `inode.h`.
@@ -321,9 +349,10 @@ static Inode *inode_get(usize inode_no)
     release_spinlock(&lock);
 
     if (ino == NULL) {
-        ino = kalloc(sizeof(Inode));
+        ino = kmem_cache_alloc(&inode_cache);
         ASSERT(ino != NULL);
-        init_inode(ino);
+        ASSERT(ino->rc.count == 0);
+        ino->valid = false;
 
         // set count to 1.
         increment_rc(&ino->rc);
@@ -411,6 +440,7 @@ static void inode_clear(OpContext *ctx, Inode *inode)
     // ASSERT(inode->rc.count == 0);
 
     // you should call inode_lock to lock it.
+    pgcache_drop(inode);
     for (usize i = 0; i < INODE_NUM_DIRECT; i++) {
         // free the direct data block.
         if (inode->entry.addrs[i] != 0) {
@@ -461,7 +491,7 @@ static Inode *inode_share(Inode *inode)
 
     "Free the inode" means freeing all related file blocks and the inode itself.
 
-    @note do not forget `kfree(inode)` after you have done them all!
+    @note do not forget to free the inode after you have done them all!
     @note caller must NOT hold the lock of `inode`. i.e. caller should have `unlock`ed it.
 
     @see `get` - the counterpart of this method.
@@ -484,11 +514,12 @@ static void inode_put(OpContext *ctx, Inode *inode)
             inodes.unlock(inode);
         }
         // no need to sync.
+        pgcache_drop(inode);
 
         // free the inode from list.
         acquire_spinlock(&lock);
         inode_rm_lst(inode);
-        kfree(inode);
+        kmem_cache_free(&inode_cache, inode);
         release_spinlock(&lock);
     }
 }
@@ -751,6 +782,11 @@ static usize inode_write(OpContext *ctx, Inode *inode, u8 *src, usize offset,
     ASSERT(end <= INODE_MAX_BYTES);
     ASSERT(offset <= end);
 
+    // pages mapped from now on must see the new content.
+    if (inode->pages != NULL) {
+        pgcache_drop(inode);
+    }
+
     // a dirty inode continue to be dirty on write.
     bool dirty = false;
     bool modified;
@@ -1068,6 +1104,8 @@ InodeTree inodes = {
     .alloc = inode_alloc,
     .lock = inode_lock,
     .unlock = inode_unlock,
+    .lock_shared = inode_lock_shared,
+    .unlock_shared = inode_unlock_shared,
     .sync = inode_sync,
     .get = inode_get,
     .clear = inode_clear,
@@ -2,6 +2,7 @@
 #include <common/list.h>
 #include <common/rc.h>
 #include <common/spinlock.h>
+#include <common/rwlock.h>
 #include <fs/cache.h>
 #include <fs/defines.h>
 
@@ -10,6 +11,8 @@
  */
 #define ROOT_INODE_NO 1
 
+struct pgcache;
+
 /**
     @brief an inode in memory.
 
@@ -22,8 +25,9 @@ typedef struct {
      *  @brief the lock protecting the inode metadata and its content.
      *  @note it does NOT protect `rc`, `node`, `valid`, etc, because they are
      *  "runtime" variables, not "filesystem" metadata or data of the inode.
+     *  Readers of the content take it shared, see `lock_shared`.
      */
-    SleepLock lock;
+    RWLock lock;
 
     /**
         @brief the reference count of this inode.
@@ -57,6 +61,13 @@ typedef struct {
         @brief the real in-memory copy of the inode on disk.
      */
     InodeEntry entry;
+
+    /**
+        @brief pages of the content mapped by processes, NULL if none.
+
+        @note dropped whenever the content changes, see `kernel/pgcache.h`.
+     */
+    struct pgcache *pages;
 } Inode;
 
 /**
@@ -100,6 +111,26 @@ typedef struct {
      */
     void (*unlock)(Inode *inode);
 
+    /**
+        @brief acquire the lock of `inode` on the shared side.
+
+        Any number of procs may hold it shared at the same time, which
+        suffices for `read` and `lookup`. Anything that modifies `inode`
+        or its content must use `lock` instead.
+
+        If the inode has not been loaded, this method loads it from disk.
+
+        @see `unlock_shared` - the counterpart of this method.
+     */
+    void (*lock_shared)(Inode *inode);
+
+    /**
+        @brief release the shared side of the lock of `inode`.
+
+        @see `lock_shared` - the counterpart of this method.
+     */
+    void (*unlock_shared)(Inode *inode);
+
     /**
         @brief synchronize the content of `inode` between memory and disk.
         
@@ -182,7 +213,7 @@ typedef struct {
         
         @return how many bytes you actually read.
 
-        @note caller must hold the lock of `inode`.
+        @note caller must hold the lock of `inode`, shared suffices.
      */
     usize (*read)(Inode *inode, u8 *dest, usize offset, usize count);
 
@@ -203,7 +234,7 @@ typedef struct {
 
         @return the inode number of the corresponding inode, or 0 if not found.
         
-        @note caller must hold the lock of `inode`.
+        @note caller must hold the lock of `inode`, shared suffices.
 
         @throw panic if `inode` is not a directory.
      */
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <common/defines.h>
+
+/** Accounting of a proc, kept in Proc.acct. Times are in timer ticks.
+ * Updated by its own cpu only: in sched(), on page faults and in the
+ * read/write syscalls.
+ */
+struct proc_acct {
+    u64 run; // time on a cpu
+    u64 wait; // time runnable in a run queue
+    u64 nvcsw; // voluntary switches: went to sleep
+    u64 nivcsw; // involuntary switches: preempted or yielded
+    u64 nfault; // user page faults
+    u64 rbytes; // bytes returned by read
+    u64 wbytes; // bytes accepted by write
+};
+
+/** getacct(ACCT_PROC, ...) record of a proc. Times are in us. */
+struct acct_proc {
+    int pid;
+    int ppid;
+    int state; // enum procstate
+    int nice;
+    int cpu; // the cpu it last ran on
+    u64 run_us;
+    u64 wait_us;
+    u64 nvcsw;
+    u64 nivcsw;
+    u64 nfault;
+    u64 rbytes;
+    u64 wbytes;
+};
+
+/** getacct(ACCT_CPU, ...) record of a cpu. Times are in us. */
+struct acct_cpu {
+    int nrun; // runnable procs in its queue
+    u64 busy_us; // time running procs
+    u64 idle_us; // time in the idle proc
+    u64 nswitch; // context switches
+    u64 nfault; // user page faults
+};
+
+#define ACCT_PROC 0
+#define ACCT_CPU 1
+
+/** Fill up to n records of started procs that are not reaped.
+ * @return the number of such procs, which may exceed n.
+ */
+int acct_procs(struct acct_proc *buf, int n);
+
+/** Fill up to n records of cpus.
+ * @return NCPU.
+ */
+int acct_cpus(struct acct_cpu *buf, int n);
+
+/** Convert timer ticks to us. */
+u64 ticks_to_us(u64 ticks);
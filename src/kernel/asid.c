@@ -0,0 +1,206 @@
+#include <kernel/asid.h>
+#include <kernel/pt.h>
+#include <kernel/cpu.h>
+#include <kernel/printk.h>
+#include <common/spinlock.h>
+#include <common/string.h>
+#include <aarch64/intrinsic.h>
+#include <aarch64/mmu.h>
+
+#define NUM_ASID (1ull << ASID_BITS)
+#define ASID_MASK (NUM_ASID - 1)
+
+/** pgdir->asid is generation | ASID, 0 if it has none.
+ * The generation counts in units of NUM_ASID. */
+#define gen_match(id) \
+    ((((id) ^ __atomic_load_n(&generation, __ATOMIC_RELAXED)) >> ASID_BITS) == 0)
+
+/** Protects the allocation of ASIDs */
+static SpinLock asid_lock;
+static u64 generation = NUM_ASID;
+static u64 nrollover;
+/** ASIDs used in this generation, ASID 0 is for no pgdir */
+static u64 asid_map[NUM_ASID / 64] = { 1 };
+static u64 cur_idx = 1;
+
+static struct {
+    u64 active; // ASID running, 0 after a rollover
+    u64 reserved; // ASID running at the last rollover
+    bool flush; // the TLB may hold entries of the last generation
+    u64 ttbr; // value in TTBR0
+    struct asid_stat stat;
+} __attribute__((aligned(64))) pcpu[NCPU];
+
+static INLINE bool test_and_set(u64 asid)
+{
+    u64 bit = 1ull << (asid % 64);
+    bool old = (asid_map[asid / 64] & bit) != 0;
+    asid_map[asid / 64] |= bit;
+    return old;
+}
+
+/** Returns 0 if none. */
+static u64 find_free(u64 from)
+{
+    for (u64 asid = from; asid < NUM_ASID; asid++) {
+        if ((asid_map[asid / 64] & (1ull << (asid % 64))) == 0) {
+            return asid;
+        }
+    }
+    return 0;
+}
+
+/** Start a new generation. Must hold asid_lock. */
+static void flush_context()
+{
+    memset(asid_map, 0, sizeof(asid_map));
+    asid_map[0] = 1;
+    for (int i = 0; i < NCPU; i++) {
+        u64 asid = __atomic_exchange_n(&pcpu[i].active, 0, __ATOMIC_RELAXED);
+        // the cpu has not switched since the last rollover,
+        // it still runs the reserved one.
+        if (asid == 0) {
+            asid = pcpu[i].reserved;
+        }
+        test_and_set(asid & ASID_MASK);
+        pcpu[i].reserved = asid;
+        pcpu[i].flush = true;
+    }
+    nrollover++;
+}
+
+/** A pgdir running somewhere keeps its ASID across the rollover. */
+static bool check_update_reserved(u64 asid, u64 newasid)
+{
+    bool hit = false;
+    for (int i = 0; i < NCPU; i++) {
+        if (pcpu[i].reserved == asid) {
+            hit = true;
+            pcpu[i].reserved = newasid;
+        }
+    }
+    return hit;
+}
+
+/** Must hold asid_lock. */
+static u64 new_context(struct pgdir *pd)
+{
+    u64 asid = pd->asid;
+    if (asid != 0) {
+        // try to keep the number from the last generation.
+        u64 newasid = generation | (asid & ASID_MASK);
+        if (check_update_reserved(asid, newasid)) {
+            return newasid;
+        }
+        if (!test_and_set(asid & ASID_MASK)) {
+            return newasid;
+        }
+    }
+
+    asid = find_free(cur_idx);
+    if (asid == 0) {
+        __atomic_store_n(&generation, generation + NUM_ASID, __ATOMIC_RELAXED);
+        flush_context();
+        asid = find_free(1);
+        ASSERT(asid != 0);
+    }
+    test_and_set(asid);
+    cur_idx = asid;
+    return generation | asid;
+}
+
+static void load_ttbr0(int cid, u64 pa, u64 asid)
+{
+    u64 ttbr = pa | (asid << 48);
+    if (pcpu[cid].ttbr == ttbr) {
+        pcpu[cid].stat.nskip++;
+        return;
+    }
+    arch_set_ttbr0_asid(pa, asid);
+    pcpu[cid].ttbr = ttbr;
+    pcpu[cid].stat.nswitch++;
+}
+
+void switch_pgdir(struct pgdir *pd)
+{
+    extern PTEntries invalid_pt;
+    const int cid = cpuid();
+    if (pd->pt == NULL) {
+        // ASID 0 has no entries, and active is kept as it is.
+        load_ttbr0(cid, K2P(&invalid_pt), 0);
+        return;
+    }
+
+    u64 asid = pd->asid;
+    u64 old = __atomic_load_n(&pcpu[cid].active, __ATOMIC_RELAXED);
+    // a rollover clears active, which fails the exchange.
+    if (old == 0 || !gen_match(asid) ||
+        !__atomic_compare_exchange_n(&pcpu[cid].active, &old, asid, false,
+                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        acquire_spinlock(&asid_lock);
+        asid = pd->asid;
+        if (!gen_match(asid)) {
+            asid = new_context(pd);
+            pd->asid = asid;
+            pcpu[cid].stat.nnew++;
+        }
+        if (pcpu[cid].flush) {
+            pcpu[cid].flush = false;
+            arch_tlbi_vmalle1();
+            pcpu[cid].stat.nflush++;
+        }
+        __atomic_store_n(&pcpu[cid].active, asid, __ATOMIC_RELAXED);
+        release_spinlock(&asid_lock);
+    }
+    load_ttbr0(cid, K2P(pd->pt), asid & ASID_MASK);
+}
+
+void asid_release(struct pgdir *pd)
+{
+    extern PTEntries invalid_pt;
+    const int cid = cpuid();
+    // do not leave the walker on tables about to be freed.
+    if (pd->pt != NULL &&
+        pcpu[cid].ttbr == (K2P(pd->pt) | ((pd->asid & ASID_MASK) << 48))) {
+        load_ttbr0(cid, K2P(&invalid_pt), 0);
+    }
+    // the number is not handed out again before the next rollover,
+    // which flushes the TLB entries tagged with it.
+    pd->asid = 0;
+}
+
+void flush_tlb_page(struct pgdir *pd, u64 va)
+{
+    // never attached, nothing cached.
+    if (pd->asid != 0) {
+        arch_tlbi_vae1is(va, pd->asid & ASID_MASK);
+    }
+}
+
+void flush_tlb_pgdir(struct pgdir *pd)
+{
+    if (pd->asid != 0) {
+        arch_tlbi_aside1is(pd->asid & ASID_MASK);
+    }
+}
+
+void asid_stat(int cpu, struct asid_stat *st)
+{
+    ASSERT(cpu >= 0 && cpu < NCPU && st != NULL);
+    // racy, which is fine for statistics.
+    *st = pcpu[cpu].stat;
+}
+
+void asid_dump()
+{
+    printk("asid: generation %lld, %lld rollovers\n",
+           (i64)(generation >> ASID_BITS), (i64)nrollover);
+    for (int i = 0; i < NCPU; i++) {
+        struct asid_stat st;
+        asid_stat(i, &st);
+        printk("cpu %d: %lld ttbr0 writes, %lld skipped, %lld new asids, "
+               "%lld flushes\n",
+               i, (i64)st.nswitch, (i64)st.nskip, (i64)st.nnew,
+               (i64)st.nflush);
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <common/defines.h>
+
+/**
+ * Address space identifiers.
+ *
+ * User pages are mapped non-global(PTE_NG), so their TLB entries are
+ * tagged with the ASID in TTBR0, and switching between address spaces
+ * needs no TLB flush. Each pgdir gets an ASID when it is first attached.
+ * When ASIDs run out, a new generation starts: the ASIDs running on
+ * each cpu are kept, every cpu flushes its TLB before it takes a new
+ * ASID, and other pgdirs get new ASIDs when they are attached again.
+ */
+
+#define ASID_BITS 8
+
+struct pgdir;
+
+/** Load pgdir into TTBR0 of this cpu, with its ASID.
+ * Skips the write if it is loaded already. */
+void switch_pgdir(struct pgdir *pgdir);
+
+/** Called before the page tables of pgdir are freed. */
+void asid_release(struct pgdir *pgdir);
+
+/** Flush TLB entries of a page of pgdir, on all cpus. */
+void flush_tlb_page(struct pgdir *pgdir, u64 va);
+
+/** Flush TLB entries of pgdir, on all cpus. */
+void flush_tlb_pgdir(struct pgdir *pgdir);
+
+struct asid_stat {
+    u64 nswitch; // TTBR0 writes
+    u64 nskip; // TTBR0 writes skipped, the pgdir is loaded already
+    u64 nnew; // new ASIDs allocated
+    u64 nflush; // local TLB flushes after a rollover
+};
+
+void asid_stat(int cpu, struct asid_stat *st);
+
+/** Print the generation and per-cpu statistics. */
+void asid_dump();
@@ -3,23 +3,33 @@
 #ifndef __KERNEL_CONFIG_
 #define __KERNEL_CONFIG_
 
-/** Round-Robin Core Configuration 
- * This is introduced to provide  the kernel
- * with overhead balance.
- * 
- * For each proc, if it yields, then it will be put 
- * in a different scheduler queue, and hence be run 
- * on a different core later. Upon creation of a proc,
- * it is put to the scheduler queue with id 
- * (p->id % NCPU). An exception to this strategy is 
- * idle threads: they cannot be run on other cores.
- * 
- * To disable this configuration, add #undef RCC and 
- * recompile.
+/** Per-CPU run queues.
+ * Each cpu runs procs from its own run queue, which has its
+ * own lock. A proc is owned by the queue of the cpu it last ran
+ * on, and goes back there when it yields or is woken up, so that
+ * its cache stays warm. New procs start on the shortest queue.
+ * A cpu whose queue is empty steals up to SCHED_STEAL_BATCH procs,
+ * half of the queue at most, from the longest queue.
+ * Waking a proc owned by an idle cpu sends that cpu a reschedule
+ * IPI(RESCHED_IRQ), so it does not wait for its next tick.
+ *
+ * Ticks are dynamic: the preemption tick runs only while other procs
+ * wait in the queue. An idle cpu, or a cpu with a single runnable
+ * proc, programs its timer only for the earliest struct timer. A cpu
+ * that has procs waiting kicks an idle cpu to steal them, and a
+ * wakeup kicks the owner cpu if its tick is stopped.
  */
-#define RCC
+#define SCHED_STEAL_BATCH 4
 
-/** It does not perform well on rcc_test. Not set. */
-#undef RCC
+/** Fair-share scheduling.
+ * A run queue is ordered by virtual runtime: the time a proc has run,
+ * scaled by NICE_0_WEIGHT over the weight of its nice value. Every
+ * runnable proc runs once in about SCHED_LATENCY_MS, for a share of it
+ * proportional to its weight, but never less than SCHED_MIN_GRAN_MS.
+ * A woken sleeper is placed at most SCHED_LATENCY_MS / 2 behind the
+ * queue, so that it runs soon but cannot starve the others.
+ */
+#define SCHED_LATENCY_MS 20
+#define SCHED_MIN_GRAN_MS 2
 
 #endif // __KERNEL_CONFIG_
@@ -3,7 +3,9 @@
 #include <driver/virtio.h>
 #include <kernel/core.h>
 #include <kernel/cpu.h>
+#include <kernel/mem.h>
 #include <kernel/printk.h>
+#include <kernel/reclaim.h>
 #include <kernel/sched.h>
 #include <test/test.h>
 #include <fdutil/stddef.h>
@@ -24,6 +26,10 @@ NO_RETURN void idle_entry()
         yield();
         if (panic_flag)
             break;
+        // nothing to run: zero some pages for later page faults,
+        // and only sleep once the pool is full.
+        if (fill_zeroed_pages())
+            continue;
         arch_with_trap
         {
             arch_wfi();
@@ -38,6 +44,9 @@ NO_RETURN void kernel_entry()
     printk("Hello world! (Core %lld)\n", cpuid());
     // user_proc_test();
 
+    // reclaim memory in the background under pressure.
+    start_reclaimd();
+
     // before doing anything else,
     // initialize the file system first.
     // the fs is initialized here because it need
@@ -25,7 +25,8 @@ static void __timer_set_clock()
 {
     auto node = _rb_first(&cpus[cpuid()].timer);
     if (!node) {
-        reset_clock(10);
+        // tickless: nothing to wake up for.
+        reset_clock(CLOCK_FOREVER);
         return;
     }
     auto t1 = container_of(node, struct timer, _node)->_key;
@@ -38,14 +39,18 @@ static void __timer_set_clock()
 
 static void timer_clock_handler()
 {
-    reset_clock(10);
     while (1) {
         auto node = _rb_first(&cpus[cpuid()].timer);
-        if (!node)
+        if (!node) {
+            __timer_set_clock();
             break;
+        }
         auto timer = container_of(node, struct timer, _node);
-        if (get_timestamp_ms() < timer->_key)
+        if (get_timestamp_ms() < timer->_key) {
+            // fired early, for a deadline beyond the range of the clock.
+            __timer_set_clock();
             break;
+        }
         cancel_cpu_timer(timer);
         timer->triggered = true;
         timer->handler(timer);
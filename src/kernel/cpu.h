@@ -7,9 +7,21 @@
 #define NCPU 4
 #endif // Add an unfortunate patch. Hmm??@!
 
+/** Run queue of a cpu */
 struct sched {
-    // TODO: customize your sched info
-};
+    SpinLock lock; // protects tree and the state of procs owned by the cpu
+    struct rb_root_ tree; // runnable procs, by vruntime
+    int nrun; // size of tree, read by other cpus without lock
+    u64 load; // sum of the weights of procs in tree
+    u64 min_vruntime; // monotonic, follows the smallest vruntime
+    u64 nswitch; // context switches
+    u64 nsteal; // times this cpu stole from others
+    u64 nstolen; // procs stolen by this cpu
+    u64 nkick; // reschedule IPIs sent to this cpu
+    u64 busy; // timer ticks spent running procs
+    u64 idle; // timer ticks spent in the idle proc
+    bool tick_on; // the preemption timer is armed
+} __attribute__((aligned(64)));
 
 struct Proc;
 struct cpu {
@@ -20,6 +32,7 @@ struct cpu {
     struct Proc *idle; // idle proc
     int noff; // depth of push_off()
     int intena; // interrupt enabled
+    u64 nfault; // user page faults taken
 };
 
 extern struct cpu cpus[NCPU];
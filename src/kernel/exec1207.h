@@ -115,6 +115,12 @@ typedef struct {
 
 extern int exec(const char *path, char **argv);
 extern int fork();
+/** Start a child running the executable at path, without cloning
+ * this proc. Child fd i is fd fdmap[i] of this proc, or closed if it is
+ * negative or i >= nfd. With fdmap NULL, all open files are inherited.
+ * @return the pid of the child, -1 if path cannot be loaded.
+ */
+extern int spawn(const char *path, char **argv, const int *fdmap, int nfd);
 
 // Make stack size: 8 pages.
 #define STACK_PAGE 8
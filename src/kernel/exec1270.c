@@ -1,8 +1,10 @@
 #include "exec1207.h"
 #include <fs/file1206.h>
 #include <kernel/mem.h>
+#include <kernel/mmap1217.h>
 #include <kernel/pt.h>
 #include <kernel/proc.h>
+#include <kernel/sched.h>
 #include <common/string.h>
 
 // aarch64/trap.S
@@ -17,6 +19,13 @@ extern void proc_entry(void (*entry)(u64), u64 arg);
  */
 static int install_section(struct pgdir *pd, Elf64_Phdr *ph, File *exe);
 
+/** Load the executable into an empty pgdir, with argv on its stack,
+ * and set ctx to start it.
+ * @return 0 on success.
+ */
+static int load_image(struct pgdir *pd, UserContext *ctx, File *exe,
+                      char **argv);
+
 extern int exec(const char *path, char **argv)
 {
     File *exe = fopen(path, F_READ);
@@ -30,6 +39,20 @@ extern int exec(const char *path, char **argv)
     struct pgdir *pd = &proc->pgdir;
     free_pgdir(pd);
 
+    int ret = load_image(pd, proc->ucontext, exe, argv);
+    fclose(exe);
+    if (ret != 0) {
+        return -1;
+    }
+
+    // install the page table.
+    attach_pgdir(pd);
+    return 0;
+}
+
+static int load_image(struct pgdir *pd, UserContext *ctx, File *exe,
+                      char **argv)
+{
     Elf64_Ehdr *ehdr = kalloc(sizeof(Elf64_Ehdr));
     if (ehdr == NULL) {
         // must fail
@@ -84,8 +107,8 @@ extern int exec(const char *path, char **argv)
 
     // map the space for heap
     // alloc lazily. Do not do mapping.
-    struct section *heap = kalloc(sizeof(struct section));
-    heap->flags = 0;
+    struct section *heap = alloc_section();
+    ASSERT(heap != NULL);
     heap->flags |= PF_R; // readable heap
     heap->flags |= PF_W; // writable heap
     heap->npages = 0;
@@ -99,8 +122,8 @@ extern int exec(const char *path, char **argv)
     *entr = K2P(stkpg) | PTE_USER_DATA;
 
     // add the stack area in pgdir.
-    struct section *sec = kalloc(sizeof(struct section));
-    sec->flags = 0;
+    struct section *sec = alloc_section();
+    ASSERT(sec != NULL);
     sec->flags |= PF_R; // readable
     sec->flags |= PF_W; // writable
     sec->npages = STACK_PAGE;
@@ -117,7 +140,6 @@ extern int exec(const char *path, char **argv)
     sec = NULL; // avoid modification
 
     // setup a user context for trap_return.
-    UserContext *ctx = proc->ucontext;
     memset(ctx, 0, sizeof(*ctx));
     // see aarch64/trap.S for why set x0 to this val.
     // ctx->spsr = 0;
@@ -165,13 +187,6 @@ extern int exec(const char *path, char **argv)
     // free allocated resources.
     kfree(ehdr);
     kfree(phdr);
-    fclose(exe);
-
-    // install the page table.
-    attach_pgdir(pd);
-
-    // set ctx so as to jump here.
-    proc->ucontext = ctx;
     return 0;
 
 exec_bad:
@@ -199,8 +214,8 @@ static int install_section(struct pgdir *pd, Elf64_Phdr *ph, File *exe)
     void *end = addr_round_up(ph->p_vaddr + ph->p_memsz, PAGE_SIZE);
 
     // record in the proc's pgdir.
-    struct section *sec = kalloc(sizeof(struct section));
-    sec->flags = 0;
+    struct section *sec = alloc_section();
+    ASSERT(sec != NULL);
     sec->npages = (end - start) / PAGE_SIZE;
     sec->start = (u64)start;
     // set flags based on ph flag
@@ -213,6 +228,23 @@ static int install_section(struct pgdir *pd, Elf64_Phdr *ph, File *exe)
     if (ph->p_flags & PF_X) {
         sec->flags |= PF_X;
     }
+
+    // map it from the file, the pages are read when first touched.
+    // read-only ones come from the page cache, shared by all procs
+    // running the program, writable ones are copied on write.
+    // this needs the file offsets to be congruent to the addresses,
+    // and pages that belong to no other segment.
+    const u64 skew = ph->p_vaddr % PAGE_SIZE;
+    if (start < end && ph->p_offset % PAGE_SIZE == skew &&
+        section_search(pd, (u64)start) == NULL &&
+        section_search(pd, (u64)end - PAGE_SIZE) == NULL) {
+        sec->fobj = fshare(exe);
+        sec->offset = ph->p_offset - skew;
+        sec->fsize = ph->p_filesz + skew;
+        sec->flags |= PF_F;
+        pgdir_add_section(pd, sec);
+        return 0;
+    }
     pgdir_add_section(pd, sec);
     sec = NULL; // avoid further modification
 
@@ -286,6 +318,72 @@ install_bad:
     return -1;
 }
 
+/** Start a user child of this proc, which returns to user space with
+ * ctx on its kstack. It inherits the cwd and nice value.
+ */
+static int start_user_child(Proc *child, UserContext *ctx)
+{
+    Proc *proc = thisproc();
+    set_parent_to_this(child);
+
+    // inherent the parent's cwd.
+    child->cwd = inodes.share(proc->cwd);
+
+    // and its nice value.
+    set_nice(child, proc->schinfo.nice);
+
+    memset(&child->kcontext, 0, sizeof(child->kcontext));
+    child->kcontext.x0 = (u64)trap_return;
+    child->kcontext.lr = (uintptr_t)proc_entry;
+    child->kcontext.sp = (u64)ctx;
+    return start_with_kcontext(child);
+}
+
+/** Returns the user context at the top of the kstack of a new proc. */
+static inline UserContext *child_ucontext(Proc *child)
+{
+    ASSERT(child->kstack != NULL);
+    return (UserContext *)(child->kstack + PAGE_SIZE - sizeof(UserContext));
+}
+
+int spawn(const char *path, char **argv, const int *fdmap, int nfd)
+{
+    ASSERT(argv != NULL && nfd <= MAXOFILE);
+    File *exe = fopen(path, F_READ);
+    if (exe == NULL) {
+        // no such file
+        return -1;
+    }
+
+    // the new image goes right into the child: nothing of this proc
+    // is cloned only to be freed by exec().
+    Proc *child = create_proc();
+    if (child == NULL) {
+        fclose(exe);
+        return -1;
+    }
+    UserContext *ctx = child_ucontext(child);
+    int ret = load_image(&child->pgdir, ctx, exe, argv);
+    fclose(exe);
+    if (ret != 0) {
+        destroy_proc(child);
+        return -1;
+    }
+
+    // open files: child fd i is fd fdmap[i] of this proc.
+    Proc *proc = thisproc();
+    for (int i = 0; i < MAXOFILE; i++) {
+        if (fdmap == NULL) {
+            child->ofile.ofile[i] = fshare(proc->ofile.ofile[i]);
+        } else if (i < nfd && fdmap[i] >= 0) {
+            ASSERT(fdmap[i] < MAXOFILE);
+            child->ofile.ofile[i] = fshare(proc->ofile.ofile[fdmap[i]]);
+        }
+    }
+
+    return start_user_child(child, ctx);
+}
+
 // fork implementation that makes parent runs first.
 int fork()
 {
@@ -297,22 +395,15 @@ int fork()
     }
     Proc *proc = thisproc();
 
-    // set parent-child relationship
-    set_parent_to_this(child);
-
     // copy the page dir.
     pgdir_clone(&child->pgdir, &proc->pgdir);
 
     // user context, child's return val is 0.
-    ASSERT(child->kstack != NULL && proc->ucontext != NULL);
-    UserContext *ctx =
-            (UserContext *)(child->kstack + PAGE_SIZE - sizeof(UserContext));
+    ASSERT(proc->ucontext != NULL);
+    UserContext *ctx = child_ucontext(child);
     memcpy(ctx, proc->ucontext, sizeof(UserContext));
     ctx->x0 = 0;
 
-    // inherent the parent's cwd.
-    child->cwd = inodes.share(proc->cwd);
-
     // FIXME: inherent the parent's
     // open file table!
     for (int i = 0; i < MAXOFILE; i++) {
@@ -320,12 +411,6 @@ int fork()
     }
 
     // start the child proc.
-    memset(&child->kcontext, 0, sizeof(child->kcontext));
-    child->kcontext.x0 = (u64)trap_return;
-    child->kcontext.lr = (uintptr_t)proc_entry;
-    child->kcontext.sp = (u64)ctx;
-    start_with_kcontext(child);
-
     // THINK: what is the return value?
-    return child->pid;
+    return start_user_child(child, ctx);
 }
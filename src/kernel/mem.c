@@ -1,20 +1,41 @@
 #include <aarch64/mmu.h>
-#include <common/rc.h>
+#include <common/counter.h>
 #include <common/spinlock.h>
 #include <driver/memlayout.h>
 #include <kernel/mem.h>
 #include <common/string.h>
+#include <kernel/cpu.h>
+#include <kernel/reclaim.h>
 // #include <kernel/printk.h>
 
 #include <fdutil/malloc.h>
 
-RefCount kalloc_page_cnt;
+PercpuCounter kalloc_page_cnt;
 
 static void *zero_page;
 
+/** Maximum number of pages in a zeroed page pool */
+#define ZPOOL_MAX 64
+/** Pages zeroed by fill_zeroed_pages() at a time */
+#define ZPOOL_BATCH 4
+
+/**
+ * Pages zeroed by an idle cpu. Only its cpu touches it, and
+ * kernel code runs with traps disabled, so no lock is needed.
+ */
+static struct zpool {
+    void *pages[ZPOOL_MAX];
+    int npg;
+} __attribute__((aligned(64))) zpools[NCPU];
+
+/** Zeroed pages handed out from, or missed in, the pools */
+static PercpuCounter zpool_nhit, zpool_nmiss;
+
 void kinit()
 {
-    init_rc(&kalloc_page_cnt);
+    init_pcpu_counter(&kalloc_page_cnt);
+    init_pcpu_counter(&zpool_nhit);
+    init_pcpu_counter(&zpool_nmiss);
     /** Initialize palloc and malloc module. */
     palloc_init();
     malloc_init();
@@ -22,18 +43,87 @@ void kinit()
     zero_page = palloc_get();
     ASSERT(zero_page != NULL);
     memset(zero_page, 0, PAGE_SIZE);
+
+    /** Watermarks and shrinkers of memory reclaim. */
+    init_reclaim();
+}
+
+long long kalloc_page_count()
+{
+    return pcpu_counter_read(&kalloc_page_cnt);
 }
 
 void *kalloc_page()
 {
-    increment_rc(&kalloc_page_cnt);
+    reclaim_check();
+    void *ret = palloc_get();
+    if (ret == NULL) {
+        // reclaim directly before failing.
+        reclaim_pages(1);
+        ret = palloc_get();
+    }
+    if (ret != NULL) {
+        pcpu_counter_inc(&kalloc_page_cnt);
+    }
+    return ret;
+}
+
+void *kalloc_page_zeroed()
+{
+    struct zpool *zp = &zpools[cpuid()];
+    if (zp->npg > 0) {
+        pcpu_counter_inc(&zpool_nhit);
+        pcpu_counter_inc(&kalloc_page_cnt);
+        return zp->pages[--zp->npg];
+    }
+
+    pcpu_counter_inc(&zpool_nmiss);
+    void *ret = kalloc_page();
+    if (ret != NULL) {
+        memset(ret, 0, PAGE_SIZE);
+    }
+    return ret;
+}
+
+bool fill_zeroed_pages()
+{
+    struct zpool *zp = &zpools[cpuid()];
+    for (int i = 0; i < ZPOOL_BATCH; i++) {
+        if (zp->npg >= ZPOOL_MAX || mem_pressure()) {
+            return false;
+        }
+        // not counted in kalloc_page_cnt until handed out.
+        void *pg = palloc_get();
+        if (pg == NULL) {
+            return false;
+        }
+        memset(pg, 0, PAGE_SIZE);
+        zp->pages[zp->npg++] = pg;
+    }
+    return zp->npg < ZPOOL_MAX;
+}
+
+unsigned long long drain_zeroed_pages()
+{
+    struct zpool *zp = &zpools[cpuid()];
+    unsigned long long ret = zp->npg;
+    while (zp->npg > 0) {
+        palloc_free(zp->pages[--zp->npg]);
+    }
+    return ret;
+}
 
-    return palloc_get();
+void zpool_stat(int cpu, struct zpool_stat *st)
+{
+    ASSERT(cpu >= 0 && cpu < NCPU && st != NULL);
+    st->npg = zpools[cpu].npg;
+    st->nhit = pcpu_counter_read_cpu(&zpool_nhit, cpu);
+    st->nmiss = pcpu_counter_read_cpu(&zpool_nmiss, cpu);
 }
 
 void kfree_page(void *p)
 {
-    decrement_rc(&kalloc_page_cnt);
+    pcpu_counter_dec(&kalloc_page_cnt);
     // check offset
     ASSERT(((u64)p & 0xffful) == 0);
 
@@ -45,10 +135,28 @@ void kfree_page(void *p)
     return;
 }
 
+void *kalloc_pages(unsigned int order)
+{
+    void *ret = palloc_get_order(order);
+    if (ret != NULL) {
+        pcpu_counter_add(&kalloc_page_cnt, 1 << order);
+    }
+    return ret;
+}
+
+void kfree_pages(void *p, unsigned int order)
+{
+    if (p == NULL) {
+        return;
+    }
+    pcpu_counter_add(&kalloc_page_cnt, -(1 << order));
+    palloc_free_order(p, order);
+}
+
 void *kalloc(unsigned long long size)
 {
-    /** Note to TAs: malloc and free will call increment_rc
-     * and decrement_rc to ensure that page usage 
+    /** Note to TAs: malloc and free will update kalloc_page_cnt
+     * to ensure that page usage 
      * are correctly collected. In src/fdutil/malloc.c
      * line 135 and 189.
      */
@@ -63,11 +171,30 @@ void kfree(void *ptr)
 
 void *kshare_page(void *pg)
 {
+    if (pg == zero_page) {
+        // never freed, so never counted.
+        return pg;
+    }
     return palloc_share(pg);
 }
 
+bool kpage_exclusive(void *pg)
+{
+    return palloc_exclusive(pg);
+}
+
+bool kunshare_page(void *pg)
+{
+    return palloc_unshare(pg);
+}
+
 void *kalloc_zero()
 {
-    increment_rc(&kalloc_page_cnt);
+    pcpu_counter_inc(&kalloc_page_cnt);
     return zero_page;
 }
+
+bool kpage_is_zero(void *pg)
+{
+    return pg == zero_page;
+}
@@ -2,9 +2,43 @@
 
 void kinit();
 
+// pages allocated and not freed yet, summed over the per-cpu counts.
+// exact once the cpus that allocate or free have synchronized.
+long long kalloc_page_count();
+
 WARN_RESULT void *kalloc_page();
 void kfree_page(void *);
+
+// allocate a page filled with 0, preferably from the pool
+// of pages zeroed by idle cpus. Freed by kfree_page.
+WARN_RESULT void *kalloc_page_zeroed();
+
+// called by idle cpus: zero a few pages into the pool of this cpu.
+// returns false if the pool is full(or memory runs low).
+bool fill_zeroed_pages();
+
+// give the pages in the zeroed pool of this cpu back.
+// returns number of pages freed.
+unsigned long long drain_zeroed_pages();
+
+// statistics of the zeroed page pool of a cpu.
+struct zpool_stat {
+    unsigned long long npg; // pages in the pool
+    unsigned long long nhit; // kalloc_page_zeroed served by the pool
+    unsigned long long nmiss; // kalloc_page_zeroed that zeroed a page
+};
+void zpool_stat(int cpu, struct zpool_stat *st);
+
+// allocate 2^order physically contiguous pages.
+WARN_RESULT void *kalloc_pages(unsigned int order);
+void kfree_pages(void *, unsigned int order);
+// share pg, or return a copy if it has too many references.
+// the zero page is shared without counting.
 void *kshare_page(void *pg);
+// true if the caller holds the only reference of pg.
+bool kpage_exclusive(void *pg);
+// drop a reference of pg unless it is the only one, see palloc_unshare.
+bool kunshare_page(void *pg);
 
 WARN_RESULT void *kalloc(unsigned long long);
 void kfree(void *);
@@ -12,3 +46,5 @@ void kfree(void *);
 // allocate a zero-init, read-only page.
 // This can be safely freed by kfree_page.
 void *kalloc_zero();
+// true if pg is the page of kalloc_zero().
+bool kpage_is_zero(void *pg);
@@ -1,6 +1,10 @@
 #include <kernel/mmap1217.h>
+#include <kernel/cpu.h>
+#include <kernel/asid.h>
 #include <fs/file1206.h>
 #include <common/string.h>
+#include <kernel/pgcache.h>
+#include <common/counter.h>
 
 #ifndef MIN
 #define MIN(a, b) ((a) > (b) ? (b) : (a))
@@ -12,6 +16,9 @@
 
 static void *find_mmap_addr(struct pgdir *pd, u64 len);
 
+/** Read faults that mapped the zero page, and writes that replaced it */
+static PercpuCounter zero_nmap, zero_ncow;
+
 u64 mmap(void *addr, u64 length, int prot, int flags, int fd, isize offset)
 {
     // check for parameters.
@@ -69,7 +76,10 @@ u64 mmap(void *addr, u64 length, int prot, int flags, int fd, isize offset)
         return MMAP_FAILED;
     }
 
-    struct section *sec = kalloc(sizeof(struct section));
+    struct section *sec = alloc_section();
+    if (sec == NULL) {
+        return MMAP_FAILED;
+    }
     sec->npages = length / PAGE_SIZE;
     sec->start = (u64)addr;
     sec->offset = 0;
@@ -89,13 +99,13 @@ u64 mmap(void *addr, u64 length, int prot, int flags, int fd, isize offset)
     if (fd >= 0 && fd < MAXOFILE && (fobj = ofile[fd]) != NULL) {
         if (fobj->type != FD_INODE) {
             // bad fd
-            kfree(sec);
+            free_section(sec);
             return MMAP_FAILED;
         }
         if ((flags & MAP_PRIVATE) == 0 && !fobj->writable &&
             (prot & PROT_WRITE)) {
             // don't allow shared map of a read-only file.
-            kfree(sec);
+            free_section(sec);
             return MMAP_FAILED;
         }
 
@@ -103,13 +113,14 @@ u64 mmap(void *addr, u64 length, int prot, int flags, int fd, isize offset)
         ASSERT(ino->valid);
         if (ino->entry.type != INODE_REGULAR) {
             // bad fd
-            kfree(sec);
+            free_section(sec);
             return MMAP_FAILED;
         }
 
         // create a file backend.
         sec->fobj = fshare(fobj);
         sec->offset = offset;
+        sec->fsize = length;
         sec->flags |= PF_F;
     }
 
@@ -177,7 +188,7 @@ int section_unmap(struct pgdir *pd, struct section *sec)
     for (u32 i = 0; i < sec->npages; i++) {
         // deallocate all pages.
         u64 addr = i * PAGE_SIZE + sec->start;
-        PTEntry *pte = get_pte(pd, addr, false);
+        PTEntry *pte = get_pte_mut(pd, addr);
 
         // we accept pte to be NULL
         // since mmap does lazy mmaping.
@@ -194,9 +205,10 @@ int section_unmap(struct pgdir *pd, struct section *sec)
                                sec->offset + (addr - sec->start));
             }
 
-            kfree_page((void *)pg);
             // clear mapping.
             *pte = 0;
+            flush_tlb_page(pd, addr);
+            kfree_page((void *)pg);
         }
     }
 
@@ -239,7 +251,8 @@ int munmap(void *addr, u64 length)
     struct section *right = NULL;
     // it is allowed to leave some pages in the front.
     if ((u64)addr > sec->start) {
-        left = kalloc(sizeof(struct section));
+        left = alloc_section();
+        ASSERT(left != NULL);
         left->start = sec->start;
         left->npages = ((u64)addr - sec->start) / PAGE_SIZE;
         left->flags = sec->flags;
@@ -249,7 +262,8 @@ int munmap(void *addr, u64 length)
 
     if ((u64)addr + length < end) {
         // create a mapping at end.
-        right = kalloc(sizeof(struct section));
+        right = alloc_section();
+        ASSERT(right != NULL);
         right->start = (u64)addr + length;
         right->npages = (end - right->start) / PAGE_SIZE;
         right->flags = sec->flags;
@@ -265,7 +279,7 @@ int munmap(void *addr, u64 length)
     sec->start = (u64)addr;
     sec->npages = length / PAGE_SIZE;
     section_unmap(pd, sec);
-    kfree(sec);
+    free_section(sec);
 
     // if any, add the rest 'segment' to the pgdir.
     if (left != NULL) {
@@ -300,7 +314,23 @@ struct section *section_search(struct pgdir *pd, u64 uva)
     return NULL;
 }
 
-int section_install(struct pgdir *pd, struct section *sec, u64 uva)
+/** Returns the index in the file of the page at uva of sec, if it can
+ * be mapped from the page cache: it is private and all from the file.
+ * @return -1 otherwise.
+ */
+static isize section_cache_index(struct section *sec, u64 uva)
+{
+    const u64 secoff = uva - sec->start;
+    const isize off = sec->offset + secoff;
+    if ((sec->flags & PF_F) == 0 || (sec->flags & PF_S) ||
+        off % PAGE_SIZE != 0 || secoff + PAGE_SIZE > sec->fsize) {
+        return -1;
+    }
+    return off / PAGE_SIZE;
+}
+
+int section_install(struct pgdir *pd, struct section *sec, u64 uva,
+                    bool write)
 {
     ASSERT(pd != NULL && sec != NULL);
     uva -= (uva % PAGE_SIZE);
@@ -312,6 +342,12 @@ int section_install(struct pgdir *pd, struct section *sec, u64 uva)
         ASSERT(*pte & PTE_VALID);
         // this is caused by EACCESS, i.e.
         // write to read-only page
+        if ((*pte & PTE_RO) == 0 || !write) {
+            // nothing to do: a read of a present page, or a write
+            // under a last-level table shared by fork(), which
+            // get_pte() has just copied.
+            return 0;
+        }
 
         if ((sec->flags & PF_W) == 0) {
             // write to read-only page
@@ -321,37 +357,150 @@ int section_install(struct pgdir *pd, struct section *sec, u64 uva)
         // the page should be writeable, but have
         // read-only enabled. So we copy the page,
         // and mark it as writable.
-        void *pg = kalloc_page();
+        void *pg;
         void *src = (void *)P2K(*pte & (~0xffful));
         ASSERT(((u64)src & 0xFFF) == 0);
-        memcpy(pg, src, PAGE_SIZE);
+        if (kpage_is_zero(src)) {
+            // nothing to copy.
+            pg = kalloc_page_zeroed();
+            if (pg == NULL) {
+                return -1;
+            }
+            pcpu_counter_inc(&zero_ncow);
+        } else {
+            pg = kalloc_page();
+            if (pg == NULL) {
+                return -1;
+            }
+            memcpy(pg, src, PAGE_SIZE);
+        }
+        // break before make: the old entry may be cached.
+        *pte = 0;
+        flush_tlb_page(pd, uva);
         *pte = K2P(pg) | PTE_USER_DATA;
         kfree_page(src);
         return 0;
     }
 
-    void *pg = kalloc_page();
-    if (pg == NULL) {
-        return -1;
-    }
-    memset(pg, 0, PAGE_SIZE);
-
-    // init page.
-    if (sec->flags & PF_F) {
+    void *pg = NULL;
+    bool readonly = (sec->flags & PF_W) == 0;
+    const u64 secoff = uva - sec->start;
+    if ((sec->flags & PF_F) && secoff < sec->fsize) {
         // read from file.
-        isize off = sec->offset + (uva - sec->start);
+        const isize off = sec->offset + secoff;
+        const isize idx = section_cache_index(sec, uva);
         Inode *ino = sec->fobj->ino;
-        inodes.lock(ino);
-        inodes.read(ino, pg, off, PAGE_SIZE);
-        inodes.unlock(ino);
+        inodes.lock_shared(ino);
+        if (idx >= 0) {
+            // map the cached page, which is copied on the first write.
+            pg = pgcache_get(ino, idx);
+            readonly = readonly || pg != NULL;
+        }
+        if (pg == NULL && (pg = kalloc_page_zeroed()) != NULL) {
+            inodes.read(ino, pg, off,
+                        MIN(sec->fsize - secoff, (u64)PAGE_SIZE));
+        }
+        inodes.unlock_shared(ino);
+    } else if (!write && (sec->flags & PF_S) == 0) {
+        // reading private memory that was never written: share the
+        // zero page until the first write copies it.
+        pg = kalloc_zero();
+        readonly = true;
+        pcpu_counter_inc(&zero_nmap);
+    } else {
+        pg = kalloc_page_zeroed();
+    }
+    if (pg == NULL) {
+        return -1;
     }
 
     pte = get_pte(pd, uva, true);
     *pte = K2P(pg);
     *pte |= PTE_USER_DATA;
-    if ((sec->flags & PF_W) == 0) {
-        // read-only
+    if (readonly) {
         *pte = *pte | PTE_RO;
     }
     return 0;
 }
+
+void section_fault_around(struct pgdir *pd, struct section *sec, u64 uva)
+{
+    const u64 w = sec->window;
+    const u64 sec_end = sec->start + sec->npages * PAGE_SIZE;
+    const bool seq = uva == sec->ra_next;
+    sec->ra_next = uva + PAGE_SIZE;
+    if (w <= 1 || (sec->flags & PF_F) == 0) {
+        return;
+    }
+
+    // sequential: read the next w pages ahead, and fault again at the
+    // end of them. Otherwise map what is cached in the aligned window.
+    u64 start, end;
+    if (seq) {
+        start = uva + PAGE_SIZE;
+        end = MIN(uva + w * PAGE_SIZE, sec_end);
+        sec->ra_next = end;
+    } else {
+        start = MAX(round_down(uva, w * PAGE_SIZE), sec->start);
+        end = MIN(start + w * PAGE_SIZE, sec_end);
+    }
+
+    Inode *ino = sec->fobj->ino;
+    inodes.lock_shared(ino);
+    for (u64 va = start; va < end; va += PAGE_SIZE) {
+        const isize idx = section_cache_index(sec, va);
+        if (idx < 0) {
+            continue;
+        }
+        PTEntry *pte = get_pte(pd, va, false);
+        if (pte != NULL && *pte != 0) {
+            continue;
+        }
+        void *pg = seq ? pgcache_get(ino, idx) : pgcache_lookup(ino, idx);
+        if (pg == NULL) {
+            continue;
+        }
+        pte = get_pte(pd, va, true);
+        // new entries only, nothing to flush.
+        *pte = K2P(pg) | PTE_USER_DATA | PTE_RO;
+    }
+    inodes.unlock_shared(ino);
+}
+
+int section_fault(u64 uva, bool write)
+{
+    Proc *p = thisproc();
+    struct pgdir *pd = &p->pgdir;
+    p->acct.nfault++;
+    mycpu()->nfault++;
+    struct section *sec = section_search(pd, uva);
+    if (sec == NULL) {
+        // fail
+        return -1;
+    }
+
+    if (section_install(pd, sec, uva, write) != 0) {
+        return -1;
+    }
+    section_fault_around(pd, sec, uva);
+    return 0;
+}
+
+int mwindow(void *addr, int npages)
+{
+    struct section *sec = section_search(&thisproc()->pgdir, (u64)addr);
+    if (sec == NULL) {
+        return -1;
+    }
+    const int old = sec->window;
+    if (npages >= 0) {
+        sec->window = MIN(npages, FAULT_AROUND_MAX);
+    }
+    return old;
+}
+
+void zero_page_stat(struct zero_page_stat *st)
+{
+    st->nmap = pcpu_counter_read(&zero_nmap);
+    st->ncow = pcpu_counter_read(&zero_ncow);
+}
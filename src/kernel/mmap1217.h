@@ -36,6 +36,36 @@ extern int section_unmap(struct pgdir *pd, struct section *sec);
 // null if not found.
 extern struct section *section_search(struct pgdir *pd, u64 uva);
 
-// fetch missing page at uva.
+// fetch missing page at uva, for a write if write.
+// a read of private memory with no file content maps the zero page.
 // return 0 if the page is installed at uva.
-extern int section_install(struct pgdir *pd, struct section *sec, u64 uva);
+extern int section_install(struct pgdir *pd, struct section *sec, u64 uva,
+                           bool write);
+
+/** After a fault at uva is resolved, map the pages around it that are
+ * cheap to get: ones of the file in the page cache, up to sec->window
+ * pages. When the faults of a file mapping are sequential, the pages
+ * after uva are read ahead instead.
+ */
+extern void section_fault_around(struct pgdir *pd, struct section *sec,
+                                 u64 uva);
+
+/** Resolve a fault of this proc at the user page uva, for a write if
+ * write, and map the pages around it. Counted in the accounting of the
+ * proc and the cpu.
+ * @return 0 if the page is installed.
+ */
+extern int section_fault(u64 uva, bool write);
+
+/** Set the window of the mapping at addr, -1 to leave it as is.
+ * @return the old window, -1 if addr is not mapped.
+ */
+extern int mwindow(void *addr, int npages);
+
+/** Statistics of the zero page in user mappings. */
+struct zero_page_stat {
+    u64 nmap; // read faults that mapped the zero page
+    u64 ncow; // writes that replaced it by a page of their own
+};
+
+void zero_page_stat(struct zero_page_stat *st);
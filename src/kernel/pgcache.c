@@ -0,0 +1,103 @@
+#include <kernel/pgcache.h>
+#include <kernel/mem.h>
+#include <aarch64/mmu.h>
+#include <common/spinlock.h>
+#include <common/string.h>
+
+/** Cached pages of an inode, by page index. */
+struct pgcache {
+    usize npages;
+    void *pages[];
+};
+
+/** Protects the pgcache of each inode. */
+static SpinLock pgcache_lock;
+
+void *pgcache_get(Inode *ino, usize idx)
+{
+    ASSERT(ino->valid && ino->entry.type == INODE_REGULAR);
+    // the size is stable, the caller holds the lock.
+    const usize npages = round_up((usize)ino->entry.num_bytes, PAGE_SIZE) /
+                         PAGE_SIZE;
+    if (idx >= npages) {
+        return NULL;
+    }
+
+    acquire_spinlock(&pgcache_lock);
+    struct pgcache *pc = ino->pages;
+    void *pg = pc != NULL ? pc->pages[idx] : NULL;
+    if (pg != NULL) {
+        // may be a copy if the page has too many references.
+        pg = kshare_page(pg);
+        release_spinlock(&pgcache_lock);
+        return pg;
+    }
+    release_spinlock(&pgcache_lock);
+
+    // read it without the spin lock. A racing reader may read it too,
+    // the first one to come back caches its page.
+    pg = kalloc_page_zeroed();
+    if (pg == NULL) {
+        return NULL;
+    }
+    inodes.read(ino, pg, idx * PAGE_SIZE, PAGE_SIZE);
+    struct pgcache *new = NULL;
+    if (pc == NULL) {
+        new = kalloc(sizeof(struct pgcache) + npages * sizeof(void *));
+        if (new != NULL) {
+            new->npages = npages;
+            memset(new->pages, 0, npages * sizeof(void *));
+        }
+    }
+
+    acquire_spinlock(&pgcache_lock);
+    if (ino->pages == NULL) {
+        ino->pages = new;
+        new = NULL;
+    }
+    pc = ino->pages;
+    if (pc != NULL && pc->pages[idx] == NULL) {
+        void *ref = kshare_page(pg);
+        if (ref == pg) {
+            pc->pages[idx] = pg;
+        } else if (ref != NULL) {
+            kfree_page(ref);
+        }
+    }
+    release_spinlock(&pgcache_lock);
+
+    if (new != NULL) {
+        kfree(new);
+    }
+    return pg;
+}
+
+void *pgcache_lookup(Inode *ino, usize idx)
+{
+    acquire_spinlock(&pgcache_lock);
+    struct pgcache *pc = ino->pages;
+    void *pg = pc != NULL && idx < pc->npages ? pc->pages[idx] : NULL;
+    if (pg != NULL) {
+        pg = kshare_page(pg);
+    }
+    release_spinlock(&pgcache_lock);
+    return pg;
+}
+
+void pgcache_drop(Inode *ino)
+{
+    acquire_spinlock(&pgcache_lock);
+    struct pgcache *pc = ino->pages;
+    ino->pages = NULL;
+    release_spinlock(&pgcache_lock);
+
+    if (pc == NULL) {
+        return;
+    }
+    for (usize i = 0; i < pc->npages; i++) {
+        if (pc->pages[i] != NULL) {
+            kfree_page(pc->pages[i]);
+        }
+    }
+    kfree(pc);
+}
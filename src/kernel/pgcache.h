@@ -0,0 +1,31 @@
+#pragma once
+
+#include <common/defines.h>
+#include <fs/inode.h>
+
+/**
+ * Page cache of file content, for private file mappings.
+ *
+ * Read-only pages of executables and of private file mappings are
+ * mapped straight from here, so that every process running a program
+ * shares one copy of its text. A write to a private page copies it,
+ * see section_install(). The cache of an inode holds a reference to
+ * each page, and lives until the content changes or the inode is freed.
+ */
+
+/** Returns the page idx of the content of ino, with a reference for
+ * the caller, reading it if it is not cached. Bytes past the end of the
+ * file are zero. The caller holds the lock of ino, at least shared.
+ * @return NULL if idx is past the end of the file, or out of memory.
+ */
+WARN_RESULT void *pgcache_get(Inode *ino, usize idx);
+
+/** Like pgcache_get(), but never reads: NULL if the page is not cached.
+ * The caller holds the lock of ino, at least shared.
+ */
+WARN_RESULT void *pgcache_lookup(Inode *ino, usize idx);
+
+/** Drop the cached pages of ino. Mapped pages are not affected.
+ * The caller holds the lock of ino, or ino is not used any more.
+ */
+void pgcache_drop(Inode *ino);
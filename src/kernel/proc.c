@@ -1,5 +1,6 @@
 #include <kernel/proc.h>
 #include <kernel/mem.h>
+#include <kernel/slab.h>
 #include <kernel/sched.h>
 #include <aarch64/mmu.h>
 #include <common/list.h>
@@ -29,8 +30,53 @@ static int allocpid()
     return ret;
 }
 
-/** Lock to process tree */
-static SpinLock pstree_lock;
+/** Started procs hashed by pid, so that kill() need not walk the
+ * process tree. Each bucket has its own lock. A proc is added when it
+ * is started and removed when it is reaped by wait().
+ */
+#define PID_HASH_SIZE 256
+static struct pid_bucket {
+    SpinLock lock;
+    struct list procs;
+} pid_hash[PID_HASH_SIZE];
+
+static INLINE struct pid_bucket *pid_bucket_of(int pid)
+{
+    return &pid_hash[(u32)pid % PID_HASH_SIZE];
+}
+
+static void init_pid_hash()
+{
+    for (int i = 0; i < PID_HASH_SIZE; i++) {
+        init_spinlock(&pid_hash[i].lock);
+        list_init(&pid_hash[i].procs);
+    }
+}
+
+static void pid_hash_add(Proc *p)
+{
+    struct pid_bucket *b = pid_bucket_of(p->pid);
+    acquire_spinlock(&b->lock);
+    list_push_back(&b->procs, &p->pidnode);
+    release_spinlock(&b->lock);
+}
+
+static void pid_hash_remove(Proc *p)
+{
+    struct pid_bucket *b = pid_bucket_of(p->pid);
+    acquire_spinlock(&b->lock);
+    list_remove(&p->pidnode);
+    release_spinlock(&b->lock);
+}
+
+/** Add p as a child of parent, with parent->lock held. */
+static void add_child(Proc *parent, Proc *p)
+{
+    acquire_spinlock(&parent->lock);
+    p->parent = parent;
+    list_push_back(&parent->children, &p->ptnode);
+    release_spinlock(&parent->lock);
+}
 
 Proc root_proc;
 
@@ -43,7 +89,7 @@ void init_kproc()
 {
     // TODO:
     // 1. init global resources (e.g. locks, semaphores)
-    init_spinlock(&pstree_lock);
+    init_pid_hash();
     init_spinlock(&pid_lock);
     nextid = 1;
     // 2. init the root_proc (finished)
@@ -74,7 +120,7 @@ static void root_entry(u64 unused __attribute__((unused)))
 // will not activate root proc.
 void init_kproc_test()
 {
-    init_spinlock(&pstree_lock);
+    init_pid_hash();
     init_spinlock(&pid_lock);
     nextid = 1;
 
@@ -85,7 +131,25 @@ void init_kproc_test()
     start_proc(&root_proc, root_entry, 123456);
 }
 
-void init_proc(Proc *p)
+/** Constructor of proc_cache. A proc is freed with no children
+ * and nobody sleeping on childexit, see wait().
+ * The cache is type-stable, so that lock_parent() may still take the
+ * lock of a parent that has been reaped in the meantime.
+ */
+static void proc_ctor(void *obj)
+{
+    Proc *p = obj;
+    init_spinlock(&p->lock);
+    list_init(&p->children);
+    list_init(&p->zombies);
+    init_sem(&p->childexit, 0);
+}
+
+static KmemCache proc_cache =
+        KMEM_CACHE_INIT_TYPESTABLE("proc", Proc, proc_ctor);
+
+/** Setup the members of a constructed proc. */
+static void setup_proc(Proc *p)
 {
     // TODO:
     // setup the Proc with kstack and pid allocated
@@ -96,8 +160,8 @@ void init_proc(Proc *p)
     p->exitcode = 0;
     p->parent = NULL;
     // p->chan = NULL;
-    list_init(&p->children);
-    init_sem(&p->childexit, 0);
+    ASSERT(list_empty(&p->children));
+    ASSERT(list_empty(&p->zombies));
     // kstack is allocated in init_proc(),
     // released in exit().
     p->kstack = kalloc_page();
@@ -113,33 +177,53 @@ void init_proc(Proc *p)
     // be set either to the parent's dir or root.
 
     // init scheduler info here
-#ifdef RCC
-    ASSERT(p->pid >= 0);
-    p->schinfo.coreid = p->pid % NCPU;
-    p->schinfo.bitmap = 0;
-#endif
+    init_schinfo(&p->schinfo);
+    memset(&p->acct, 0, sizeof(p->acct));
+}
+
+void init_proc(Proc *p)
+{
+    proc_ctor(p);
+    setup_proc(p);
+    ASSERT(p->kstack != NULL);
 }
 
 Proc *create_proc()
 {
-    Proc *p = kalloc(sizeof(Proc));
-    init_proc(p);
+    Proc *p = kmem_cache_alloc(&proc_cache);
+    if (p == NULL) {
+        return NULL;
+    }
+    setup_proc(p);
+    if (p->kstack == NULL) {
+        // no page for the kernel stack.
+        kmem_cache_free(&proc_cache, p);
+        return NULL;
+    }
     return p;
 }
 
+void destroy_proc(Proc *p)
+{
+    ASSERT(p->parent == NULL && list_empty(&p->children));
+    free_pgdir(&p->pgdir);
+    kfree_page(p->kstack);
+    kmem_cache_free(&proc_cache, p);
+}
+
 void set_parent_to_this(Proc *proc)
 {
     // TODO: set the parent of proc to thisproc
     // NOTE: maybe you need to lock the process tree
     // NOTE: it's ensured that the old proc->parent = NULL
-    acquire_spinlock(&pstree_lock);
     // [PITFALL]: remove from old parent's children list
-    if (proc->parent != NULL) {
+    Proc *old = proc->parent;
+    if (old != NULL) {
+        acquire_spinlock(&old->lock);
         list_remove(&proc->ptnode);
+        release_spinlock(&old->lock);
     }
-    proc->parent = myproc;
-    list_push_back(&myproc->children, &proc->ptnode);
-    release_spinlock(&pstree_lock);
+    add_child(myproc, proc);
 }
 
 int start_proc(Proc *p, void (*entry)(u64), u64 arg)
@@ -147,10 +231,7 @@ int start_proc(Proc *p, void (*entry)(u64), u64 arg)
     // TODO:
     // 1. set the parent to root_proc if NULL
     if (p->parent == NULL) {
-        acquire_spinlock(&pstree_lock);
-        p->parent = &root_proc;
-        list_push_back(&root_proc.children, &p->ptnode);
-        release_spinlock(&pstree_lock);
+        add_child(&root_proc, p);
     }
     // 2. setup the kcontext to make the proc start with proc_entry(entry, arg)
     memset((void *)&p->kcontext, 0, sizeof(p->kcontext));
@@ -167,6 +248,8 @@ int start_proc(Proc *p, void (*entry)(u64), u64 arg)
     // 3. activate the proc and return its pid
     p->state = UNUSED;
     activate_proc(p);
+    // visible to kill() once started.
+    pid_hash_add(p);
     // NOTE: be careful of concurrency
     return p->pid;
 }
@@ -178,16 +261,14 @@ int start_with_kcontext(Proc *p)
 {
     // 1. set parent to root if null.
     if (p->parent == NULL) {
-        acquire_spinlock(&pstree_lock);
-        p->parent = &root_proc;
-        list_push_back(&root_proc.children, &p->ptnode);
-        release_spinlock(&pstree_lock);
+        add_child(&root_proc, p);
     }
     // 2. activate the proc and return its pid.
     //    it is your job to make sure the kcontext is already setup.
     ASSERT(p->kstack != NULL);
     p->state = UNUSED;
     activate_proc(p);
+    pid_hash_add(p);
     return p->pid;
 }
 
@@ -200,77 +281,83 @@ int wait(int *exitcode)
     // 1. return -1 if no children
     // [PITFALL] if one proc is writeing pstree,
     // list_empty would get incorrect result.
-    acquire_spinlock(&pstree_lock);
-    if (list_empty(&p->children)) {
+    acquire_spinlock(&p->lock);
+    if (list_empty(&p->children) && list_empty(&p->zombies)) {
         Log("no children\n");
-        release_spinlock(&pstree_lock);
+        release_spinlock(&p->lock);
         return -1;
     }
-    // [PITFALL]: must release pstree_lock,
+    // [PITFALL]: must release p->lock,
     // if its child call exit(), then it will try to
-    // acquire pstree_lock, which results in deadlock.
-    release_spinlock(&pstree_lock);
+    // acquire p->lock, which results in deadlock.
+    release_spinlock(&p->lock);
 
-    // 2. wait for childexit
+    // 2. wait for childexit, which is posted once for each zombie.
     bool wait_ret = wait_sem(&p->childexit);
     if (!wait_ret) {
         // passive wakeup, maybe killed
         return -1;
     }
 
-    // reacquire lock
-    acquire_spinlock(&pstree_lock);
-    // 3. if any child exits, clean it up and return its pid and exitcode
-    int ret = -1;
-    ASSERT(!list_empty(&p->children));
-    struct list_elem *e = list_begin(&p->children);
-    for (; e != list_end(&p->children); e = list_next(e)) {
-        struct Proc *chd = list_entry(e, struct Proc, ptnode);
-        // validate child proc
-        ASSERT(chd->parent == p);
-        ASSERT(chd->pid >= 0);
-        Log("(%d): state %d\n", chd->pid, (int)chd->state);
-        acquire_sched_lock();
-        if (chd->state == ZOMBIE) {
-            // remove the child from children list
-            list_remove(&chd->ptnode);
-
-            // set miscellaneous item
-            *exitcode = chd->exitcode;
-            ret = chd->pid;
-
-            // free the proc struct
-            // kfree_page is done here, reason
-            // is described in exit, "2. clean up the resources"
-            kfree_page(chd->kstack);
-            kfree(chd);
-            release_sched_lock();
-            break;
-        }
-        release_sched_lock();
-    }
-    release_spinlock(&pstree_lock);
-    if (ret < 0) {
+    // 3. take the earliest zombie, clean it up and return its pid and
+    // exitcode.
+    acquire_spinlock(&p->lock);
+    if (list_empty(&p->zombies)) {
         // not found, possibly accedential wakeup.
         PANIC("no zombie found");
     }
+    struct Proc *chd = list_entry(list_pop_front(&p->zombies), struct Proc,
+                                  ptnode);
+    release_spinlock(&p->lock);
+    ASSERT(chd->parent == p);
+    ASSERT(chd->pid >= 0);
+    Log("(%d): state %d\n", chd->pid, (int)chd->state);
+    // the child holds its sched lock from before it is queued until it
+    // is switched out, so seeing ZOMBIE here means it is off its kstack.
+    ASSERT(is_zombie(chd));
+    pid_hash_remove(chd);
+
+    *exitcode = chd->exitcode;
+    int ret = chd->pid;
+
+    // free the proc struct
+    // kfree_page is done here, reason
+    // is described in exit, "2. clean up the resources"
+    kfree_page(chd->kstack);
+    // posts from the children it left behind.
+    get_all_sem(&chd->childexit);
+    // let the children that still spin in lock_parent() get through.
+    acquire_spinlock(&chd->lock);
+    release_spinlock(&chd->lock);
+    kmem_cache_free(&proc_cache, chd);
 
     // NOTE: be careful of concurrency
     return ret;
 }
 
+/** Lock the parent of p, which may change under us while p's old
+ * parent exits. The old parent may even be reaped before we get its
+ * lock, which is fine as procs are type-stable: the check below fails.
+ * @return the locked parent.
+ */
+static Proc *lock_parent(Proc *p)
+{
+    while (1) {
+        Proc *parent = __atomic_load_n(&p->parent, __ATOMIC_ACQUIRE);
+        acquire_spinlock(&parent->lock);
+        // p->parent only changes under the lock of the old parent.
+        if (p->parent == parent) {
+            return parent;
+        }
+        release_spinlock(&parent->lock);
+    }
+}
+
 NO_RETURN void exit(int code)
 {
     // TODO:
     struct Proc *p = myproc;
     // 1. set the exitcode
-    // [PITFALL] lock must be held, cause other proc
-    // may be reading p->state or p->exitcode.
-    // see test case prpr2.
-    // Want to ensure that proc woke up in wait can
-    // see at least one zombie proc.
-    acquire_spinlock(&pstree_lock);
-    // p->state = ZOMBIE;
     p->exitcode = code;
     // 2. clean up the resources
     free_pgdir(&p->pgdir);
@@ -279,47 +366,54 @@ NO_RETURN void exit(int code)
     // That will be use-after-free.
     // [PITFALL]
 
-    // 3. transfer children to the root_proc, and notify the root_proc if there is zombie
+    // 3. transfer children and zombies to the root_proc, and notify the
+    // root_proc of the zombies. Only p adds children to itself, so none
+    // comes after this. Lock order: a proc before root_proc, which is
+    // taken only if there is anything to hand over.
     int rootcnt = 0; // num post_sem
-    struct list_elem *e;
-    while (!list_empty(&p->children)) {
-        e = list_pop_front(&p->children);
-        list_push_back(&root_proc.children, e);
-        struct Proc *chd = list_entry(e, struct Proc, ptnode);
-        ASSERT(chd->state != UNUSED);
-        acquire_sched_lock();
-        chd->parent = &root_proc;
-        // if there is zombei proc, wakeup root proc.
-        if (chd->state == ZOMBIE) {
-            ++rootcnt;
+    if (p != &root_proc) {
+        acquire_spinlock(&p->lock);
+        if (!list_empty(&p->children) || !list_empty(&p->zombies)) {
+            acquire_spinlock(&root_proc.lock);
+            while (!list_empty(&p->children)) {
+                struct list_elem *e = list_pop_front(&p->children);
+                struct Proc *chd = list_entry(e, struct Proc, ptnode);
+                ASSERT(chd->state != UNUSED);
+                __atomic_store_n(&chd->parent, &root_proc, __ATOMIC_RELEASE);
+                list_push_back(&root_proc.children, e);
+            }
+            while (!list_empty(&p->zombies)) {
+                struct list_elem *e = list_pop_front(&p->zombies);
+                struct Proc *chd = list_entry(e, struct Proc, ptnode);
+                chd->parent = &root_proc;
+                list_push_back(&root_proc.zombies, e);
+                ++rootcnt;
+            }
+            release_spinlock(&root_proc.lock);
         }
-        release_sched_lock();
+        release_spinlock(&p->lock);
+    }
+    for (int i = 0; i < rootcnt; i++) {
+        post_sem(&root_proc.childexit);
     }
 
-    // 3.1 wakeup its parent
+    // 3.1 queue p as a zombie of its parent, and wake it up.
     // This is not described in the comment[PITFALL]
-    struct Proc *parent = p->parent;
+    struct Proc *parent = lock_parent(p);
     if (p != parent) {
+        list_remove(&p->ptnode);
+        list_push_back(&parent->zombies, &p->ptnode);
         post_sem(&parent->childexit);
     }
 
-    // notify the root process of added children.
-    for (int i = 0; i < rootcnt; i++) {
-        if (p != &root_proc)
-            post_sem(&root_proc.childexit);
-    }
-
     // 4. sched(ZOMBIE)
     acquire_sched_lock();
-    // we have notified its parent and/or root proc that one of the child
-    // is ready. but BEFORE we set its state to zombie, the parent/root
-    // proc should NOT read its state. this is done by preempting the
-    // sched lock and then release the pstree_lock.
-
-    // release pstree lock allows parent/root to scan its children,
-    // but they will have to acquire the sched lock, at which time
-    // they can see the zombie state of thisproc().
-    release_spinlock(&pstree_lock);
+    // we have notified its parent that one of the child is ready. but
+    // BEFORE we set its state to zombie, the parent should NOT free it.
+    // this is done by preempting the sched lock and then release the
+    // parent's lock: wait() checks the state under the sched lock, at
+    // which time it can see the zombie state of thisproc().
+    release_spinlock(&parent->lock);
     sched(ZOMBIE);
     // will not reach
     // NOTE: be careful of concurrency
@@ -327,55 +421,72 @@ NO_RETURN void exit(int code)
     PANIC(); // prevent the warning of 'no_return function returns'
 }
 
-static Proc *find_proc_from(int pid, Proc *parent)
+int kill(int pid)
 {
-    ASSERT(parent != NULL);
-    if (parent->pid == pid && !is_unused(parent)) {
-        return parent;
-    }
-
-    if (list_empty(&parent->children)) {
-        return NULL;
-    }
-
+    // TODO:
+    // Set the killed flag of the proc to true and return 0.
+    // Return -1 if the pid is invalid (proc not found).
+    struct pid_bucket *b = pid_bucket_of(pid);
+    int ret = -1;
+    acquire_spinlock(&b->lock);
+    // the bucket lock keeps the proc from being freed by wait().
     struct list_elem *e;
-    struct Proc *p;
-    struct Proc *ret;
-    for (e = list_begin(&parent->children); e != list_end(&parent->children);
+    for (e = list_begin(&b->procs); e != list_end(&b->procs);
          e = list_next(e)) {
-        p = list_entry(e, struct Proc, ptnode);
-        ret = find_proc_from(pid, p);
-        if (ret != NULL) {
-            return ret;
+        Proc *p = list_entry(e, Proc, pidnode);
+        if (p->pid == pid) {
+            p->killed = 1;
+            // by doc, kill should use alert proc.
+            // ignore return value.
+            bool r __attribute__((unused));
+            r = alert_proc(p);
+            ret = 0;
+            break;
         }
     }
-    return NULL;
-}
-
-/** Find the proc with pid. Must hold pstree_lock.
- * @return NULL if not found.
- */
-static Proc *find_proc(int pid)
-{
-    return find_proc_from(pid, &root_proc);
+    release_spinlock(&b->lock);
+    return ret;
 }
 
-int kill(int pid)
+int acct_procs(struct acct_proc *buf, int n)
 {
-    // TODO:
-    // Set the killed flag of the proc to true and return 0.
-    // Return -1 if the pid is invalid (proc not found).
-    acquire_spinlock(&pstree_lock);
-    Proc *p = find_proc(pid);
-    release_spinlock(&pstree_lock);
-
-    if (p != NULL) {
-        p->killed = 1;
-        // by doc, kill should use alert proc.
-        // ignore return value.
-        bool ret __attribute__((unused));
-        ret = alert_proc(p);
-        return 0;
+    const u64 now = get_timestamp();
+    int cnt = 0;
+    for (int i = 0; i < PID_HASH_SIZE; i++) {
+        struct pid_bucket *b = &pid_hash[i];
+        acquire_spinlock(&b->lock);
+        struct list_elem *e;
+        for (e = list_begin(&b->procs); e != list_end(&b->procs);
+             e = list_next(e), cnt++) {
+            if (cnt >= n) {
+                continue;
+            }
+            // racy, which is fine for statistics. the bucket lock
+            // keeps p from being freed.
+            Proc *p = list_entry(e, Proc, pidnode);
+            struct acct_proc *a = &buf[cnt];
+            const enum procstate state = p->state;
+            u64 run = p->acct.run, wait = p->acct.wait;
+            // add the time not charged yet.
+            if (state == RUNNING) {
+                run += now - MIN(now, p->schinfo.exec_start);
+            } else if (state == RUNNABLE) {
+                wait += now - MIN(now, p->schinfo.ready_since);
+            }
+            a->pid = p->pid;
+            a->ppid = p->parent == NULL ? -1 : p->parent->pid;
+            a->state = (int)state;
+            a->nice = p->schinfo.nice;
+            a->cpu = p->schinfo.cpu;
+            a->run_us = ticks_to_us(run);
+            a->wait_us = ticks_to_us(wait);
+            a->nvcsw = p->acct.nvcsw;
+            a->nivcsw = p->acct.nivcsw;
+            a->nfault = p->acct.nfault;
+            a->rbytes = p->acct.rbytes;
+            a->wbytes = p->acct.wbytes;
+        }
+        release_spinlock(&b->lock);
     }
-    return -1;
-}
\ No newline at end of file
+    return cnt;
+}
@@ -10,6 +10,7 @@
 #include <fdutil/stddef.h>
 #include <fdutil/lst.h>
 #include <kernel/pt.h>
+#include <kernel/acct.h>
 #include <fs/defines.h>
 #include <fs/file1206.h>
 
@@ -79,23 +80,17 @@ typedef struct KernelContext {
 } KernelContext;
 
 // embeded data for procs
-#ifndef RCC
-struct schinfo {
-    // TODO: customize your sched info
-};
-#else
 /** Scheduler information */
 struct schinfo {
-    uint32_t coreid; /** cpu it is currently running */
-    uint32_t bitmap; /** record scheduled cpu id */
+    int cpu; // owner of the proc: the cpu it last ran on, or will run on
+    int nice; // -20(highest) ~ 19(lowest)
+    u32 weight; // derived from nice
+    u64 vruntime; // weighted run time, in timer ticks
+    u64 exec_start; // timestamp when it last got the cpu
+    u64 ready_since; // timestamp when it last became runnable
+    struct rb_node_ rbnode; // in the tree of the run queue
 };
 
-/** Update scheduler information, which is done in sched().
- * @return the next cpu to run.
- */
-int update_schinfo(struct schinfo *sch);
-#endif
-
 typedef struct Proc {
     // must held lock when accessing these
     int killed;
@@ -103,14 +98,17 @@ typedef struct Proc {
     int pid;
     int exitcode;
     struct Proc *parent;
-    struct list children;
-    struct list_elem ptnode; // put on parent's children list.
-    struct list_elem schq; // put on scheduler queue
+    SpinLock lock; // protects children and zombies
+    struct list children; // children that have not exited
+    struct list zombies; // exited children, in the order they exited
+    struct list_elem ptnode; // put on parent's children or zombies list.
+    struct list_elem pidnode; // in the pid hash
     // void *chan;
 
     enum procstate state;
     Semaphore childexit;
     struct schinfo schinfo;
+    struct proc_acct acct;
     struct pgdir pgdir;
     void *kstack;
     KernelContext kcontext;
@@ -122,7 +120,10 @@ typedef struct Proc {
 void init_kproc();
 void init_kproc_test();
 void init_proc(Proc *);
+/** @return a new proc, or NULL if out of memory. */
 WARN_RESULT Proc *create_proc();
+/** Free a proc from create_proc() that was never started. */
+void destroy_proc(Proc *p);
 int start_proc(Proc *, void (*entry)(u64), u64 arg);
 NO_RETURN void exit(int code);
 WARN_RESULT int wait(int *exitcode);
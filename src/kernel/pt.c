@@ -1,18 +1,19 @@
 #include <kernel/pt.h>
 #include <kernel/mem.h>
+#include <kernel/slab.h>
 #include <common/string.h>
 #include <aarch64/intrinsic.h>
 #include <aarch64/mmu.h>
 #include <kernel/exec1207.h>
 #include <fs/file1206.h>
 #include <kernel/mmap1217.h>
+#include <kernel/asid.h>
 
 /** Returns a page filled with 0 */
 static inline void *pte_page(void)
 {
-    void *ret = kalloc_page();
+    void *ret = kalloc_page_zeroed();
     ASSERT(ret != NULL);
-    memset(ret, 0, PAGE_SIZE);
     return ret;
 }
 
@@ -50,7 +51,17 @@ static inline u64 pte_idx_lv3(u64 va)
     return ret;
 }
 
-static PTEntry *pte_walk(PTEntry *table, u64 va, int lv, bool alloc)
+/** Returns the kernel address of the table a table entry points to */
+static inline PTEntry *pte_table(PTEntry entr)
+{
+    return (PTEntry *)P2K(PTE_ADDRESS(entr));
+}
+
+/** Walk from the table at level lv down to the entry of va at level
+ * target, allocating missing tables if alloc.
+ */
+static PTEntry *pte_walk(PTEntry *table, u64 va, int lv, int target,
+                         bool alloc)
 {
     typedef u64 (*idx_fn)(u64);
     static idx_fn indices[4] = {
@@ -66,10 +77,10 @@ static PTEntry *pte_walk(PTEntry *table, u64 va, int lv, bool alloc)
     ASSERT(((u64)table & 0xfff) == 0);
     const u64 index = indices[lv](va);
 
-    if (lv == 3) {
+    if (lv == target) {
         return &table[index];
     }
-    PTEntry *next = (PTEntry *)(P2K(table[index]) & (~PTE_TABLE));
+    PTEntry *next = pte_table(table[index]);
     if (table[index] == 0x0) {
         if (alloc) {
             next = pte_page();
@@ -78,7 +89,90 @@ static PTEntry *pte_walk(PTEntry *table, u64 va, int lv, bool alloc)
             return NULL;
         }
     }
-    return pte_walk(next, va, lv + 1, alloc);
+    return pte_walk(next, va, lv + 1, target, alloc);
+}
+
+/** Returns the level 2 entry of va, which points to a last-level table */
+static PTEntry *get_pde(struct pgdir *pgdir, u64 va, bool alloc)
+{
+    if (pgdir->pt == NULL) {
+        if (alloc) {
+            pgdir->pt = pte_page();
+        } else {
+            return NULL;
+        }
+    }
+    return pte_walk(pgdir->pt, va, 0, 2, alloc);
+}
+
+/** Drop the pages mapped by a last-level table, and the table. */
+static void pte_put_table(PTEntry *table)
+{
+    for (int i = 0; i < N_PTE_PER_TABLE; i++) {
+        if (table[i] & PTE_VALID) {
+            kfree_page(pte_table(table[i]));
+        }
+    }
+    kfree_page(table);
+}
+
+/** Give pgdir a private copy of the last-level table at pde, which
+ * fork() shared. The pages it maps become copy-on-write.
+ */
+static void pte_unshare(struct pgdir *pgdir, PTEntry *pde)
+{
+    PTEntry *old = pte_table(*pde);
+    if (kpage_exclusive(old)) {
+        // the other sharers are gone, take it back.
+        *pde &= ~PTE_TABLE_RO;
+        flush_tlb_pgdir(pgdir);
+        return;
+    }
+
+    PTEntry *new = pte_page();
+    for (int i = 0; i < N_PTE_PER_TABLE; i++) {
+        if ((old[i] & PTE_VALID) == 0) {
+            continue;
+        }
+        void *pg = pte_table(old[i]);
+        void *dup = kshare_page(pg);
+        ASSERT(dup != NULL);
+        if (dup == pg) {
+            // all sharers see old read-only through their level 2
+            // entry, so it can be changed under them.
+            old[i] |= PTE_RO;
+            new[i] = old[i];
+        } else {
+            new[i] = K2P(dup) | PTE_FLAGS(old[i]);
+        }
+    }
+
+    // break before make: the old entry may be cached.
+    *pde = 0;
+    flush_tlb_pgdir(pgdir);
+    *pde = K2P(new) | PTE_TABLE;
+    if (!kunshare_page(old)) {
+        // the other sharers left meanwhile.
+        pte_put_table(old);
+    }
+}
+
+static PTEntry *pte_lookup(struct pgdir *pgdir, u64 va, bool alloc,
+                           bool mut)
+{
+    PTEntry *pde = get_pde(pgdir, va, alloc);
+    if (pde == NULL) {
+        return NULL;
+    }
+    if (*pde == 0) {
+        if (!alloc) {
+            return NULL;
+        }
+        *pde = K2P(pte_page()) | PTE_TABLE;
+    } else if (mut && (*pde & PTE_TABLE_RO)) {
+        pte_unshare(pgdir, pde);
+    }
+    return &pte_table(*pde)[pte_idx_lv3(va)];
 }
 
 PTEntriesPtr get_pte(struct pgdir *pgdir, u64 va, bool alloc)
@@ -93,15 +187,8 @@ PTEntriesPtr get_pte(struct pgdir *pgdir, u64 va, bool alloc)
     // do the following: allocate page for this level,
     // and compute the index to the next level.
 
-    // at level 0, bit [47:39]
-    if (pgdir->pt == NULL) {
-        if (alloc) {
-            pgdir->pt = pte_page();
-        } else {
-            return NULL;
-        }
-    }
-    return pte_walk(pgdir->pt, va, 0, alloc);
+    // an entry asked to be allocated is going to be changed.
+    return pte_lookup(pgdir, va, alloc, alloc);
 #ifdef DISCARDED
     const u64 lv0 = pte_idx_lv0(va);
     PTEntry *ptlv0 = (PTEntry *)(pgdir->pt[lv0] & (~PTE_TABLE));
@@ -151,9 +238,60 @@ PTEntriesPtr get_pte(struct pgdir *pgdir, u64 va, bool alloc)
 #endif
 }
 
+PTEntriesPtr get_pte_mut(struct pgdir *pgdir, u64 va)
+{
+    ASSERT(pgdir != NULL);
+    return pte_lookup(pgdir, va, false, true);
+}
+
+typedef void (*pde_fn)(struct pgdir *, PTEntry *pde, u64 va, void *arg);
+
+/** Call fn on each level 2 entry of pgdir that points to a table. */
+static void pgdir_for_each_pde(struct pgdir *pgdir, pde_fn fn, void *arg)
+{
+    PTEntry *pt = pgdir->pt;
+    if (pt == NULL) {
+        return;
+    }
+    for (u64 i = 0; i < N_PTE_PER_TABLE; i++) {
+        if (pt[i] == 0) {
+            continue;
+        }
+        PTEntry *pt1 = pte_table(pt[i]);
+        for (u64 j = 0; j < N_PTE_PER_TABLE; j++) {
+            if (pt1[j] == 0) {
+                continue;
+            }
+            PTEntry *pt2 = pte_table(pt1[j]);
+            for (u64 k = 0; k < N_PTE_PER_TABLE; k++) {
+                if (pt2[k] != 0) {
+                    fn(pgdir, &pt2[k], (i << 39) | (j << 30) | (k << 21),
+                       arg);
+                }
+            }
+        }
+    }
+}
+
+/** Let go of a last-level table shared by fork(), or take it back if
+ * nobody else uses it. */
+static void pde_drop_shared(struct pgdir *pgdir, PTEntry *pde, u64 va,
+                            void *arg)
+{
+    if ((*pde & PTE_TABLE_RO) == 0) {
+        return;
+    }
+    if (kunshare_page(pte_table(*pde))) {
+        *pde = 0;
+    } else {
+        *pde &= ~PTE_TABLE_RO;
+    }
+}
+
 void init_pgdir(struct pgdir *pgdir)
 {
     pgdir->pt = NULL;
+    pgdir->asid = 0;
     // empty sections
     list_init(&pgdir->sections);
 }
@@ -179,7 +317,7 @@ static void pgdir_free_lv(PTEntry *pte, int lv)
         // and then the page itself.
         for (int i = 0; i < N_PTE_PER_TABLE; i++) {
             if (pte[i] != 0x0) {
-                pgdir_free_lv((PTEntry *)(P2K(pte[i]) & (~PTE_TABLE)), lv + 1);
+                pgdir_free_lv(pte_table(pte[i]), lv + 1);
             }
         }
         kfree_page(pte);
@@ -195,6 +333,11 @@ void free_pgdir(struct pgdir *pgdir)
         return;
     }
 
+    // tables shared with other pgdirs are theirs now, so that exit
+    // after fork does not touch the pages.
+    pgdir_for_each_pde(pgdir, pde_drop_shared, NULL);
+    flush_tlb_pgdir(pgdir);
+
     // free the sections.
     struct list_elem *elem;
     while (!list_empty(&pgdir->sections)) {
@@ -205,10 +348,11 @@ void free_pgdir(struct pgdir *pgdir)
         // FIXME: for writable files,
         // the content may have to be written back.
         section_unmap(pgdir, sec);
-        kfree(sec);
+        free_section(sec);
     }
 
     // recursively free all pages used by page table
+    asid_release(pgdir);
     pgdir_free_lv(pgdir->pt, 0);
     pgdir->heap = NULL;
     pgdir->pt = NULL;
@@ -216,11 +360,7 @@ void free_pgdir(struct pgdir *pgdir)
 
 void attach_pgdir(struct pgdir *pgdir)
 {
-    extern PTEntries invalid_pt;
-    if (pgdir->pt)
-        arch_set_ttbr0(K2P(pgdir->pt));
-    else
-        arch_set_ttbr0(K2P(&invalid_pt));
+    switch_pgdir(pgdir);
 }
 
 static bool sec_less_func(const struct list_elem *a, const struct list_elem *b,
@@ -233,6 +373,30 @@ static bool sec_less_func(const struct list_elem *a, const struct list_elem *b,
     return sa->start < sb->start;
 }
 
+static KmemCache section_cache =
+    KMEM_CACHE_INIT("section", struct section, NULL);
+
+struct section *alloc_section(void)
+{
+    struct section *sec = kmem_cache_alloc(&section_cache);
+    if (sec != NULL) {
+        sec->start = 0;
+        sec->fobj = NULL;
+        sec->offset = 0;
+        sec->fsize = 0;
+        sec->npages = 0;
+        sec->flags = 0;
+        sec->window = FAULT_AROUND_PAGES;
+        sec->ra_next = 0;
+    }
+    return sec;
+}
+
+void free_section(struct section *sec)
+{
+    kmem_cache_free(&section_cache, sec);
+}
+
 void pgdir_add_section(struct pgdir *pgdir, struct section *sec)
 {
     ASSERT(sec != NULL);
@@ -294,6 +458,61 @@ static void page_copy(struct pgdir *dst, struct pgdir *src, u64 va, int flags)
     }
 }
 
+/** Whether fork() may share the last-level table at va: it must not map
+ * pages of a shared mapping, whose writes have to stay visible.
+ */
+static bool pte_shareable(struct pgdir *pgdir, u64 va)
+{
+    const u64 end = va + N_PTE_PER_TABLE * PAGE_SIZE;
+    struct list_elem *elem;
+    for (elem = list_begin(&pgdir->sections);
+         elem != list_end(&pgdir->sections); elem = list_next(elem)) {
+        struct section *sec = list_entry(elem, struct section, node);
+        if ((sec->flags & PF_S) && sec->start < end &&
+            sec->start + sec->npages * PAGE_SIZE > va) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/** Clone the last-level table of src at spde into dst. */
+static void pde_clone(struct pgdir *src, PTEntry *spde, u64 va, void *arg)
+{
+    struct pgdir *dst = arg;
+    if (pte_shareable(src, va)) {
+        PTEntry *table = pte_table(*spde);
+        void *dup = kshare_page(table);
+        if (dup == table) {
+            // both see it read-only until one of them writes.
+            *spde |= PTE_TABLE_RO;
+            PTEntry *dpde = get_pde(dst, va, true);
+            ASSERT(*dpde == 0);
+            *dpde = *spde;
+            return;
+        }
+        // no room to count another reference.
+        if (dup != NULL) {
+            kfree_page(dup);
+        }
+    }
+
+    // copy it page by page.
+    if (*spde & PTE_TABLE_RO) {
+        pte_unshare(src, spde);
+    }
+    PTEntry *table = pte_table(*spde);
+    for (int i = 0; i < N_PTE_PER_TABLE; i++) {
+        if (table[i] & PTE_VALID) {
+            const u64 pva = va + i * PAGE_SIZE;
+            struct section *sec = section_search(src, pva);
+            if (sec != NULL) {
+                page_copy(dst, src, pva, sec->flags);
+            }
+        }
+    }
+}
+
 void pgdir_clone(struct pgdir *dst, struct pgdir *src)
 {
     ASSERT(dst != NULL && src != NULL);
@@ -304,13 +523,16 @@ void pgdir_clone(struct pgdir *dst, struct pgdir *src)
         for (; elem != list_end(l); elem = list_next(elem)) {
             struct section *s = list_entry(elem, struct section, node);
             // make a clone of the node.
-            struct section *sec = kalloc(sizeof(struct section));
+            struct section *sec = alloc_section();
+            ASSERT(sec != NULL);
             sec->flags = s->flags;
             sec->npages = s->npages;
             sec->start = s->start;
+            sec->window = s->window;
             if (s->flags & PF_F) {
                 sec->fobj = fshare(s->fobj);
                 sec->offset = s->offset;
+                sec->fsize = s->fsize;
             } else {
                 sec->fobj = NULL;
             }
@@ -320,13 +542,14 @@ void pgdir_clone(struct pgdir *dst, struct pgdir *src)
                 dst->heap = sec;
             }
 
-            // for each of the page, make a clone
-            for (u32 i = 0; i < s->npages; i++) {
-                page_copy(dst, src, s->start + PAGE_SIZE * i, s->flags);
-            }
-
             // add to the list of dst
             list_push_back(&dst->sections, &sec->node);
         }
     }
+
+    // share the last-level tables, or copy their pages one by one.
+    // either way, the cost is per table rather than per page.
+    pgdir_for_each_pde(src, pde_clone, dst);
+    // pages of src may be read-only now.
+    flush_tlb_pgdir(src);
 }
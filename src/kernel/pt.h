@@ -9,28 +9,54 @@ struct section {
     struct list_elem node;
     File *fobj; // file backend
     isize offset; // file offset
+    u64 fsize; // bytes from offset backed by the file, zero after them
     u32 npages; // number of pages
     u32 flags; // flags(r,w,x)
+    u32 window; // pages mapped around a fault, see section_fault_around()
+    u64 ra_next; // the next fault is sequential if it is here
 };
 
+/** Default window of a section */
+#define FAULT_AROUND_PAGES 16
+/** Largest window of a section */
+#define FAULT_AROUND_MAX 64
+
 struct pgdir {
     PTEntriesPtr pt;
     // sections, ascending order wrt. start vaddr
     struct list sections;
     struct section *heap;
+    u64 asid; // generation | ASID, 0 if none, see kernel/asid.h
 };
 
 void init_pgdir(struct pgdir *pgdir);
+/** Returns the entry of va. With alloc, missing tables are allocated,
+ * and the entry may be changed: a last-level table shared by fork() is
+ * copied first. Without alloc, the entry is only for reading.
+ * @return NULL if va has no last-level table and !alloc.
+ */
 WARN_RESULT PTEntriesPtr get_pte(struct pgdir *pgdir, u64 va, bool alloc);
+/** Like get_pte(pgdir, va, false), but the entry may be changed. */
+WARN_RESULT PTEntriesPtr get_pte_mut(struct pgdir *pgdir, u64 va);
 void free_pgdir(struct pgdir *pgdir);
 void attach_pgdir(struct pgdir *pgdir);
 
+/** Allocate a section with no pages, no flags and no file backend.
+ * @return NULL if out of memory.
+ */
+WARN_RESULT struct section *alloc_section(void);
+void free_section(struct section *sec);
+
 /** Add a section to pgdir. 
- * @param sec a section element allocated by kalloc().
+ * @param sec a section element allocated by alloc_section().
  */
 void pgdir_add_section(struct pgdir *pgdir, struct section *sec);
 
 /** Create a clone of pgdir. Used by fork(). 
+ * Last-level tables are shared read-only by both, through PTE_TABLE_RO
+ * of their level 2 entries. The first write under a shared table copies
+ * it, and makes the pages it maps copy-on-write. Tables that map pages
+ * of a shared mapping are copied page by page instead.
  * @param dst a initialized page dir.
  * @param src the pgdir from which to make a copy
  */
@@ -0,0 +1,215 @@
+#include <kernel/reclaim.h>
+#include <kernel/mem.h>
+#include <kernel/slab.h>
+#include <kernel/proc.h>
+#include <kernel/printk.h>
+#include <common/sem.h>
+#include <common/spinlock.h>
+#include <fdutil/palloc.h>
+#include <fdutil/malloc.h>
+
+/** Watermarks as fractions of all pages */
+#define WMARK_LOW_DIV 64
+#define WMARK_HIGH_DIV 32
+/** Pages the reclaim thread asks for at a time */
+#define RECLAIM_BATCH 64
+/** Batches the reclaim thread asks for per wakeup at most */
+#define RECLAIM_MAX_PASS 32
+
+/** Serializes reclaim, protects the shrinkers and statistics */
+static SpinLock reclaim_lock;
+static struct shrinker *shrinkers;
+static struct reclaim_stat stat;
+
+/** The reclaim thread sleeps on it */
+static Semaphore kick;
+/** Whether the reclaim thread has been kicked and not finished */
+static volatile bool kicked;
+static bool started;
+
+/*-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *                          Built-in shrinkers
+ -+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+*/
+// Note: per-cpu caches can only be drained by their own cpu,
+// so these only drain the cpu running reclaim.
+
+// spare slabs of the object caches(inodes, procs, files...)
+static usize slab_scan(usize nr __attribute__((unused)))
+{
+    return kmem_cache_shrink_all();
+}
+
+// pages zeroed in advance by the idle loop.
+static usize zpool_scan(usize nr __attribute__((unused)))
+{
+    return drain_zeroed_pages();
+}
+
+// empty arenas kept alive by blocks in the per-cpu malloc caches.
+static usize malloc_scan(usize nr __attribute__((unused)))
+{
+    usize before = palloc_used();
+    malloc_drain();
+    usize after = palloc_used();
+    return before > after ? before - after : 0;
+}
+
+// pages free in multi-page blocks of the buddy lists.
+static usize palloc_nfree_mult()
+{
+    size_t nfree[PALLOC_NORDER];
+    palloc_buddystat(nfree);
+    usize ret = 0;
+    for (int i = 1; i < PALLOC_NORDER; i++) {
+        ret += nfree[i] << i;
+    }
+    return ret;
+}
+
+// free pages in the per-cpu magazine cannot serve other cpus or
+// multi-page blocks, give them back to the buddy lists. They are
+// already free, so only the pages merged into multi-page blocks count.
+static usize palloc_scan(usize nr __attribute__((unused)))
+{
+    usize before = palloc_nfree_mult();
+    palloc_drain();
+    usize after = palloc_nfree_mult();
+    return after > before ? after - before : 0;
+}
+
+static struct shrinker slab_shrinker = { .name = "slab", .scan = slab_scan };
+static struct shrinker zpool_shrinker = { .name = "zpool", .scan = zpool_scan };
+static struct shrinker malloc_shrinker = { .name = "malloc",
+                                           .scan = malloc_scan };
+static struct shrinker palloc_shrinker = { .name = "palloc",
+                                           .scan = palloc_scan };
+
+void init_reclaim()
+{
+    init_spinlock(&reclaim_lock);
+    init_sem(&kick, 0);
+    kicked = false;
+    started = false;
+    shrinkers = NULL;
+
+    usize npage = palloc_npage();
+    stat.low = npage / WMARK_LOW_DIV;
+    stat.high = npage / WMARK_HIGH_DIV;
+
+    // cheapest first: pages that are simply cached.
+    register_shrinker(&palloc_shrinker);
+    register_shrinker(&slab_shrinker);
+    register_shrinker(&malloc_shrinker);
+    register_shrinker(&zpool_shrinker);
+}
+
+void register_shrinker(struct shrinker *s)
+{
+    ASSERT(s != NULL && s->scan != NULL);
+    acquire_spinlock(&reclaim_lock);
+    s->ncall = s->nfreed = 0;
+    // keep the order of registration.
+    struct shrinker **it = &shrinkers;
+    while (*it != NULL) {
+        it = &(*it)->next;
+    }
+    s->next = NULL;
+    *it = s;
+    release_spinlock(&reclaim_lock);
+}
+
+/** Must hold reclaim_lock. */
+static usize _reclaim_pages(usize nr)
+{
+    usize ret = 0;
+    for (struct shrinker *s = shrinkers; s != NULL && ret < nr; s = s->next) {
+        usize n = s->scan(nr - ret);
+        s->ncall++;
+        s->nfreed += n;
+        ret += n;
+    }
+    return ret;
+}
+
+usize reclaim_pages(usize nr)
+{
+    acquire_spinlock(&reclaim_lock);
+    usize ret = _reclaim_pages(nr);
+    stat.ndirect++;
+    if (ret == 0) {
+        stat.nfail++;
+    }
+    release_spinlock(&reclaim_lock);
+    return ret;
+}
+
+bool mem_pressure()
+{
+    return palloc_nfree() < stat.high;
+}
+
+void reclaim_check()
+{
+    if (!started || palloc_nfree() >= stat.low) {
+        return;
+    }
+    // wake up the reclaim thread once per episode.
+    if (!__atomic_exchange_n(&kicked, true, __ATOMIC_ACQ_REL)) {
+        post_sem(&kick);
+    }
+}
+
+static void reclaimd(u64 arg __attribute__((unused)))
+{
+    while (1) {
+        unalertable_wait_sem(&kick);
+        acquire_spinlock(&reclaim_lock);
+        stat.nwakeup++;
+        // the shrinkers measure global deltas that other cpus blur, so
+        // stop as soon as a pass does not raise the free count.
+        usize nfree = palloc_nfree();
+        for (int i = 0; i < RECLAIM_MAX_PASS && nfree < stat.high; i++) {
+            if (_reclaim_pages(RECLAIM_BATCH) == 0) {
+                // nothing more to reclaim.
+                break;
+            }
+            usize now = palloc_nfree();
+            if (now <= nfree) {
+                break;
+            }
+            nfree = now;
+        }
+        release_spinlock(&reclaim_lock);
+        __atomic_store_n(&kicked, false, __ATOMIC_RELEASE);
+    }
+}
+
+void start_reclaimd()
+{
+    Proc *p = create_proc();
+    ASSERT(p != NULL);
+    start_proc(p, reclaimd, 0);
+    started = true;
+}
+
+void reclaim_stat(struct reclaim_stat *st)
+{
+    ASSERT(st != NULL);
+    acquire_spinlock(&reclaim_lock);
+    *st = stat;
+    release_spinlock(&reclaim_lock);
+}
+
+void reclaim_dump()
+{
+    acquire_spinlock(&reclaim_lock);
+    printk("reclaim: low %lld, high %lld, free %lld, wakeups %lld, "
+           "direct %lld, failed %lld\n",
+           (i64)stat.low, (i64)stat.high, (i64)palloc_nfree(),
+           (i64)stat.nwakeup, (i64)stat.ndirect, (i64)stat.nfail);
+    for (struct shrinker *s = shrinkers; s != NULL; s = s->next) {
+        printk("  %s: %lld calls, %lld pages\n", s->name, (i64)s->ncall,
+               (i64)s->nfreed);
+    }
+    release_spinlock(&reclaim_lock);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <common/defines.h>
+
+/**
+ * Memory reclaim.
+ *
+ * Caches register shrinkers, which give memory back to the page
+ * allocator. When free pages drop below the low watermark, the
+ * reclaim thread is woken up and calls the shrinkers until free pages
+ * reach the high watermark. kalloc_page() also reclaims directly
+ * before it fails.
+ */
+
+struct shrinker {
+    const char *name;
+    /** Try to free about nr pages.
+     * @return number of pages freed.
+     */
+    usize (*scan)(usize nr);
+
+    /**< Statistics, updated by reclaim */
+    usize ncall; // times scan() is called
+    usize nfreed; // pages freed by scan()
+    struct shrinker *next;
+};
+
+/** Register the built-in shrinkers and the watermarks. Call after kinit. */
+void init_reclaim();
+
+/** Start the background reclaim thread. */
+void start_reclaimd();
+
+void register_shrinker(struct shrinker *s);
+
+/** Call the shrinkers until nr pages are freed or none makes progress.
+ * @return number of pages freed.
+ */
+usize reclaim_pages(usize nr);
+
+/** Called on allocation: wake up the reclaim thread if free pages
+ * are below the low watermark.
+ */
+void reclaim_check();
+
+/** Returns true if free pages are below the high watermark. */
+bool mem_pressure();
+
+struct reclaim_stat {
+    usize low, high; // watermarks, in pages
+    usize nwakeup; // times the reclaim thread is woken up
+    usize ndirect; // direct reclaims by kalloc_page
+    usize nfail; // direct reclaims that freed nothing
+};
+
+void reclaim_stat(struct reclaim_stat *st);
+
+/** Print the statistics of reclaim and each shrinker. */
+void reclaim_dump();
@@ -6,28 +6,42 @@
 #include <kernel/cpu.h>
 #include <fdutil/lst.h>
 #include <common/rbtree.h>
+#include <driver/interrupt.h>
 
-/** Scheduler lock guards the sched queue and the state
- * of each process. Read/write to proc stat must hold
- * the lock. */
-static SpinLock sched_lock;
+/** Each cpu has a run queue with its own lock, see kernel/config.h.
+ * The lock of a run queue guards the queue and the state of each
+ * process it owns, i.e. whose schinfo.cpu is the cpu. Read/write
+ * to proc state must hold the lock. "The sched lock" of a cpu is
+ * the lock of its run queue. */
+#define rq_of(cpu) (&cpus[(cpu)].sched)
+
+/** Weight of each nice value, from -20 to 19. Each level is about
+ * 1.25x of the next, so one nice level is about 10% of the cpu. */
+static const u32 nice_to_weight[NICE_MAX - NICE_MIN + 1] = {
+    /* -20 */ 88761, 71755, 56483, 46273, 36291,
+    /* -15 */ 29154, 23254, 18705, 14949, 11916,
+    /* -10 */ 9548,  7620,  6100,  4904,  3906,
+    /*  -5 */ 3121,  2501,  1991,  1586,  1277,
+    /*   0 */ 1024,  820,   655,   526,   423,
+    /*   5 */ 335,   272,   215,   172,   137,
+    /*  10 */ 110,   87,    70,    56,    45,
+    /*  15 */ 36,    29,    23,    18,    15,
+};
 
 /** Scheduler timer for each core. */
 static struct timer sched_timer[NCPU];
 
-static void sched_handler(struct timer *timer)
+static void sched_handler(struct timer *timer __attribute__((unused)))
 {
-    timer->triggered = false;
     yield();
 }
 
-#ifndef RCC
-/** Scheduler queue */
-static struct list queue;
-#else
-/** Scheduler queues for all cores */
-static struct list queue[NCPU];
-#endif
+/** The interrupt itself is all it needs: interrupt_global_handler
+ * yields afterwards, so an idle cpu looks at its run queue, and a
+ * busy cpu lets the woken proc compete and restarts its tick. */
+static void resched_handler()
+{
+}
 
 extern bool panic_flag;
 
@@ -37,14 +51,19 @@ void init_sched()
 {
     // TODO: initialize the scheduler
     // 1. initialize the resources (e.g. locks, semaphores)
-    init_spinlock(&sched_lock);
-#ifndef RCC
-    list_init(&queue);
-#else
     for (int i = 0; i < NCPU; i++) {
-        list_init(&queue[i]);
+        struct sched *rq = rq_of(i);
+        init_spinlock(&rq->lock);
+        rq->tree.rb_node = NULL;
+        rq->nrun = 0;
+        rq->load = 0;
+        rq->min_vruntime = 0;
+        rq->nswitch = rq->nsteal = rq->nstolen = 0;
+        rq->nkick = 0;
+        rq->busy = rq->idle = 0;
+        rq->tick_on = false;
     }
-#endif
+    set_interrupt_handler(RESCHED_IRQ, resched_handler);
 
     // 2. initialize the scheduler info of each CPU
     for (int i = 0; i < NCPU; i++) {
@@ -57,11 +76,15 @@ void init_sched()
         idleproc[i].idle = 1;
         idleproc[i].state = RUNNING;
         idleproc[i].kstack = NULL;
+        idleproc[i].schinfo.cpu = i;
+        idleproc[i].schinfo.nice = 0;
+        idleproc[i].schinfo.weight = NICE_0_WEIGHT;
+        init_spinlock(&idleproc[i].lock);
         list_init(&idleproc[i].children);
+        list_init(&idleproc[i].zombies);
         init_sem(&idleproc[i].childexit, 0);
 
         sched_timer[i].triggered = false;
-        sched_timer[i].elapse = 10;
         sched_timer[i].handler = sched_handler;
     }
 }
@@ -76,110 +99,224 @@ Proc *thisproc()
     return cpu->proc != NULL ? cpu->proc : cpu->idle;
 }
 
+static INLINE int rq_len(int cpu)
+{
+    return __atomic_load_n(&rq_of(cpu)->nrun, __ATOMIC_RELAXED);
+}
+
 void init_schinfo(struct schinfo *p)
 {
     // TODO: initialize your customized schinfo for every newly-created process
-    // Note to TA: since the initialization of schinfo relies
-    // on the proc's id, it is done in proc.c
+    // start on the shortest queue, stealing evens out the rest.
+    int best = 0;
+    for (int i = 1; i < NCPU; i++) {
+        if (rq_len(i) < rq_len(best)) {
+            best = i;
+        }
+    }
+    p->cpu = best;
+    p->nice = 0;
+    p->weight = NICE_0_WEIGHT;
+    // placed by _activate_proc.
+    p->vruntime = 0;
+    p->exec_start = 0;
+    p->ready_since = 0;
 }
 
-#ifdef RCC
-int update_schinfo(struct schinfo *sch)
+/** Lock the run queue that owns p. */
+static struct sched *lock_rq_of(Proc *p)
 {
-    // this process is similar to clock algorithm
-    ASSERT(sch->coreid < NCPU);
     while (1) {
-        if ((sch->bitmap & (1U << sch->coreid)) != 0) {
-            // clear this scheduled bit.
-            // this means that we notice the proc is once scheduled
-            // on the core, so don't run on it again.
-            sch->bitmap &= ~(1U << sch->coreid);
-        } else {
-            // this bit is not set, meaning that the proc
-            // has not be scheduled on that core. so return that.
-            return sch->coreid;
+        const int cpu = __atomic_load_n(&p->schinfo.cpu, __ATOMIC_ACQUIRE);
+        struct sched *rq = rq_of(cpu);
+        acquire_spinlock(&rq->lock);
+        // the owner only changes under the lock of the old owner.
+        if (p->schinfo.cpu == cpu) {
+            return rq;
+        }
+        release_spinlock(&rq->lock);
+    }
+}
+
+/** Compare vruntime with wrap-around, ties broken by address. */
+static bool __vruntime_cmp(rb_node lnode, rb_node rnode)
+{
+    i64 d = container_of(lnode, struct schinfo, rbnode)->vruntime -
+            container_of(rnode, struct schinfo, rbnode)->vruntime;
+    if (d < 0)
+        return true;
+    if (d == 0)
+        return lnode < rnode;
+    return false;
+}
+
+/** Must hold rq->lock. */
+static void rq_push(struct sched *rq, Proc *p)
+{
+    ASSERT(0 == _rb_insert(&p->schinfo.rbnode, &rq->tree, __vruntime_cmp));
+    rq->load += p->schinfo.weight;
+    __atomic_store_n(&rq->nrun, rq->nrun + 1, __ATOMIC_RELAXED);
+}
+
+/** Must hold rq->lock, and p is in rq. */
+static void rq_remove(struct sched *rq, Proc *p)
+{
+    ASSERT(rq->nrun > 0);
+    _rb_erase(&p->schinfo.rbnode, &rq->tree);
+    rq->load -= p->schinfo.weight;
+    __atomic_store_n(&rq->nrun, rq->nrun - 1, __ATOMIC_RELAXED);
+}
+
+/** Pop the proc with the smallest vruntime.
+ * Must hold rq->lock, and the queue is not empty. */
+static Proc *rq_pop(struct sched *rq)
+{
+    rb_node node = _rb_first(&rq->tree);
+    ASSERT(node != NULL);
+    Proc *p = container_of(node, Proc, schinfo.rbnode);
+    rq_remove(rq, p);
+    return p;
+}
+
+/** max() of two vruntimes with wrap-around */
+static INLINE u64 vruntime_max(u64 a, u64 b)
+{
+    return (i64)(a - b) > 0 ? a : b;
+}
+
+/** Charge the time since exec_start to the running proc p. */
+static void update_vruntime(Proc *p, u64 now)
+{
+    u64 delta = now - p->schinfo.exec_start;
+    p->schinfo.vruntime += delta * NICE_0_WEIGHT / p->schinfo.weight;
+    p->schinfo.exec_start = now;
+}
+
+/** Length of the next timeslice of p in ms. Must hold rq->lock. */
+static int timeslice(struct sched *rq, Proc *p)
+{
+    u64 w = p->schinfo.weight;
+    int ms = (int)(SCHED_LATENCY_MS * w / (rq->load + w));
+    return MAX(ms, SCHED_MIN_GRAN_MS);
+}
+
+/** Arm the preemption tick of this cpu for p.
+ * Must hold rq->lock of this cpu. */
+static void start_tick(struct sched *rq, Proc *p)
+{
+    if (rq->tick_on) {
+        return;
+    }
+    struct timer *timer = &sched_timer[cpuid()];
+    timer->elapse = timeslice(rq, p);
+    set_cpu_timer(timer);
+    rq->tick_on = true;
+}
+
+/** Send a reschedule IPI to an idle cpu, if any, so that it steals
+ * from the others. */
+static void kick_idle(int cid)
+{
+    for (int i = 0; i < NCPU; i++) {
+        // racy, a wrong guess only costs an interrupt.
+        Proc *cur = __atomic_load_n(&cpus[i].proc, __ATOMIC_RELAXED);
+        if (i != cid && cpus[i].online && (cur == NULL || cur->idle)) {
+            send_ipi(i, RESCHED_IRQ);
+            return;
         }
-        // set the position of the frame pointer
-        sch->coreid = (sch->coreid + 1) % NCPU;
     }
 }
-#endif
 
 void acquire_sched_lock()
 {
     // TODO: acquire the sched_lock if need
-    acquire_spinlock(&sched_lock);
+    // traps are disabled, so the cpu does not change.
+    acquire_spinlock(&rq_of(cpuid())->lock);
 }
 
 void release_sched_lock()
 {
     // TODO: release the sched_lock if need
-    release_spinlock(&sched_lock);
+    release_spinlock(&rq_of(cpuid())->lock);
 }
 
 bool is_zombie(Proc *p)
 {
     bool r;
-    acquire_sched_lock();
+    struct sched *rq = lock_rq_of(p);
     r = p->state == ZOMBIE;
-    release_sched_lock();
+    release_spinlock(&rq->lock);
     return r;
 }
 
-// activate process p.
-// in the inside will hold sched_lock.
 bool is_unused(Proc *p)
 {
     bool r;
-    acquire_sched_lock();
+    struct sched *rq = lock_rq_of(p);
     r = p->state == UNUSED;
-    release_sched_lock();
+    release_spinlock(&rq->lock);
     return r;
 }
 
+// activate process p.
+// in the inside will hold the lock of its run queue.
 bool _activate_proc(Proc *p, bool onalert)
 {
     // TODO:
     // if the proc->state is RUNNING/RUNNABLE, do nothing
     // if the proc->state if SLEEPING/UNUSED, set the process state to RUNNABLE and add it to the sched queue
     // else: panic
-    acquire_spinlock(&sched_lock);
+    struct sched *rq = lock_rq_of(p);
+    int kick = -1;
     switch (p->state) {
     case (RUNNING):
     case (RUNNABLE): {
         break;
     }
+    case (DEEPSLEEPING):
     case (SLEEPING):
     case (UNUSED): {
-        p->state = RUNNABLE;
-        // push operation is atomic.
-#ifndef RCC
-        list_push_back(&queue, &p->schq);
-#else
-        // I believe before the proc is deactivated,
-        // it calls sched() which updates its schinfo.
-        // so no update is done here.
-        list_push_back(&queue[p->schinfo.coreid], &p->schq);
-#endif
-        break;
-    }
-    case (DEEPSLEEPING): {
-        if (onalert) {
+        if (onalert && p->state == DEEPSLEEPING) {
+            release_spinlock(&rq->lock);
             return false;
+        }
+        // a new proc starts at the queue; a sleeper keeps its lag
+        // but gets at most half of the latency as a bonus.
+        if (p->state == UNUSED) {
+            p->schinfo.vruntime = rq->min_vruntime;
         } else {
-            p->state = RUNNABLE;
-            list_push_back(&queue, &p->schq);
+            u64 bonus = get_clock_frequency() * SCHED_LATENCY_MS / 2000;
+            p->schinfo.vruntime = vruntime_max(p->schinfo.vruntime,
+                                               rq->min_vruntime - bonus);
+        }
+        p->state = RUNNABLE;
+        p->schinfo.ready_since = get_timestamp();
+        // back to the cpu it last ran on.
+        rq_push(rq, p);
+        // the owner has no tick if it is idle or runs a single
+        // proc, kick it now so that it runs p or restarts its tick.
+        const int cpu = p->schinfo.cpu;
+        if (cpu != (int)cpuid()) {
+            if (!rq->tick_on) {
+                rq->nkick++;
+                kick = cpu;
+            }
+        } else if (!thisproc()->idle) {
+            start_tick(rq, thisproc());
         }
         break;
     }
     default: {
         // PANIC("activate zombie proc");
         // handout change
-        release_spinlock(&sched_lock);
+        release_spinlock(&rq->lock);
         return false;
     }
     }
-    release_spinlock(&sched_lock);
+    release_spinlock(&rq->lock);
+    if (kick >= 0) {
+        send_ipi(kick, RESCHED_IRQ);
+    }
     return true;
     // TODO:(Lab5 new)
     // if the proc->state is RUNNING/RUNNABLE, do nothing and return false
@@ -198,13 +335,7 @@ static void update_this_state(enum procstate new_state)
     // set state to new state.
     struct Proc *p = thisproc();
     p->state = new_state;
-
-#ifdef RCC
-    // compute the next core to run the proc.
-    if (!p->idle) {
-        update_schinfo(&p->schinfo);
-    }
-#endif
+    ASSERT(p->schinfo.cpu == (int)cpuid());
 
     switch (new_state) {
     case (RUNNING): {
@@ -220,11 +351,8 @@ static void update_this_state(enum procstate new_state)
         // no need to remove from queue,
         // since it is done in pick_next().
         if (!p->idle) {
-#ifndef RCC
-            list_push_back(&queue, &p->schq);
-#else
-            list_push_back(&queue[p->schinfo.coreid], &p->schq);
-#endif // RCC
+            p->schinfo.ready_since = get_timestamp();
+            rq_push(rq_of(cpuid()), p);
         }
         break;
     }
@@ -240,49 +368,62 @@ static void update_this_state(enum procstate new_state)
     }
 }
 
+/** Move a batch of procs from the longest queue to rq, which is
+ * empty. Must hold rq->lock.
+ */
+static void steal(struct sched *rq, int cid)
+{
+    int victim = -1, most = 0;
+    for (int i = 0; i < NCPU; i++) {
+        if (i != cid && rq_len(i) > most) {
+            most = rq_len(i);
+            victim = i;
+        }
+    }
+    if (victim < 0) {
+        return;
+    }
+    struct sched *vq = rq_of(victim);
+    // the victim may be stealing from us, so do not wait for it.
+    if (!try_acquire_spinlock(&vq->lock)) {
+        return;
+    }
+    // take the procs that have run least, and keep their lag
+    // relative to the queue they move to.
+    int n = MIN((vq->nrun + 1) / 2, SCHED_STEAL_BATCH);
+    for (int i = 0; i < n; i++) {
+        Proc *p = rq_pop(vq);
+        p->schinfo.cpu = cid;
+        p->schinfo.vruntime += rq->min_vruntime - vq->min_vruntime;
+        rq_push(rq, p);
+    }
+    release_spinlock(&vq->lock);
+    if (n > 0) {
+        rq->nsteal++;
+        rq->nstolen += n;
+    }
+}
+
 // Returns next thread to run. Must hold sched_lock.
 static Proc *pick_next()
 {
     // TODO: if using template sched function, you should implement this routinue
     // choose the next process to run, and return idle if no runnable process
-#ifndef RCC
-    if (list_empty(&queue)) {
-        return mycpu()->idle;
-    }
-    struct list_elem *e = list_pop_front(&queue);
-    return list_entry(e, struct Proc, schq);
-#else
     const int cid = cpuid();
-    if (list_empty(&queue[cid])) {
-        // "steal" one proc from other cpu's scheduler queue(?!)
-        // if it is not done, some cores at sometime may have
-        // no job to run, which is a waste of computation power.
-        // It may not also be run with less than 4 cores.
-
-        // it is safe to do so for we already acquired
-        // the sched lock.
-        for (int i = 1; i < NCPU; i++) {
-            const int qid = (cid + i) % NCPU;
-            if (!list_empty(&queue[qid])) {
-                struct list_elem *e = list_pop_front(&queue[qid]);
-                Proc *p = list_entry(e, struct Proc, schq);
-                // update its bitmap, this will
-                // lower the possibility that it will be scheduled
-                // on the same cpu.
-                p->schinfo.bitmap |= (1U << cid);
-                return p;
-            }
-        }
+    struct sched *rq = rq_of(cid);
+    if (rq->nrun == 0) {
+        steal(rq, cid);
+    }
+    if (rq->nrun == 0) {
         return mycpu()->idle;
     }
-    // get a proc from its own scheduler queue
-    struct list_elem *e = list_pop_front(&queue[cid]);
-    struct Proc *p = list_entry(e, struct Proc, schq);
-    // mark the cpu as scheduled.
-    p->schinfo.bitmap |= (1U << cid);
-    p->schinfo.coreid = (cid + 1) % NCPU;
+    Proc *p = rq_pop(rq);
+    rq->min_vruntime = vruntime_max(rq->min_vruntime, p->schinfo.vruntime);
+    if (rq->nrun > 0) {
+        // idle cpus have no tick to poll for work, give them some.
+        kick_idle(cid);
+    }
     return p;
-#endif
 }
 
 // update the result of `thisproc` to p.
@@ -292,11 +433,15 @@ static void update_this_proc(Proc *p)
 {
     // TODO: you should implement this routinue
     // update thisproc to the choosen process
-    struct timer *timer = &sched_timer[cpuid()];
-    if (!timer->triggered) {
-        cancel_cpu_timer(timer);
+    struct sched *rq = rq_of(cpuid());
+    if (rq->tick_on && !sched_timer[cpuid()].triggered) {
+        cancel_cpu_timer(&sched_timer[cpuid()]);
+    }
+    rq->tick_on = false;
+    // tickless: nothing to preempt p for.
+    if (!p->idle && rq->nrun > 0) {
+        start_tick(rq, p);
     }
-    set_cpu_timer(timer);
 }
 
 // A simple scheduler.
@@ -311,6 +456,16 @@ void sched(enum procstate new_state)
         return;
     }
     ASSERT(this->state == RUNNING || this->state == ZOMBIE);
+    struct sched *rq = rq_of(cpuid());
+    const u64 now = get_timestamp();
+    const u64 ran = now - this->schinfo.exec_start;
+    if (this->idle) {
+        rq->idle += ran;
+    } else {
+        update_vruntime(this, now);
+        rq->busy += ran;
+        this->acct.run += ran;
+    }
     update_this_state(new_state);
     auto next = pick_next();
     update_this_proc(next);
@@ -318,13 +473,43 @@ void sched(enum procstate new_state)
     ASSERT(next->state == RUNNABLE);
     mycpu()->proc = next;
     next->state = RUNNING;
+    next->schinfo.exec_start = now;
     if (next != this) {
+        if (!this->idle) {
+            if (new_state == RUNNABLE) {
+                this->acct.nivcsw++;
+            } else if (new_state != ZOMBIE) {
+                this->acct.nvcsw++;
+            }
+        }
+        if (!next->idle) {
+            next->acct.wait += now - next->schinfo.ready_since;
+        }
+        rq->nswitch++;
         attach_pgdir(&next->pgdir);
         swtch(&this->kcontext, &next->kcontext);
     }
     release_sched_lock();
 }
 
+int set_nice(Proc *p, int nice)
+{
+    nice = MIN(MAX(nice, NICE_MIN), NICE_MAX);
+    struct sched *rq = lock_rq_of(p);
+    // the weight is part of rq->load while p is queued.
+    bool queued = p->state == RUNNABLE;
+    if (queued) {
+        rq_remove(rq, p);
+    }
+    p->schinfo.nice = nice;
+    p->schinfo.weight = nice_to_weight[nice - NICE_MIN];
+    if (queued) {
+        rq_push(rq, p);
+    }
+    release_spinlock(&rq->lock);
+    return nice;
+}
+
 u64 proc_entry(void (*entry)(u64), u64 arg)
 {
     // at sched() will hold sched_lock,
@@ -336,3 +521,63 @@ u64 proc_entry(void (*entry)(u64), u64 arg)
     // and the proc can retrieve its parameter.
     return arg;
 }
+
+void sched_stat(int cpu, struct sched_stat *st)
+{
+    ASSERT(cpu >= 0 && cpu < NCPU && st != NULL);
+    struct sched *rq = rq_of(cpu);
+    // racy, which is fine for statistics.
+    st->nrun = rq_len(cpu);
+    st->load = rq->load;
+    st->nswitch = rq->nswitch;
+    st->nsteal = rq->nsteal;
+    st->nstolen = rq->nstolen;
+    st->nkick = rq->nkick;
+}
+
+u64 ticks_to_us(u64 ticks)
+{
+    const u64 freq = get_clock_frequency();
+    // split, so that a long time does not overflow.
+    return ticks / freq * 1000000 + ticks % freq * 1000000 / freq;
+}
+
+int acct_cpus(struct acct_cpu *buf, int n)
+{
+    const u64 now = get_timestamp();
+    for (int i = 0; i < MIN(n, NCPU); i++) {
+        struct sched *rq = rq_of(i);
+        // the lock keeps the running proc of cpu i from switching.
+        acquire_spinlock(&rq->lock);
+        u64 busy = rq->busy, idle = rq->idle;
+        Proc *cur = cpus[i].proc;
+        if (cur != NULL) {
+            // the time since the last switch is not charged yet.
+            u64 ran = now - MIN(now, cur->schinfo.exec_start);
+            if (cur->idle) {
+                idle += ran;
+            } else {
+                busy += ran;
+            }
+        }
+        buf[i].nrun = rq->nrun;
+        buf[i].nswitch = rq->nswitch;
+        release_spinlock(&rq->lock);
+        buf[i].busy_us = ticks_to_us(busy);
+        buf[i].idle_us = ticks_to_us(idle);
+        buf[i].nfault = cpus[i].nfault;
+    }
+    return NCPU;
+}
+
+void sched_dump()
+{
+    struct sched_stat st;
+    for (int i = 0; i < NCPU; i++) {
+        sched_stat(i, &st);
+        printk("cpu %d: %d runnable, load %lld, %lld switches, %lld steals "
+               "of %lld procs, %lld kicks\n",
+               i, st.nrun, (i64)st.load, (i64)st.nswitch, (i64)st.nsteal,
+               (i64)st.nstolen, (i64)st.nkick);
+    }
+}
@@ -20,3 +20,26 @@ void sched(enum procstate new_state);
 #define yield() (acquire_sched_lock(), sched(RUNNABLE))
 
 WARN_RESULT Proc *thisproc();
+
+#define NICE_MIN (-20)
+#define NICE_MAX 19
+/** Weight of nice 0 */
+#define NICE_0_WEIGHT 1024
+
+/** Set the nice value of p, clamped to [NICE_MIN, NICE_MAX].
+ * @return the new nice value.
+ */
+int set_nice(Proc *p, int nice);
+
+/** Statistics of the run queue of a cpu */
+struct sched_stat {
+    int nrun; // runnable procs in the queue
+    u64 load; // sum of their weights
+    u64 nswitch; // context switches
+    u64 nsteal; // times it stole from other cpus
+    u64 nstolen; // procs it stole
+    u64 nkick; // reschedule IPIs it received
+};
+
+void sched_stat(int cpu, struct sched_stat *st);
+void sched_dump();
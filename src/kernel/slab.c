@@ -0,0 +1,244 @@
+#include <kernel/slab.h>
+#include <kernel/mem.h>
+#include <kernel/printk.h>
+#include <aarch64/mmu.h>
+
+/** A slab: one page, this header followed by objects.
+ * Each object is followed by a link word, which points to the next
+ * free object when the object is free, or is SLAB_INUSE otherwise.
+ * The link word lives outside the object so that the constructed
+ * state survives a free.
+ */
+struct slab {
+    KmemCache *cache;
+    struct slab *prev, *next; // on cache->partial or cache->empty
+    void *free; // free objects, LIFO
+    u32 nfree; // length of free
+    u32 nobj; // objects in this slab
+    u64 magic;
+};
+
+#define SLAB_MAGIC 0x51ab51ab51ab51abull
+#define SLAB_INUSE ((void *)0xdeadbeefdeadbeefull)
+
+/** Offset of the first object in a slab */
+#define SLAB_HDR round_up(sizeof(struct slab), 16)
+
+/** Lock to the list of all caches */
+static SpinLock caches_lock;
+static KmemCache *caches;
+
+static INLINE usize obj_stride(KmemCache *cache)
+{
+    return round_up(cache->size, 8) + sizeof(void *);
+}
+
+static INLINE void **obj_link(KmemCache *cache, void *obj)
+{
+    return (void **)((u8 *)obj + round_up(cache->size, 8));
+}
+
+static INLINE struct slab *obj_slab(void *obj)
+{
+    struct slab *s = (struct slab *)round_down((u64)obj, PAGE_SIZE);
+    ASSERT(s->magic == SLAB_MAGIC);
+    return s;
+}
+
+// push s to the front of *lst.
+static void slab_push(struct slab **lst, struct slab *s)
+{
+    s->prev = NULL;
+    s->next = *lst;
+    if (*lst != NULL) {
+        (*lst)->prev = s;
+    }
+    *lst = s;
+}
+
+// remove s from *lst.
+static void slab_remove(struct slab **lst, struct slab *s)
+{
+    if (s->prev != NULL) {
+        s->prev->next = s->next;
+    } else {
+        ASSERT(*lst == s);
+        *lst = s->next;
+    }
+    if (s->next != NULL) {
+        s->next->prev = s->prev;
+    }
+    s->prev = s->next = NULL;
+}
+
+/** Allocate a slab and construct all its objects. Do not hold lock. */
+static struct slab *slab_create(KmemCache *cache)
+{
+    const usize stride = obj_stride(cache);
+    ASSERT(SLAB_HDR + stride <= PAGE_SIZE);
+
+    struct slab *s = kalloc_page();
+    if (s == NULL) {
+        return NULL;
+    }
+    s->cache = cache;
+    s->prev = s->next = NULL;
+    s->free = NULL;
+    s->nobj = (PAGE_SIZE - SLAB_HDR) / stride;
+    s->nfree = s->nobj;
+    s->magic = SLAB_MAGIC;
+
+    // link the objects in address order.
+    u8 *obj = (u8 *)s + SLAB_HDR + stride * (s->nobj - 1);
+    for (u32 i = 0; i < s->nobj; i++, obj -= stride) {
+        if (cache->ctor != NULL) {
+            cache->ctor(obj);
+        }
+        *obj_link(cache, obj) = s->free;
+        s->free = obj;
+    }
+    return s;
+}
+
+void *kmem_cache_alloc(KmemCache *cache)
+{
+    acquire_spinlock(&cache->lock);
+    struct slab *s = cache->partial;
+    if (s == NULL && cache->empty != NULL) {
+        // reuse a spare slab, its objects are still constructed.
+        s = cache->empty;
+        slab_remove(&cache->empty, s);
+        cache->nempty--;
+        slab_push(&cache->partial, s);
+    }
+    if (s == NULL) {
+        // the constructors run without the lock held.
+        release_spinlock(&cache->lock);
+        s = slab_create(cache);
+        if (s == NULL) {
+            return NULL;
+        }
+
+        acquire_spinlock(&caches_lock);
+        if (!cache->listed) {
+            cache->listed = true;
+            cache->next = caches;
+            caches = cache;
+        }
+        release_spinlock(&caches_lock);
+
+        acquire_spinlock(&cache->lock);
+        cache->nslab++;
+        cache->nfree += s->nobj;
+        slab_push(&cache->partial, s);
+    }
+
+    ASSERT(s->nfree > 0 && s->free != NULL);
+    void *obj = s->free;
+    void **link = obj_link(cache, obj);
+    s->free = *link;
+    *link = SLAB_INUSE;
+    if (--s->nfree == 0) {
+        // full slabs are not tracked.
+        slab_remove(&cache->partial, s);
+    }
+    cache->nactive++;
+    cache->nfree--;
+    release_spinlock(&cache->lock);
+    return obj;
+}
+
+void kmem_cache_free(KmemCache *cache, void *obj)
+{
+    if (obj == NULL) {
+        return;
+    }
+    struct slab *s = obj_slab(obj);
+    ASSERT(s->cache == cache);
+    void **link = obj_link(cache, obj);
+    // catch double free.
+    ASSERT(*link == SLAB_INUSE);
+
+    acquire_spinlock(&cache->lock);
+    *link = s->free;
+    s->free = obj;
+    cache->nactive--;
+    cache->nfree++;
+    if (++s->nfree == 1) {
+        // it was full.
+        slab_push(&cache->partial, s);
+    }
+
+    if (s->nfree == s->nobj) {
+        slab_remove(&cache->partial, s);
+        if (cache->typestable || cache->nempty == 0 ||
+            cache->nempty * s->nobj <= cache->nactive) {
+            // keep it as a spare, so that bursts of allocations
+            // do not construct the objects again.
+            slab_push(&cache->empty, s);
+            cache->nempty++;
+            s = NULL;
+        } else {
+            cache->nslab--;
+            cache->nfree -= s->nobj;
+        }
+    } else {
+        s = NULL;
+    }
+    release_spinlock(&cache->lock);
+
+    if (s != NULL) {
+        kfree_page(s);
+    }
+}
+
+void kmem_cache_stat(KmemCache *cache, struct kmem_cache_stat *st)
+{
+    ASSERT(st != NULL);
+    acquire_spinlock(&cache->lock);
+    st->active = cache->nactive;
+    st->free = cache->nfree;
+    st->slabs = cache->nslab;
+    release_spinlock(&cache->lock);
+}
+
+usize kmem_cache_shrink_all(void)
+{
+    usize ret = 0;
+    acquire_spinlock(&caches_lock);
+    for (KmemCache *c = caches; c != NULL; c = c->next) {
+        if (c->typestable) {
+            continue;
+        }
+        acquire_spinlock(&c->lock);
+        struct slab *lst = c->empty;
+        c->empty = NULL;
+        c->nempty = 0;
+        for (struct slab *s = lst; s != NULL; s = s->next) {
+            c->nslab--;
+            c->nfree -= s->nobj;
+        }
+        release_spinlock(&c->lock);
+
+        while (lst != NULL) {
+            struct slab *nxt = lst->next;
+            kfree_page(lst);
+            lst = nxt;
+            ret++;
+        }
+    }
+    release_spinlock(&caches_lock);
+    return ret;
+}
+
+void kmem_cache_dump(void)
+{
+    struct kmem_cache_stat st;
+    acquire_spinlock(&caches_lock);
+    for (KmemCache *c = caches; c != NULL; c = c->next) {
+        kmem_cache_stat(c, &st);
+        printk("%s: active %lld, free %lld, slabs %lld\n", c->name,
+               (i64)st.active, (i64)st.free, (i64)st.slabs);
+    }
+    release_spinlock(&caches_lock);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <common/defines.h>
+#include <common/spinlock.h>
+
+/**
+ * Typed object caches.
+ *
+ * Each cache hands out objects of one type, carved from slabs of one
+ * page. The optional constructor runs only when a slab is created;
+ * objects must be given back in their constructed state(locks released,
+ * lists empty), so that the next allocation can skip the initialization.
+ * Free objects are reused in LIFO order to stay cache-warm, and empty
+ * slabs are kept as spares(up to the number of objects in use) until
+ * kmem_cache_shrink_all().
+ *
+ * The slabs of a type-stable cache are never given back: a freed object
+ * stays an object of that type, so a lock found through a stale pointer
+ * may still be taken, as long as what it guards is checked again under it.
+ */
+
+/** Constructor of the objects of a cache. */
+typedef void (*kmem_ctor_t)(void *obj);
+
+struct slab;
+
+typedef struct kmem_cache {
+    const char *name;
+    usize size; // object size
+    kmem_ctor_t ctor; // may be NULL
+
+    SpinLock lock;
+    struct slab *partial; // slabs with free objects
+    struct slab *empty; // spare slabs with no object in use
+    usize nempty; // length of empty
+    struct kmem_cache *next; // on the list of all caches
+    bool listed; // whether on the list of all caches
+    bool typestable; // never release slabs
+
+    /**< Statistics, must hold lock */
+    usize nactive; // objects in use
+    usize nfree; // free objects, including those of the spare slab
+    usize nslab; // slabs owned
+} KmemCache;
+
+/** Statically initialize an object cache of _type.
+ * The remaining members are zero, i.e. an unlocked, empty cache.
+ */
+#define KMEM_CACHE_INIT(_name, _type, _ctor) \
+    { .name = (_name), .size = sizeof(_type), .ctor = (_ctor) }
+
+/** Statically initialize a type-stable object cache of _type. */
+#define KMEM_CACHE_INIT_TYPESTABLE(_name, _type, _ctor) \
+    { .name = (_name), .size = sizeof(_type), .ctor = (_ctor), \
+      .typestable = true }
+
+/** Statistics of an object cache */
+struct kmem_cache_stat {
+    usize active; // objects in use
+    usize free; // objects ready to be handed out
+    usize slabs; // pages held by the cache
+};
+
+/** Allocate an object, constructed by the ctor of cache.
+ * @return NULL if out of memory.
+ */
+WARN_RESULT void *kmem_cache_alloc(KmemCache *cache);
+
+/** Give an object back to its cache, in its constructed state. */
+void kmem_cache_free(KmemCache *cache, void *obj);
+
+void kmem_cache_stat(KmemCache *cache, struct kmem_cache_stat *st);
+
+/** Release the spare slabs of each cache.
+ * @return number of pages released.
+ */
+usize kmem_cache_shrink_all(void);
+
+/** Print the statistics of all caches that have been used. */
+void kmem_cache_dump(void);
@@ -3,6 +3,7 @@
 #include <kernel/printk.h>
 #include <kernel/mmap1217.h>
 #include <kernel/pt.h>
+#include <kernel/vmalloc.h>
 #include <common/sem.h>
 #include <common/string.h>
 #include <test/test.h>
@@ -13,7 +14,7 @@
 #pragma GCC diagnostic ignored "-Woverride-init"
 
 extern int exec(const char *path, char **argv);
-static int install_page(struct pgdir *pd, u64 uva);
+static int install_page(struct pgdir *pd, u64 uva, bool write);
 
 /** Syscall executor type */
 typedef void (*syscall_fn)(UserContext *);
@@ -37,8 +38,12 @@ void syscall_dup2(UserContext *ctx);
 void syscall_sbrk(UserContext *ctx);
 void syscall_mmap(UserContext *ctx);
 void syscall_munmap(UserContext *ctx);
+void syscall_spawn(UserContext *ctx);
+void syscall_mwindow(UserContext *ctx);
 void syscall_socket(UserContext *ctx);
 void syscall_link(UserContext *ctx);
+void syscall_nice(UserContext *ctx);
+void syscall_getacct(UserContext *ctx);
 
 /** Page table helper methods. */
 
@@ -65,7 +70,11 @@ void *syscall_table[NR_SYSCALL] = {
     [19] = (void *)syscall_munmap,
     [20] = (void *)syscall_socket,
     [21] = (void *)syscall_link,
-    [22 ... NR_SYSCALL - 1] = NULL,
+    [SYS_nice] = (void *)syscall_nice,
+    [SYS_getacct] = (void *)syscall_getacct,
+    [SYS_spawn] = (void *)syscall_spawn,
+    [SYS_mwindow] = (void *)syscall_mwindow,
+    [26 ... NR_SYSCALL - 1] = NULL,
     [SYS_myreport] = (void *)syscall_myreport,
 };
 
@@ -88,7 +97,6 @@ void syscall_entry(UserContext *context)
         // function that executes the syscall
         syscall_fn fn = syscall_table[id];
         fn(context);
-        arch_tlbi_vmalle1is();
         // printk("[KERNEL] pid %d syscall id %lld return %lld\n",
         // thisproc()->pid, id, context->x0);
         break;
@@ -139,7 +147,7 @@ isize copyin(struct pgdir *pd, void *ka, u64 va, u64 size)
 
         PTEntry *entr = get_pte(pd, va, false);
         if (entr == NULL || *entr == 0) {
-            install_page(pd, va);
+            install_page(pd, va, false);
             entr = get_pte(pd, va, false);
         }
         if (entr == NULL || *entr == 0) {
@@ -175,14 +183,14 @@ isize copyout(struct pgdir *pd, void *ka, u64 va, u64 size)
         // ncp = min(ncp, size)
         ncp = ncp > size ? size : ncp;
 
-        PTEntry *entr = get_pte(pd, va, false);
+        PTEntry *entr = get_pte_mut(pd, va);
         // this may be:
         // (a) a lazily mapped page;
         // (b) a Copy-on-Write page;
         if (entr == NULL || *entr == 0 || *entr & PTE_RO) {
             // for COW page, section_install() will
             // duplicate it and mark it as writable.
-            install_page(pd, va);
+            install_page(pd, va, true);
             entr = get_pte(pd, va, false);
         }
         if (entr == NULL || *entr == 0 || *entr & PTE_RO) {
@@ -217,7 +225,7 @@ extern isize copyinstr(struct pgdir *pd, void *ka, u64 va)
 
         PTEntry *entr = get_pte(pd, va, false);
         if (entr == NULL || *entr == 0) {
-            install_page(pd, va);
+            install_page(pd, va, false);
             entr = get_pte(pd, va, false);
         }
         if (entr == NULL || *entr == 0) {
@@ -325,6 +333,7 @@ void syscall_read(UserContext *ctx)
     }
     ret += tmp;
     kfree_page(buf);
+    thisproc()->acct.rbytes += ret;
     ctx->x0 = ret;
     return;
 
@@ -419,6 +428,7 @@ void syscall_write(UserContext *ctx)
     ret += tmp;
 
     kfree_page(buf);
+    thisproc()->acct.wbytes += ret;
     ctx->x0 = (u64)ret;
     return;
 
@@ -495,27 +505,23 @@ void syscall_wait(UserContext *ctx)
     ctx->x0 = pid;
 }
 
-void syscall_execve(UserContext *ctx)
+static void free_argv(char **argv)
 {
-    struct pgdir *pd = &thisproc()->pgdir;
-    // return value
-    int ret = 0;
-    // name of executable
-    char *ename = kalloc_page();
-    if (ename == NULL) {
-        ret = -1;
-        goto exe_bad;
-    }
-    if (copyinstr(pd, ename, ctx->x0) != 0) {
-        ret = -1;
-        goto exe_bad2;
+    for (int i = 0; argv[i] != NULL; i++) {
+        kfree_page(argv[i]);
     }
+    kfree(argv);
+}
 
+/** Copy a NULL-terminated argv from user space, a page per string.
+ * @return NULL on error. Release it by free_argv().
+ */
+static char **copyin_argv(struct pgdir *pd, u64 uva)
+{
     // zero-init argv array
     char **argv = kalloc(EXE_MAX_ARGS * sizeof(void *));
     if (argv == NULL) {
-        ret = -1;
-        goto exe_bad2;
+        return NULL;
     }
     for (int i = 0; i < EXE_MAX_ARGS; i++) {
         argv[i] = NULL;
@@ -523,11 +529,11 @@ void syscall_execve(UserContext *ctx)
 
     // copy argv from user space
     u64 narg = 0;
-    for (u64 va = ctx->x1;; va += sizeof(void *)) {
+    for (u64 va = uva;; va += sizeof(void *)) {
         u64 uvaddr;
-        if (copyin(pd, (void *)&uvaddr, va, sizeof(uvaddr)) != 0) {
-            ret = -1;
-            goto exe_bad1;
+        if (narg + 1 >= EXE_MAX_ARGS ||
+            copyin(pd, (void *)&uvaddr, va, sizeof(uvaddr)) != 0) {
+            goto argv_bad;
         }
         if (uvaddr == NULL) {
             // end
@@ -537,29 +543,94 @@ void syscall_execve(UserContext *ctx)
         // copy string from user
         argv[narg] = kalloc_page();
         if (argv[narg] == NULL || copyinstr(pd, argv[narg], uvaddr) != 0) {
-            ret = -1;
-            goto exe_bad1;
+            goto argv_bad;
         }
 
         narg++;
     }
+    return argv;
+
+argv_bad:
+    free_argv(argv);
+    return NULL;
+}
+
+void syscall_execve(UserContext *ctx)
+{
+    struct pgdir *pd = &thisproc()->pgdir;
+    // return value
+    int ret = -1;
+    // name of executable
+    char *ename = kalloc_page();
+    if (ename == NULL) {
+        goto exe_bad;
+    }
+    if (copyinstr(pd, ename, ctx->x0) != 0) {
+        goto exe_bad1;
+    }
+    char **argv = copyin_argv(pd, ctx->x1);
+    if (argv == NULL) {
+        goto exe_bad1;
+    }
 
     // execute command.
     ret = exec(ename, argv);
 
 // free up resources.
+    free_argv(argv);
 exe_bad1:
-    for (int i = 0; argv[i] != NULL; i++) {
-        kfree_page(argv[i]);
-    }
-    kfree(argv);
-exe_bad2:
     kfree_page(ename);
 exe_bad:
     ctx->x0 = ret;
     return;
 }
 
+void syscall_spawn(UserContext *ctx)
+{
+    // note:
+    // int spawn(const char *path, char **argv, const int *fdmap, int nfd);
+    Proc *proc = thisproc();
+    struct pgdir *pd = &proc->pgdir;
+    int ret = -1;
+
+    // fd remapping, NULL to inherit all.
+    int fdmap[MAXOFILE];
+    const int nfd = (int)ctx->x3;
+    if (ctx->x2 != 0) {
+        if (nfd < 0 || nfd > MAXOFILE ||
+            copyin(pd, fdmap, ctx->x2, nfd * sizeof(int)) != 0) {
+            goto spawn_bad;
+        }
+        for (int i = 0; i < nfd; i++) {
+            if (fdmap[i] >= MAXOFILE ||
+                (fdmap[i] >= 0 && proc->ofile.ofile[fdmap[i]] == NULL)) {
+                // bad file descriptor
+                goto spawn_bad;
+            }
+        }
+    }
+
+    char *ename = kalloc_page();
+    if (ename == NULL) {
+        goto spawn_bad;
+    }
+    if (copyinstr(pd, ename, ctx->x0) != 0) {
+        goto spawn_bad1;
+    }
+    char **argv = copyin_argv(pd, ctx->x1);
+    if (argv == NULL) {
+        goto spawn_bad1;
+    }
+
+    ret = spawn(ename, argv, ctx->x2 != 0 ? fdmap : NULL, nfd);
+
+    free_argv(argv);
+spawn_bad1:
+    kfree_page(ename);
+spawn_bad:
+    ctx->x0 = ret;
+}
+
 void syscall_fstat(UserContext *ctx)
 {
     // hint:
@@ -617,7 +688,7 @@ void syscall_pipe(UserContext *ctx)
     }
 
     // read pipe
-    File *rf = kalloc(sizeof(File));
+    File *rf = falloc();
     if (rf == NULL) {
         ctx->x0 = -1;
         return;
@@ -625,10 +696,9 @@ void syscall_pipe(UserContext *ctx)
     rf->readable = true;
     rf->writable = false;
     rf->pipe = pip;
-    rf->ref = 1;
     rf->type = FD_PIPE;
 
-    File *wf = kalloc(sizeof(File));
+    File *wf = falloc();
     if (wf == NULL) {
         fclose(rf);
         ctx->x0 = -1;
@@ -637,7 +707,6 @@ void syscall_pipe(UserContext *ctx)
     wf->readable = false;
     wf->writable = true;
     wf->pipe = pip;
-    wf->ref = 1;
     wf->type = FD_PIPE;
 
     Proc *proc = thisproc();
@@ -692,7 +761,6 @@ void syscall_sbrk(UserContext *ctx)
         // install a page at virtual address start.
         void *page = kalloc_zero();
         ASSERT(page != NULL);
-        memset(page, 0, PAGE_SIZE);
 
         // install page
         PTEntry *pte = get_pte(pd, start, true);
@@ -708,8 +776,8 @@ void syscall_sbrk(UserContext *ctx)
         heap->npages++;
     }
 
+    // only new entries, nothing to flush.
     ctx->x0 = heap->start + heap->npages * PAGE_SIZE;
-    arch_tlbi_vmalle1is();
     return;
 }
 
@@ -726,6 +794,13 @@ void syscall_munmap(UserContext *ctx)
     return;
 }
 
+void syscall_mwindow(UserContext *ctx)
+{
+    // note:
+    // int mwindow(void *addr, int npages);
+    ctx->x0 = mwindow((void *)ctx->x0, (int)ctx->x1);
+}
+
 void syscall_link(UserContext *ctx)
 {
     char *oldpth = kalloc_page();
@@ -761,7 +836,47 @@ void syscall_socket(UserContext *ctx)
     return;
 }
 
-static int install_page(struct pgdir *pd, u64 faddr)
+void syscall_nice(UserContext *ctx)
+{
+    Proc *p = thisproc();
+    // clamp first so that the sum cannot overflow.
+    int inc = MIN(MAX((int)ctx->x0, 2 * NICE_MIN), 2 * NICE_MAX);
+    ctx->x0 = set_nice(p, p->schinfo.nice + inc);
+    return;
+}
+
+/** Most records returned by one getacct. */
+#define ACCT_MAX 4096
+
+void syscall_getacct(UserContext *ctx)
+{
+    // note:
+    // int getacct(int which, void *buf, int n);
+    const int which = (int)ctx->x0;
+    if (which != ACCT_PROC && which != ACCT_CPU) {
+        ctx->x0 = -1;
+        return;
+    }
+    const int n = MIN(MAX((int)ctx->x2, 0), ACCT_MAX);
+    const usize size = which == ACCT_PROC ? sizeof(struct acct_proc)
+                                          : sizeof(struct acct_cpu);
+    void *buf = n > 0 ? vmalloc(n * size) : NULL;
+    if (n > 0 && buf == NULL) {
+        ctx->x0 = -1;
+        return;
+    }
+    int cnt = which == ACCT_PROC ? acct_procs(buf, n) : acct_cpus(buf, n);
+    if (n > 0) {
+        if (copyout(&thisproc()->pgdir, buf, ctx->x1, MIN(cnt, n) * size) !=
+            0) {
+            cnt = -1;
+        }
+        vfree(buf);
+    }
+    ctx->x0 = cnt;
+}
+
+static int install_page(struct pgdir *pd, u64 faddr, bool write)
 {
     struct section *sec = section_search(pd, faddr);
     if (sec == NULL) {
@@ -769,7 +884,7 @@ static int install_page(struct pgdir *pd, u64 faddr)
         return -1;
     }
 
-    return section_install(pd, sec, faddr);
+    return section_install(pd, sec, faddr, write);
 }
 
 #pragma GCC diagnostic pop
\ No newline at end of file
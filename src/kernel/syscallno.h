@@ -4,4 +4,17 @@
  * THIS SYSCALL IS DEPRECATED AND IS USED ONLY FOR DEBUGGING.
  */
 #define SYS_print 1
+
+/** Change the nice value of the calling process. */
+#define SYS_nice 22
+
+/** Read the accounting records of procs or cpus. */
+#define SYS_getacct 23
+
+/** Start a program in a new child, without forking this one. */
+#define SYS_spawn 24
+
+/** Set how many pages are mapped around a page fault of a mapping. */
+#define SYS_mwindow 25
+
 #define SYS_myreport 499
\ No newline at end of file
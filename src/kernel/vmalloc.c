@@ -0,0 +1,270 @@
+#include <kernel/vmalloc.h>
+#include <kernel/mem.h>
+#include <kernel/slab.h>
+#include <common/spinlock.h>
+#include <aarch64/intrinsic.h>
+#include <aarch64/mmu.h>
+
+/** Level 2 table of the vmalloc space, in kernel_pt.c */
+extern PTEntries _kernel_pt_lv2_vmalloc;
+
+/** A virtually contiguous area, followed by a guard page */
+struct vm_area {
+    u64 start;
+    usize npages; // mapped pages, not counting the guard page
+    struct vm_area *next; // in address order
+};
+
+static KmemCache area_cache = KMEM_CACHE_INIT("vm_area", struct vm_area, NULL);
+
+/** Protects areas, the vmalloc page tables and stat */
+static SpinLock vmalloc_lock;
+static struct vm_area *areas;
+static struct vmalloc_stat stat;
+
+/** Returns the level 3 entry of va, NULL if its table is not
+ * allocated and alloc is false or out of memory.
+ * Must hold vmalloc_lock.
+ */
+static PTEntry *vm_pte(u64 va, bool alloc)
+{
+    ASSERT(va >= VMALLOC_START && va < VMALLOC_END);
+    PTEntry *pde = &_kernel_pt_lv2_vmalloc[VA_PART2(va)];
+    if (*pde == 0) {
+        if (!alloc) {
+            return NULL;
+        }
+        // tables are kept once allocated, they are few.
+        void *table = kalloc_page_zeroed();
+        if (table == NULL) {
+            return NULL;
+        }
+        stat.nptpage++;
+        *pde = K2P(table) | PTE_TABLE;
+    }
+    PTEntry *table = (PTEntry *)P2K(PTE_ADDRESS(*pde));
+    return &table[VA_PART3(va)];
+}
+
+/** Unmap pages [from, to) of the area at start, and free them.
+ * Must hold vmalloc_lock.
+ */
+static void vm_unmap(u64 start, usize from, usize to)
+{
+    for (usize i = from; i < to; i++) {
+        u64 va = start + i * PAGE_SIZE;
+        PTEntry *pte = vm_pte(va, false);
+        ASSERT(pte != NULL && (*pte & PTE_VALID));
+        void *page = (void *)P2K(PTE_ADDRESS(*pte));
+        *pte = 0;
+        arch_tlbi_vaae1is(va);
+        kfree_page(page);
+        stat.npage--;
+    }
+}
+
+/** Map new pages to [from, to) of the area at start. On failure,
+ * nothing is left mapped.
+ * Must hold vmalloc_lock.
+ */
+static bool vm_map(u64 start, usize from, usize to)
+{
+    for (usize i = from; i < to; i++) {
+        u64 va = start + i * PAGE_SIZE;
+        PTEntry *pte = vm_pte(va, true);
+        void *page = pte != NULL ? kalloc_page() : NULL;
+        if (page == NULL) {
+            vm_unmap(start, from, i);
+            return false;
+        }
+        ASSERT(*pte == 0);
+        *pte = K2P(page) | PTE_KERNEL_PAGE;
+        stat.npage++;
+    }
+    arch_fence();
+    return true;
+}
+
+/** Find a free range for npages and its guard page, and link area
+ * there. Must hold vmalloc_lock.
+ * @return false if the vmalloc space is used up.
+ */
+static bool vm_place(struct vm_area *area, usize npages)
+{
+    const u64 size = (npages + 1) * PAGE_SIZE;
+    u64 addr = VMALLOC_START;
+    struct vm_area **it = &areas;
+    // first fit.
+    for (; *it != NULL; it = &(*it)->next) {
+        if ((*it)->start - addr >= size) {
+            break;
+        }
+        addr = (*it)->start + ((*it)->npages + 1) * PAGE_SIZE;
+    }
+    if (*it == NULL && VMALLOC_END - addr < size) {
+        return false;
+    }
+    area->start = addr;
+    area->npages = npages;
+    area->next = *it;
+    *it = area;
+    stat.narea++;
+    return true;
+}
+
+static void vm_unlink(struct vm_area *area)
+{
+    struct vm_area **it = &areas;
+    while (*it != area) {
+        ASSERT(*it != NULL);
+        it = &(*it)->next;
+    }
+    *it = area->next;
+    stat.narea--;
+}
+
+/** Must hold vmalloc_lock. */
+static struct vm_area *vm_find(void *p)
+{
+    for (struct vm_area *a = areas; a != NULL; a = a->next) {
+        if (a->start == (u64)p) {
+            return a;
+        }
+    }
+    PANIC();
+    return NULL;
+}
+
+static INLINE usize vm_npages(usize size)
+{
+    return round_up(size, PAGE_SIZE) / PAGE_SIZE;
+}
+
+void *vmalloc(usize size)
+{
+    if (size == 0 || size > VMALLOC_SIZE) {
+        return NULL;
+    }
+    struct vm_area *area = kmem_cache_alloc(&area_cache);
+    if (area == NULL) {
+        return NULL;
+    }
+    const usize npages = vm_npages(size);
+
+    acquire_spinlock(&vmalloc_lock);
+    if (!vm_place(area, npages)) {
+        release_spinlock(&vmalloc_lock);
+        kmem_cache_free(&area_cache, area);
+        return NULL;
+    }
+    if (!vm_map(area->start, 0, npages)) {
+        vm_unlink(area);
+        release_spinlock(&vmalloc_lock);
+        kmem_cache_free(&area_cache, area);
+        return NULL;
+    }
+    release_spinlock(&vmalloc_lock);
+    return (void *)area->start;
+}
+
+void vfree(void *p)
+{
+    if (p == NULL) {
+        return;
+    }
+    acquire_spinlock(&vmalloc_lock);
+    struct vm_area *area = vm_find(p);
+    vm_unlink(area);
+    vm_unmap(area->start, 0, area->npages);
+    release_spinlock(&vmalloc_lock);
+    kmem_cache_free(&area_cache, area);
+}
+
+/** Move the pages of src to dst, which has room for them and whose
+ * level 3 tables exist. Must hold vmalloc_lock.
+ */
+static void vm_move(struct vm_area *dst, struct vm_area *src)
+{
+    for (usize i = 0; i < src->npages; i++) {
+        u64 va = src->start + i * PAGE_SIZE;
+        PTEntry *from = vm_pte(va, false);
+        PTEntry *to = vm_pte(dst->start + i * PAGE_SIZE, false);
+        ASSERT(from != NULL && to != NULL && *to == 0);
+        *to = *from;
+        *from = 0;
+        arch_tlbi_vaae1is(va);
+    }
+    arch_fence();
+}
+
+void *vrealloc(void *p, usize size)
+{
+    if (p == NULL) {
+        return vmalloc(size);
+    }
+    if (size == 0) {
+        vfree(p);
+        return NULL;
+    }
+    if (size > VMALLOC_SIZE) {
+        return NULL;
+    }
+    const usize npages = vm_npages(size);
+    void *ret = NULL;
+    // in case the area has to move, freed if not used.
+    struct vm_area *spare = kmem_cache_alloc(&area_cache);
+
+    acquire_spinlock(&vmalloc_lock);
+    struct vm_area *area = vm_find(p);
+    const u64 limit = area->next != NULL ? area->next->start : VMALLOC_END;
+
+    if (npages <= area->npages) {
+        vm_unmap(area->start, npages, area->npages);
+        area->npages = npages;
+        ret = p;
+    } else if (area->start + (npages + 1) * PAGE_SIZE <= limit) {
+        // grow in place, the guard page moves to the new end.
+        if (vm_map(area->start, area->npages, npages)) {
+            area->npages = npages;
+            ret = p;
+        }
+    } else if (spare != NULL && vm_place(spare, npages)) {
+        // move: the pages are remapped, not copied.
+        bool ok = true;
+        for (usize i = 0; ok && i < area->npages; i += N_PTE_PER_TABLE) {
+            ok = vm_pte(spare->start + i * PAGE_SIZE, true) != NULL;
+        }
+        ok = ok && vm_pte(spare->start + (area->npages - 1) * PAGE_SIZE,
+                          true) != NULL;
+        if (ok && vm_map(spare->start, area->npages, npages)) {
+            vm_move(spare, area);
+            vm_unlink(area);
+            ret = (void *)spare->start;
+            spare = area;
+        } else {
+            vm_unlink(spare);
+        }
+    }
+    release_spinlock(&vmalloc_lock);
+
+    if (spare != NULL) {
+        kmem_cache_free(&area_cache, spare);
+    }
+    return ret;
+}
+
+usize vmalloc_size(void *p)
+{
+    acquire_spinlock(&vmalloc_lock);
+    usize ret = vm_find(p)->npages * PAGE_SIZE;
+    release_spinlock(&vmalloc_lock);
+    return ret;
+}
+
+void vmalloc_stat(struct vmalloc_stat *st)
+{
+    ASSERT(st != NULL);
+    acquire_spinlock(&vmalloc_lock);
+    *st = stat;
+    release_spinlock(&vmalloc_lock);
+}
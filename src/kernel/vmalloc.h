@@ -0,0 +1,37 @@
+#pragma once
+
+#include <common/defines.h>
+
+/**
+ * Virtually contiguous kernel allocations.
+ *
+ * Pages from kalloc_page() are mapped into [VMALLOC_START, VMALLOC_END)
+ * of the kernel page table. Every area is followed by an unmapped guard
+ * page, so running off its end faults instead of corrupting a neighbour.
+ * Use it for buffers larger than malloc() can serve; the size is
+ * rounded up to pages.
+ */
+
+/** @return NULL if out of memory or virtual space, or size is 0. */
+WARN_RESULT void *vmalloc(usize size);
+
+void vfree(void *p);
+
+/** Resize an area, keeping its contents up to the smaller size.
+ * Grows in place if the space after it is free, otherwise its pages
+ * are remapped to a new address without copying.
+ * @return the new address, or NULL on failure, in which case p is
+ * left as it is.
+ */
+WARN_RESULT void *vrealloc(void *p, usize size);
+
+/** @return the size of the area at p, in bytes. */
+usize vmalloc_size(void *p);
+
+struct vmalloc_stat {
+    usize narea; // areas allocated
+    usize npage; // pages mapped
+    usize nptpage; // pages used by level 3 tables
+};
+
+void vmalloc_stat(struct vmalloc_stat *st);
@@ -1,5 +1,6 @@
 #include "socket.h"
 #include <kernel/mem.h>
+#include <kernel/slab.h>
 
 static ListNode head;
 static ListNode tail;
@@ -40,26 +41,33 @@ void sock_init(void)
     tail.prev = &head;
 }
 
+// constructor of sock_cache. A socket is freed with
+// an empty queue and nobody waiting on it.
+static void sock_ctor(void *obj)
+{
+    Socket *si = obj;
+    // init sock's lock, condvar and buffer queue
+    cond_init(&si->cv);
+    init_spinlock(&si->lock);
+    mbufq_init(&si->rxq);
+}
+
+static KmemCache sock_cache = KMEM_CACHE_INIT("socket", Socket, sock_ctor);
+
 Socket *sock_open(u32 raddr, u16 lport, u16 rport)
 {
-    Socket *si = kalloc(sizeof(Socket));
+    Socket *si = kmem_cache_alloc(&sock_cache);
     if (si == NULL) {
         // fail!
         return si;
     }
-
-    // init sock's lock and condvar
-    cond_init(&si->cv);
-    init_spinlock(&si->lock);
+    ASSERT(mbufq_empty(&si->rxq));
 
     // fill in properties
     si->raddr = raddr;
     si->lport = lport;
     si->rport = rport;
 
-    // buffer queue
-    mbufq_init(&si->rxq);
-
     // list node.
     acquire_spinlock(&slock);
     sock_add(si);
@@ -83,7 +91,7 @@ void sock_close(Socket *sock)
         mbuffree(m);
     }
 
-    kfree(sock);
+    kmem_cache_free(&sock_cache, sock);
 }
 
 extern void net_tx_udp(struct mbuf *m, uint32 dip, uint16 sport, uint16 dport);
@@ -26,12 +26,14 @@ int sys_socket(u32 raddr, u16 lport, u16 rport)
         return -1;
     }
 
-    File *fobj = kalloc(sizeof(File));
+    File *fobj = falloc();
+    if (fobj == NULL) {
+        sock_close(sock);
+        return -1;
+    }
     fobj->type = FD_SOCK;
-    fobj->ref = 1;
     fobj->sock = sock;
     fobj->readable = fobj->writable = true;
-    fobj->off = 0;
 
     // done.
     ofile[id] = fobj;
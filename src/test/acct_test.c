@@ -0,0 +1,108 @@
+/**
+ * Accounting: a spinner burns cpu, and a sleeper and a poster ping-pong
+ * through semaphores. Each saves its own accounting before it exits.
+ * The spinner must be charged run time, the ping-pong procs must have
+ * voluntary switches, and getacct's helpers must see the live procs and cpus.
+ */
+#include <kernel/proc.h>
+#include <kernel/sched.h>
+#include <kernel/cpu.h>
+#include <kernel/printk.h>
+#include <aarch64/intrinsic.h>
+
+#define NROUND 100
+/** Run time of the spinner, in ms */
+#define SPIN_MS 50
+
+extern Proc root_proc;
+static Semaphore ping, pong;
+static struct proc_acct spinner, sleeper, poster;
+static struct acct_proc live[16];
+static struct acct_cpu cpu_recs[NCPU];
+static int nlive;
+
+static void spinner_entry(u64 unused __attribute__((unused)))
+{
+    u64 end = get_timestamp() + get_clock_frequency() * SPIN_MS / 1000;
+    while (get_timestamp() < end)
+        ;
+    // charge the run time so far.
+    yield();
+    nlive = acct_procs(live, 16);
+    spinner = thisproc()->acct;
+    exit(0);
+}
+
+static void sleeper_entry(u64 unused __attribute__((unused)))
+{
+    for (int i = 0; i < NROUND; i++) {
+        unalertable_wait_sem(&ping);
+        post_sem(&pong);
+    }
+    sleeper = thisproc()->acct;
+    exit(0);
+}
+
+static void poster_entry(u64 unused __attribute__((unused)))
+{
+    for (int i = 0; i < NROUND; i++) {
+        post_sem(&ping);
+        unalertable_wait_sem(&pong);
+    }
+    poster = thisproc()->acct;
+    exit(0);
+}
+
+static void rt_entry()
+{
+    int code;
+    for (int i = 0; i < 3; i++) {
+        ASSERT(wait(&code) >= 0);
+    }
+    // at least root and the spinner itself were alive.
+    ASSERT(nlive >= 2);
+    ASSERT(ticks_to_us(spinner.run) >= SPIN_MS * 1000);
+    ASSERT(spinner.nvcsw == 0);
+    // one of them sleeps in almost every round.
+    ASSERT(sleeper.nvcsw + poster.nvcsw > 0);
+    ASSERT(acct_cpus(cpu_recs, NCPU) == NCPU);
+    u64 busy = 0;
+    for (int i = 0; i < NCPU; i++) {
+        busy += cpu_recs[i].busy_us;
+    }
+    ASSERT(busy >= SPIN_MS * 1000);
+
+    printk("spinner: run %lld us, %lld preemptions\n",
+           (i64)ticks_to_us(spinner.run), (i64)spinner.nivcsw);
+    printk("sleeper: run %lld us, wait %lld us, %lld sleeps\n",
+           (i64)ticks_to_us(sleeper.run), (i64)ticks_to_us(sleeper.wait),
+           (i64)sleeper.nvcsw);
+    printk("poster: run %lld us, wait %lld us, %lld sleeps\n",
+           (i64)ticks_to_us(poster.run), (i64)ticks_to_us(poster.wait),
+           (i64)poster.nvcsw);
+    for (int i = 0; i < NCPU; i++) {
+        printk("cpu %d: busy %lld us, idle %lld us, %lld switches\n", i,
+               (i64)cpu_recs[i].busy_us, (i64)cpu_recs[i].idle_us,
+               (i64)cpu_recs[i].nswitch);
+    }
+    printk("acct test PASS\n");
+    exit(0);
+}
+
+void test_init()
+{
+    init_sem(&ping, 0);
+    init_sem(&pong, 0);
+    root_proc.kcontext.x0 = (uint64_t)rt_entry;
+    void (*entries[])(u64) = { spinner_entry, sleeper_entry, poster_entry };
+    for (int i = 0; i < 3; i++) {
+        Proc *p = create_proc();
+        ASSERT(p != NULL);
+        start_proc(p, entries[i], 0);
+    }
+}
+
+void run_test()
+{
+    yield();
+}
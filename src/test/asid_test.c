@@ -0,0 +1,79 @@
+/**
+ * Test ASID-tagged address spaces: more pgdirs than ASIDs map the
+ * same user address to different pages. Reading it after each switch
+ * must see the page of the attached pgdir, never a stale TLB entry,
+ * before and after the ASIDs roll over.
+ */
+#include "test.h"
+#include "test_util.h"
+#include <common/debug.h>
+#include <kernel/asid.h>
+#include <kernel/mem.h>
+#include <kernel/printk.h>
+#include <kernel/pt.h>
+#include <aarch64/mmu.h>
+
+/** More than the ASIDs of a generation */
+#define NPGDIR ((1 << ASID_BITS) + 64)
+#define NROUND 3
+/** User address mapped by every pgdir */
+#define UVA 0x1000
+
+static struct pgdir pds[NPGDIR];
+static void *pages[NPGDIR];
+
+static void asid_test(void)
+{
+    TEST_START;
+    for (int i = 0; i < NPGDIR; i++) {
+        init_pgdir(&pds[i]);
+        pages[i] = kalloc_page();
+        ASSERT(pages[i] != NULL);
+        *(int *)pages[i] = i;
+        *get_pte(&pds[i], UVA, true) = K2P(pages[i]) | PTE_USER_DATA;
+    }
+
+    for (int r = 0; r < NROUND; r++) {
+        for (int i = 0; i < NPGDIR; i++) {
+            attach_pgdir(&pds[i]);
+            ASSERT(*(volatile int *)UVA == i);
+            // attaching it again needs no write to TTBR0.
+            attach_pgdir(&pds[i]);
+            ASSERT(pds[i].asid != 0);
+        }
+        // change a mapping in place: the old one must not be seen.
+        attach_pgdir(&pds[0]);
+        PTEntry *pte = get_pte(&pds[0], UVA, false);
+        *pte = 0;
+        flush_tlb_page(&pds[0], UVA);
+        *pte = K2P(pages[1]) | PTE_USER_DATA;
+        ASSERT(*(volatile int *)UVA == 1);
+        *pte = K2P(pages[0]) | PTE_USER_DATA;
+        flush_tlb_pgdir(&pds[0]);
+        ASSERT(*(volatile int *)UVA == 0);
+    }
+
+    struct asid_stat st;
+    asid_stat(cpuid(), &st);
+    ASSERT(st.nskip >= (u64)NPGDIR * NROUND);
+    ASSERT(st.nflush > 0);
+
+    for (int i = 0; i < NPGDIR; i++) {
+        free_pgdir(&pds[i]);
+        kfree_page(pages[i]);
+    }
+    attach_pgdir(&pds[0]);
+    asid_dump();
+    TEST_END;
+}
+
+void test_init(void)
+{
+}
+
+void run_test()
+{
+    if (cpuid() == 0) {
+        asid_test();
+    }
+}
@@ -0,0 +1,92 @@
+/**
+ * Test the buddy allocator behind palloc: multi-page blocks
+ * must be contiguous, aligned to their order and disjoint, and
+ * freeing them must coalesce the buddies back.
+ */
+#include "test.h"
+#include "test_util.h"
+#include "range.h"
+#include "sync.h"
+#include <common/debug.h>
+#include <common/string.h>
+#include <fdutil/palloc.h>
+#include <fdutil/malloc.h>
+#include <fdutil/stddef.h>
+
+/** Blocks each cpu allocates */
+#define NBLK 16
+/** Largest order tested */
+#define MAXORD 4
+
+typedef struct range range_t;
+static range_t rgs[NBLK * NCPU];
+
+/** Free block counts before the test starts */
+static size_t nfree[PALLOC_NORDER];
+
+static void buddy_test(void)
+{
+    TEST_START;
+    const int cpu = cpuid();
+    sync(1);
+
+    // alloc phase: blocks of different orders.
+    for (int i = 0; i < NBLK; i++) {
+        const unsigned int order = 1 + (i + cpu) % MAXORD;
+        void *blk = palloc_get_order(order);
+        ASSERT(blk != NULL && pg_off(blk) == 0);
+
+        // touch every byte of the block.
+        memset(blk, cpu, PGSIZE << order);
+        const int idx = i + NBLK * cpu;
+        rgs[idx].valid = 1;
+        rgs[idx].size = PGSIZE << order;
+        rgs[idx].start = blk;
+    }
+    sync(2);
+
+    if (cpu == 0) {
+        // no two blocks intersect.
+        for (int i = 0; i < NBLK * NCPU; i++) {
+            ASSERT(rg_find(&rgs[0], &rgs[i], NBLK * NCPU) == RG_ERR);
+        }
+    }
+    sync(3);
+
+    // free phase
+    for (int i = 0; i < NBLK; i++) {
+        const int idx = i + NBLK * cpu;
+        ASSERT(Memchk(rgs[idx].start, rgs[idx].size, cpu));
+        palloc_free_mult(rgs[idx].start, rgs[idx].size / PGSIZE);
+        rgs[idx].valid = 0;
+    }
+    sync(4);
+
+    if (cpu == 0) {
+        // all buddies are merged back.
+        size_t now[PALLOC_NORDER];
+        palloc_buddystat(now);
+        for (int i = 0; i < PALLOC_NORDER; i++) {
+            printk("order %d: %lld free blocks\n", i, (i64)now[i]);
+            ASSERT(now[i] == nfree[i]);
+        }
+
+        // malloc can serve more than a page now.
+        void *big = malloc(3 * PGSIZE);
+        ASSERT(big != NULL);
+        memset(big, 0x5a, 3 * PGSIZE);
+        free(big);
+        TEST_END;
+    }
+}
+
+void test_init(void)
+{
+    sync_init();
+    palloc_buddystat(nfree);
+}
+
+void run_test(void)
+{
+    buddy_test();
+}
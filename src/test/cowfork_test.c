@@ -0,0 +1,124 @@
+/**
+ * Test fork-style pgdir_clone(): last-level tables are shared until
+ * the first write, private pages become copy-on-write then, tables of
+ * shared mappings are copied, and freeing the pgdirs in any order
+ * drops every page exactly once.
+ */
+#include "test.h"
+#include "test_util.h"
+#include <common/debug.h>
+#include <kernel/exec1207.h>
+#include <kernel/mem.h>
+#include <kernel/mmap1217.h>
+#include <kernel/printk.h>
+#include <kernel/pt.h>
+#include <aarch64/mmu.h>
+
+/** Private pages, in a table of their own */
+#define PRIV_VA 0x200000
+/** Shared pages, in the next table */
+#define SHARED_VA 0x400000
+#define NPAGES 16
+
+static void *pages[NPAGES];
+
+static void add_section(struct pgdir *pd, u64 start, u32 flags)
+{
+    struct section *sec = alloc_section();
+    ASSERT(sec != NULL);
+    sec->start = start;
+    sec->npages = NPAGES;
+    sec->flags = flags;
+    pgdir_add_section(pd, sec);
+}
+
+static void *page_of(struct pgdir *pd, u64 va)
+{
+    PTEntry *pte = get_pte(pd, va, false);
+    ASSERT(pte != NULL && (*pte & PTE_VALID));
+    return (void *)P2K(PTE_ADDRESS(*pte));
+}
+
+static void cowfork_test(void)
+{
+    TEST_START;
+    struct pgdir a, b, c;
+    init_pgdir(&a);
+    add_section(&a, PRIV_VA, PF_R | PF_W);
+    add_section(&a, SHARED_VA, PF_R | PF_W | PF_S);
+    for (int i = 0; i < NPAGES; i++) {
+        pages[i] = kalloc_page();
+        ASSERT(pages[i] != NULL);
+        *(int *)pages[i] = i;
+        // keep one reference of our own to check the count at the end.
+        ASSERT(kshare_page(pages[i]) == pages[i]);
+        *get_pte(&a, PRIV_VA + i * PAGE_SIZE, true) =
+                K2P(pages[i]) | PTE_USER_DATA;
+    }
+    for (int i = 0; i < NPAGES; i++) {
+        void *pg = kalloc_page();
+        ASSERT(pg != NULL);
+        *get_pte(&a, SHARED_VA + i * PAGE_SIZE, true) =
+                K2P(pg) | PTE_USER_DATA;
+    }
+
+    init_pgdir(&b);
+    pgdir_clone(&b, &a);
+    // the private table is shared, entries and all.
+    PTEntry *pte = get_pte(&a, PRIV_VA, false);
+    ASSERT(get_pte(&b, PRIV_VA, false) == pte);
+    ASSERT((*pte & PTE_RO) == 0);
+    // the shared one is not, but maps the same pages writable.
+    pte = get_pte(&a, SHARED_VA, false);
+    ASSERT(get_pte(&b, SHARED_VA, false) != pte);
+    ASSERT(*get_pte(&b, SHARED_VA, false) == *pte);
+    ASSERT((*pte & PTE_RO) == 0);
+
+    // a write in b copies the table, and the pages become COW.
+    struct section *sec = section_search(&b, PRIV_VA);
+    ASSERT(sec != NULL && sec->start == PRIV_VA);
+    ASSERT(section_install(&b, sec, PRIV_VA, true) == 0);
+    pte = get_pte(&b, PRIV_VA, false);
+    ASSERT(pte != get_pte(&a, PRIV_VA, false));
+    ASSERT((*pte & PTE_RO) == 0 && page_of(&b, PRIV_VA) != pages[0]);
+    ASSERT(*(int *)page_of(&b, PRIV_VA) == 0);
+    for (int i = 1; i < NPAGES; i++) {
+        const u64 va = PRIV_VA + i * PAGE_SIZE;
+        ASSERT(*get_pte(&b, va, false) & PTE_RO);
+        ASSERT(*get_pte(&a, va, false) & PTE_RO);
+        ASSERT(page_of(&a, va) == pages[i] && page_of(&b, va) == pages[i]);
+    }
+
+    // a owns the old table alone now: a write takes it back.
+    pte = get_pte(&a, PRIV_VA, false);
+    ASSERT(get_pte(&a, PRIV_VA, true) == pte);
+
+    // a grandchild, then the parent goes first.
+    init_pgdir(&c);
+    pgdir_clone(&c, &b);
+    ASSERT(get_pte(&c, PRIV_VA, false) == get_pte(&b, PRIV_VA, false));
+    free_pgdir(&b);
+    for (int i = 1; i < NPAGES; i++) {
+        ASSERT(*(int *)page_of(&c, PRIV_VA + i * PAGE_SIZE) == i);
+    }
+    free_pgdir(&c);
+    free_pgdir(&a);
+
+    // only our own references are left.
+    for (int i = 0; i < NPAGES; i++) {
+        ASSERT(kpage_exclusive(pages[i]));
+        kfree_page(pages[i]);
+    }
+    TEST_END;
+}
+
+void test_init(void)
+{
+}
+
+void run_test()
+{
+    if (cpuid() == 0) {
+        cowfork_test();
+    }
+}
@@ -0,0 +1,156 @@
+/**
+ * Test fault-around and readahead of private file mappings, through
+ * section_fault() as the trap handler calls it. The file lives in
+ * memory: inodes.read is replaced, and counts the pages read.
+ * A sequential pass over a cold mapping reads each page once and
+ * faults about once per window, a backward pass over a warm one maps
+ * whole windows from the page cache, and a window of 0 set by
+ * mwindow() faults once per page.
+ */
+#include "test.h"
+#include "test_util.h"
+#include <common/debug.h>
+#include <common/string.h>
+#include <fs/file1206.h>
+#include <kernel/mem.h>
+#include <kernel/mmap1217.h>
+#include <kernel/pgcache.h>
+#include <kernel/printk.h>
+#include <kernel/proc.h>
+#include <kernel/pt.h>
+#include <aarch64/mmu.h>
+
+extern Proc root_proc;
+
+/** 1MB of file */
+#define NPAGES 256
+#define MAP_VA MMAP_MIN_ADDR
+
+static Inode ino;
+static int nread;
+static usize (*inode_read)(Inode *, u8 *, usize, usize);
+static void (*inode_lock_shared)(Inode *);
+static void (*inode_unlock_shared)(Inode *);
+
+// each page of the file holds its index plus one in its first word.
+static usize fake_read(Inode *inode, u8 *dest, usize offset, usize count)
+{
+    ASSERT(inode == &ino && offset % PAGE_SIZE == 0);
+    memset(dest, 0, count);
+    *(u64 *)dest = offset / PAGE_SIZE + 1;
+    nread++;
+    return count;
+}
+
+static void fake_lock(Inode *inode __attribute__((unused)))
+{
+}
+
+static void map_file(void)
+{
+    struct section *sec = alloc_section();
+    ASSERT(sec != NULL);
+    File *f = falloc();
+    ASSERT(f != NULL);
+    f->ino = &ino;
+    sec->start = MAP_VA;
+    sec->npages = NPAGES;
+    sec->flags = PF_R | PF_F;
+    sec->fobj = f;
+    sec->offset = 0;
+    sec->fsize = NPAGES * PAGE_SIZE;
+    pgdir_add_section(&thisproc()->pgdir, sec);
+}
+
+// read the page i of the mapping as a user load would.
+// @return whether it faulted.
+static bool touch(int i)
+{
+    const u64 va = MAP_VA + i * PAGE_SIZE;
+    PTEntry *pte = get_pte(&thisproc()->pgdir, va, false);
+    bool fault = pte == NULL || (*pte & PTE_VALID) == 0;
+    if (fault) {
+        ASSERT(section_fault(va, false) == 0);
+        pte = get_pte(&thisproc()->pgdir, va, false);
+    }
+    ASSERT(pte != NULL && (*pte & PTE_VALID) && (*pte & PTE_RO));
+    ASSERT(*(u64 *)P2K(PTE_ADDRESS(*pte)) == (u64)i + 1);
+    return fault;
+}
+
+static void faultaround_test(void)
+{
+    TEST_START;
+    Proc *p = thisproc();
+
+    // sequential, cold: read ahead one window at a time.
+    map_file();
+    u64 nfault = p->acct.nfault;
+    int nfault_seen = 0;
+    for (int i = 0; i < NPAGES; i++) {
+        nfault_seen += touch(i);
+    }
+    nfault = p->acct.nfault - nfault;
+    ASSERT(nfault == (u64)nfault_seen);
+    ASSERT(nfault <= NPAGES / (FAULT_AROUND_PAGES - 1) + 2);
+    ASSERT(nread == NPAGES);
+    printk("sequential: %lld faults for %d pages\n", (i64)nfault, NPAGES);
+    ASSERT(munmap((void *)MAP_VA, NPAGES * PAGE_SIZE) == 0);
+
+    // backward, warm: map the cached pages of the window of each fault.
+    map_file();
+    nfault = p->acct.nfault;
+    for (int i = NPAGES - 1; i >= 0; i--) {
+        touch(i);
+    }
+    nfault = p->acct.nfault - nfault;
+    ASSERT(nfault == NPAGES / FAULT_AROUND_PAGES);
+    ASSERT(nread == NPAGES);
+    printk("backward: %lld faults for %d pages\n", (i64)nfault, NPAGES);
+    ASSERT(munmap((void *)MAP_VA, NPAGES * PAGE_SIZE) == 0);
+
+    // no window: one page per fault, even if sequential and cached.
+    map_file();
+    ASSERT(mwindow((void *)MAP_VA, 0) == FAULT_AROUND_PAGES);
+    ASSERT(mwindow((void *)MAP_VA, -1) == 0);
+    nfault = p->acct.nfault;
+    for (int i = 0; i < NPAGES; i++) {
+        ASSERT(touch(i));
+    }
+    nfault = p->acct.nfault - nfault;
+    ASSERT(nfault == NPAGES);
+    ASSERT(munmap((void *)MAP_VA, NPAGES * PAGE_SIZE) == 0);
+
+    pgcache_drop(&ino);
+    inodes.read = inode_read;
+    inodes.lock_shared = inode_lock_shared;
+    inodes.unlock_shared = inode_unlock_shared;
+    TEST_END;
+}
+
+static void rt_entry()
+{
+    faultaround_test();
+    exit(0);
+}
+
+void test_init(void)
+{
+    ino.valid = true;
+    ino.entry.type = INODE_REGULAR;
+    ino.entry.num_bytes = NPAGES * PAGE_SIZE;
+    ino.pages = NULL;
+    nread = 0;
+    inode_read = inodes.read;
+    inode_lock_shared = inodes.lock_shared;
+    inode_unlock_shared = inodes.unlock_shared;
+    inodes.read = fake_read;
+    inodes.lock_shared = fake_lock;
+    inodes.unlock_shared = fake_lock;
+    root_proc.kcontext.x0 = (uint64_t)rt_entry;
+}
+
+void run_test()
+{
+    yield();
+}
@@ -6,8 +6,6 @@
 #include <kernel/printk.h>
 #include <test/test.h>
 
-extern RefCount kalloc_page_cnt;
-
 static RefCount x;
 static void *p[4][10000];
 static short sz[4][10000];
@@ -28,7 +26,7 @@ static short sz[4][10000];
 void kalloc_test()
 {
     int i = cpuid();
-    int r = kalloc_page_cnt.count;
+    int r = kalloc_page_count();
     int y = 10000 - i * 500;
     if (i == 0)
         printk("\n\nkalloc_test\n");
@@ -47,8 +45,8 @@ void kalloc_test()
         kfree_page(p[i][j]);
     }
     SYNC(2)
-    if (kalloc_page_cnt.count != r)
-        FAIL("FAIL: kalloc_page_cnt %d -> %lld\n", r, kalloc_page_cnt.count);
+    if (kalloc_page_count() != r)
+        FAIL("FAIL: kalloc_page_cnt %d -> %lld\n", r, kalloc_page_count());
     SYNC(3)
     for (int j = 0; j < 10000;) {
         if (j < 1000 || rand() > RAND_MAX / 16 * 7) {
@@ -97,7 +95,7 @@ void kalloc_test()
         for (int j = 0; j < 4; j++)
             for (int k = 0; k < 10000; k++)
                 z += sz[j][k];
-        printk("Total: %lld\nUsage: %lld\n", z, kalloc_page_cnt.count - r);
+        printk("Total: %lld\nUsage: %lld\n", z, kalloc_page_count() - r);
     }
     SYNC(5)
     for (int j = 0; j < 10000; j++)
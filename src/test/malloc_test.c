@@ -7,6 +7,8 @@
 #include <fdutil/stddef.h>
 
 #define NBLK 8
+/** malloc/free pairs of the throughput phase */
+#define NOPS 100000
 
 typedef struct range range_t;
 static range_t rgs[NBLK * NCPU];
@@ -34,10 +36,27 @@ static void malloc_test(void)
         // check intersection
         for (int i = 0; i < NBLK * NCPU; i++) {
             ASSERT(rg_find(&rgs[0], &rgs[i], NBLK * NCPU) == RG_ERR);
+            // blocks of other cpus go through the remote free path.
             free(rgs[i].start);
             rgs[i].valid = 0;
         }
     }
+    sync(2);
+
+    // throughput phase: all cpus hit the same size class.
+    u64 start = get_timestamp();
+    for (int i = 0; i < NOPS; i++) {
+        void *blk = malloc(32);
+        ASSERT(blk != NULL);
+        free(blk);
+    }
+    u64 elapse = get_timestamp() - start;
+    printk("cpu %d: %lld malloc/free pairs in %lld ticks\n", cpu,
+           (i64)NOPS, (i64)elapse);
+
+    // give cached blocks back, so that arenas are released.
+    malloc_drain();
+    sync(3);
 
     if (cpu == 0) {
         ASSERT(palloc_used() == 0);
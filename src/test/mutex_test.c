@@ -0,0 +1,153 @@
+/**
+ * Adaptive mutex: a proc on each cpu takes the same mutex for a short
+ * critical section. Holders are always running, so waiters should
+ * mostly spin rather than sleep. Then the same is done through the
+ * block cache: procs on each cpu acquire and release one cached block,
+ * on an in-memory device. The ticks per acquisition and the spin/sleep
+ * counts are printed for both.
+ */
+#include <kernel/proc.h>
+#include <kernel/sched.h>
+#include <kernel/printk.h>
+#include <common/mutex.h>
+#include <common/string.h>
+#include <fs/cache.h>
+#include <aarch64/intrinsic.h>
+
+#define NPROC NCPU
+/** Acquisitions by each proc */
+#define NITER 20000
+/** Length of the critical section, in loop iterations */
+#define NWORK 50
+
+extern Proc root_proc;
+static Mutex mtx;
+static u64 counter;
+static u64 start;
+
+/** The in-memory device: a log, then the block read by all */
+#define NDISK 32
+#define LOG_START 2
+#define NLOG 16
+#define HOT_BLOCK 24
+#define HOT_BYTE 0x5a
+
+static u8 disk[NDISK][BLOCK_SIZE];
+static int nhot_read;
+
+static void disk_read(usize block_no, u8 *buffer)
+{
+    ASSERT(block_no < NDISK);
+    if (block_no == HOT_BLOCK) {
+        __atomic_fetch_add(&nhot_read, 1, __ATOMIC_RELAXED);
+    }
+    memcpy(buffer, disk[block_no], BLOCK_SIZE);
+}
+
+static void disk_write(usize block_no, u8 *buffer)
+{
+    ASSERT(block_no < NDISK);
+    memcpy(disk[block_no], buffer, BLOCK_SIZE);
+}
+
+static const BlockDevice disk_device = { .read = disk_read,
+                                         .write = disk_write };
+static const SuperBlock disk_sb = { .num_blocks = NDISK,
+                                    .num_log_blocks = NLOG,
+                                    .log_start = LOG_START };
+
+static void pc_entry(u64 unused __attribute__((unused)))
+{
+    for (int i = 0; i < NITER; i++) {
+        acquire_mutex(&mtx);
+        ASSERT(holding_mutex(&mtx));
+        for (volatile int j = 0; j < NWORK; j++)
+            ;
+        counter++;
+        release_mutex(&mtx);
+    }
+    exit(0);
+}
+
+static void bc_entry(u64 unused __attribute__((unused)))
+{
+    for (int i = 0; i < NITER; i++) {
+        Block *b = bcache.acquire(HOT_BLOCK);
+        ASSERT(b->valid && b->data[0] == HOT_BYTE);
+        __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED);
+        bcache.release(b);
+    }
+    exit(0);
+}
+
+// time hits of one block, read by a proc on each cpu.
+static void bcache_hits()
+{
+    init_bcache(&disk_sb, &disk_device);
+    memset(disk[HOT_BLOCK], HOT_BYTE, BLOCK_SIZE);
+    struct mutex_stat st0, st;
+    mutex_stat(&st0);
+    counter = 0;
+    start = get_timestamp();
+    for (int i = 0; i < NPROC; i++) {
+        Proc *p = create_proc();
+        ASSERT(p != NULL);
+        start_proc(p, bc_entry, 0);
+    }
+    int code;
+    for (int i = 0; i < NPROC; i++) {
+        ASSERT(wait(&code) >= 0);
+    }
+    u64 elapse = get_timestamp() - start;
+    ASSERT(counter == (u64)NPROC * NITER);
+    // all but the first are hits.
+    ASSERT(nhot_read == 1);
+
+    mutex_stat(&st);
+    printk("bcache: %lld hits in %lld ticks, %lld ticks each\n",
+           (i64)counter, (i64)elapse, (i64)(elapse / counter));
+    printk("fast %lld, spin %lld, sleep %lld\n",
+           (i64)(st.nfast - st0.nfast), (i64)(st.nspin - st0.nspin),
+           (i64)(st.nsleep - st0.nsleep));
+}
+
+static void rt_entry()
+{
+    int code;
+    for (int i = 0; i < NPROC; i++) {
+        ASSERT(wait(&code) >= 0);
+    }
+    u64 elapse = get_timestamp() - start;
+    ASSERT(counter == (u64)NPROC * NITER);
+    ASSERT(try_acquire_mutex(&mtx));
+    ASSERT(!try_acquire_mutex(&mtx));
+    release_mutex(&mtx);
+
+    struct mutex_stat st;
+    mutex_stat(&st);
+    printk("%lld acquisitions in %lld ticks, %lld ticks each\n",
+           (i64)counter, (i64)elapse, (i64)(elapse / counter));
+    printk("fast %lld, spin %lld, sleep %lld\n", (i64)st.nfast,
+           (i64)st.nspin, (i64)st.nsleep);
+
+    bcache_hits();
+    printk("mutex test PASS\n");
+    exit(0);
+}
+
+void test_init()
+{
+    init_mutex(&mtx);
+    root_proc.kcontext.x0 = (uint64_t)rt_entry;
+    start = get_timestamp();
+    for (int i = 0; i < NPROC; i++) {
+        Proc *p = create_proc();
+        ASSERT(p != NULL);
+        start_proc(p, pc_entry, 0);
+    }
+}
+
+void run_test()
+{
+    yield();
+}
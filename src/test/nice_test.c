@@ -0,0 +1,75 @@
+/** This tests the fair-share scheduler.
+ *
+ * Each cpu gets a proc of nice 0 and a proc of nice 10, which
+ * do the same chunks of work and yield in between, until the
+ * deadline. Kernel code is not preempted, but every yield picks
+ * the proc with the smallest vruntime, so the nice 0 procs should
+ * get most of the chunks.
+ *
+ * See kernel/config.h for more info.
+ */
+
+#define NPROC (2 * NCPU)
+#define NSPIN 1000
+/** Run time of each proc, in ms */
+#define RUN_MS 500
+
+#include <kernel/sched.h>
+#include <kernel/printk.h>
+#include <aarch64/intrinsic.h>
+
+extern Proc root_proc;
+Proc *pr[NPROC];
+static volatile u64 nchunk[NPROC];
+static u64 deadline;
+
+static void pc_entry(u64 i)
+{
+    while (get_timestamp() < deadline) {
+        for (volatile int j = 0; j < NSPIN; j++)
+            ;
+        nchunk[i]++;
+        yield();
+    }
+    exit(0);
+}
+
+static void rt_entry()
+{
+    int code;
+    for (int i = 0; i < NPROC; i++) {
+        ASSERT(wait(&code) >= 0);
+    }
+    u64 hi = 0, lo = 0;
+    for (int i = 0; i < NPROC; i++) {
+        if (i < NCPU) {
+            hi += nchunk[i];
+        } else {
+            lo += nchunk[i];
+        }
+    }
+    printk("nice 0: %lld chunks, nice 10: %lld chunks\n", (i64)hi, (i64)lo);
+    sched_dump();
+    ASSERT(hi > lo);
+    exit(0);
+}
+
+void test_init()
+{
+    root_proc.kcontext.x0 = (uint64_t)rt_entry;
+    deadline = get_timestamp() + get_clock_frequency() * RUN_MS / 1000;
+
+    // new procs start on the shortest queue, so the first NCPU
+    // procs and the last NCPU procs spread over the cpus.
+    for (int i = 0; i < NPROC; i++) {
+        pr[i] = create_proc();
+        ASSERT(pr[i] != NULL);
+        ASSERT(set_nice(pr[i], i < NCPU ? 0 : 10) == (i < NCPU ? 0 : 10));
+        start_proc(pr[i], pc_entry, i);
+    }
+}
+
+void run_test()
+{
+    yield();
+}
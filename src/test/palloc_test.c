@@ -1,5 +1,6 @@
 #include "test.h"
 #include "test_util.h"
+#include "sync.h"
 #include <aarch64/intrinsic.h>
 #include <common/debug.h>
 #include <fdutil/palloc.h>
@@ -8,6 +9,13 @@
 #define NALLOC 16
 static void *pages[NALLOC * NCPU];
 
+/** References each cpu takes on the shared page, beyond a u8 count */
+#define NSHARE 1000
+static void *shared;
+
+/** Pages used before the test starts */
+static size_t nused;
+
 /** Smoke test for palloc */
 static void palloc_test(void)
 {
@@ -37,8 +45,38 @@ static void palloc_test(void)
 
     // free null pointer.
     palloc_free(NULL);
+    sync(1);
 
+    // share one page far beyond the per-page count: no copies.
     if (cpu == 0) {
+        shared = palloc_get();
+        ASSERT(shared != NULL);
+    }
+    sync(2);
+    for (int i = 0; i < NSHARE; i++) {
+        ASSERT(palloc_share(shared) == shared);
+    }
+    for (int i = 0; i < NSHARE; i++) {
+        palloc_free(shared);
+    }
+    sync(3);
+
+    if (cpu == 0) {
+        struct palloc_ovfstat ost;
+        palloc_ovfstat(&ost);
+        ASSERT(ost.npg == 0 && ost.ncopy == 0 && ost.nops > 0);
+        palloc_free(shared);
+
+        // freed pages stay in the magazines, but are not used.
+        ASSERT(palloc_used() == nused);
+        struct palloc_pcpstat st;
+        for (int i = 0; i < NCPU; i++) {
+            palloc_pcpstat(i, &st);
+            printk("cpu %d: %lld cached, %lld hits, %lld refills, "
+                   "%lld drains\n",
+                   i, (i64)st.npg, (i64)st.nhit, (i64)st.nrefill,
+                   (i64)st.ndrain);
+        }
         TEST_END;
     }
 }
@@ -50,4 +88,6 @@ void run_test(void)
 
 void test_init(void)
 {
+    sync_init();
+    nused = palloc_used();
 }
\ No newline at end of file
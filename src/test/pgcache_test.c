@@ -0,0 +1,183 @@
+/**
+ * Test the page cache behind demand-paged executables: pgdirs mapping
+ * the same file read-only share one physical page per file page, a
+ * write to a private writable mapping copies the cached page, and once
+ * the content changes and the cache is dropped, as inode_write() does,
+ * new faults see the new content while old mappings keep theirs.
+ * The file lives in memory: inodes.read is replaced, and counts the
+ * pages read.
+ */
+#include "test.h"
+#include "test_util.h"
+#include <common/debug.h>
+#include <common/string.h>
+#include <fs/file1206.h>
+#include <kernel/exec1207.h>
+#include <kernel/mem.h>
+#include <kernel/mmap1217.h>
+#include <kernel/pgcache.h>
+#include <kernel/printk.h>
+#include <kernel/pt.h>
+#include <aarch64/mmu.h>
+
+#define NPAGES 4
+#define TEXT_VA 0x400000
+#define DATA_VA 0x800000
+
+static Inode ino;
+static int nread;
+/** Bumped when the content of the file changes */
+static u64 gen;
+static InodeTree saved;
+
+// each page of the file holds its generation and index in its first word.
+static usize fake_read(Inode *inode, u8 *dest, usize offset, usize count)
+{
+    ASSERT(inode == &ino && offset % PAGE_SIZE == 0);
+    memset(dest, 0, count);
+    *(u64 *)dest = gen << 32 | (offset / PAGE_SIZE + 1);
+    nread++;
+    return count;
+}
+
+static Inode *fake_share(Inode *inode)
+{
+    return inode;
+}
+
+static void fake_put(OpContext *ctx __attribute__((unused)),
+                     Inode *inode __attribute__((unused)))
+{
+}
+
+static void fake_lock(Inode *inode __attribute__((unused)))
+{
+}
+
+static struct section *map_file(struct pgdir *pd, File *f, u64 start,
+                                u32 flags)
+{
+    struct section *sec = alloc_section();
+    ASSERT(sec != NULL);
+    sec->start = start;
+    sec->npages = NPAGES;
+    sec->flags = flags | PF_F;
+    sec->fobj = fshare(f);
+    sec->offset = 0;
+    sec->fsize = NPAGES * PAGE_SIZE;
+    pgdir_add_section(pd, sec);
+    return sec;
+}
+
+static PTEntry fault(struct pgdir *pd, struct section *sec, u64 va,
+                     bool write)
+{
+    ASSERT(section_install(pd, sec, va, write) == 0);
+    PTEntry *pte = get_pte(pd, va, false);
+    ASSERT(pte != NULL && (*pte & PTE_VALID));
+    return *pte;
+}
+
+static u64 word_of(PTEntry pte)
+{
+    return *(u64 *)P2K(PTE_ADDRESS(pte));
+}
+
+static void pgcache_test(void)
+{
+    TEST_START;
+    File *f = falloc();
+    ASSERT(f != NULL);
+    f->type = FD_INODE;
+    f->ino = &ino;
+    f->readable = true;
+
+    struct pgdir a, b, c;
+    init_pgdir(&a);
+    init_pgdir(&b);
+    struct section *ta = map_file(&a, f, TEXT_VA, PF_R | PF_X);
+    struct section *tb = map_file(&b, f, TEXT_VA, PF_R | PF_X);
+    struct section *da = map_file(&a, f, DATA_VA, PF_R | PF_W);
+    struct section *db = map_file(&b, f, DATA_VA, PF_R | PF_W);
+
+    // text: both pgdirs map the same page, read once.
+    for (int i = 0; i < NPAGES; i++) {
+        const u64 va = TEXT_VA + i * PAGE_SIZE;
+        PTEntry pa = fault(&a, ta, va, false);
+        PTEntry pb = fault(&b, tb, va, false);
+        ASSERT(PTE_ADDRESS(pa) == PTE_ADDRESS(pb));
+        ASSERT((pa & PTE_RO) && (pb & PTE_RO));
+        ASSERT(word_of(pa) == (u64)i + 1);
+    }
+    ASSERT(nread == NPAGES);
+
+    // private writable data: read from the cache like text.
+    PTEntry text0 = *get_pte(&a, TEXT_VA, false);
+    PTEntry pa = fault(&a, da, DATA_VA, false);
+    ASSERT(PTE_ADDRESS(pa) == PTE_ADDRESS(text0) && (pa & PTE_RO));
+
+    // a write copies it, the cache and b still see the file.
+    pa = fault(&a, da, DATA_VA, true);
+    ASSERT(PTE_ADDRESS(pa) != PTE_ADDRESS(text0) && (pa & PTE_RO) == 0);
+    ASSERT(word_of(pa) == 1);
+    *(u64 *)P2K(PTE_ADDRESS(pa)) = 0xdead;
+    PTEntry pb = fault(&b, db, DATA_VA, false);
+    ASSERT(PTE_ADDRESS(pb) == PTE_ADDRESS(text0) && word_of(pb) == 1);
+
+    // a first write maps the cached page, the retried write copies it.
+    const u64 va1 = DATA_VA + PAGE_SIZE;
+    PTEntry text1 = *get_pte(&b, TEXT_VA + PAGE_SIZE, false);
+    pb = fault(&b, db, va1, true);
+    ASSERT(PTE_ADDRESS(pb) == PTE_ADDRESS(text1) && (pb & PTE_RO));
+    pb = fault(&b, db, va1, true);
+    ASSERT(PTE_ADDRESS(pb) != PTE_ADDRESS(text1) && (pb & PTE_RO) == 0);
+    ASSERT(word_of(pb) == 2 && word_of(text1) == 2);
+    ASSERT(nread == NPAGES);
+
+    // the file changes: old mappings keep their pages, new faults
+    // read the new content.
+    gen = 1;
+    pgcache_drop(&ino);
+    init_pgdir(&c);
+    struct section *tc = map_file(&c, f, TEXT_VA, PF_R | PF_X);
+    PTEntry pc = fault(&c, tc, TEXT_VA, false);
+    ASSERT(PTE_ADDRESS(pc) != PTE_ADDRESS(text0));
+    ASSERT(word_of(pc) == (1ull << 32 | 1));
+    ASSERT(word_of(text0) == 1);
+    ASSERT(nread == NPAGES + 1);
+    pb = fault(&b, db, DATA_VA + 2 * PAGE_SIZE, false);
+    ASSERT(word_of(pb) == (1ull << 32 | 3));
+
+    free_pgdir(&a);
+    free_pgdir(&b);
+    free_pgdir(&c);
+    pgcache_drop(&ino);
+    fclose(f);
+    TEST_END;
+}
+
+void test_init(void)
+{
+    ino.valid = true;
+    ino.entry.type = INODE_REGULAR;
+    ino.entry.num_bytes = NPAGES * PAGE_SIZE;
+    ino.pages = NULL;
+    nread = 0;
+    gen = 0;
+    saved = inodes;
+    inodes.read = fake_read;
+    inodes.share = fake_share;
+    inodes.put = fake_put;
+    inodes.lock = fake_lock;
+    inodes.unlock = fake_lock;
+    inodes.lock_shared = fake_lock;
+    inodes.unlock_shared = fake_lock;
+}
+
+void run_test()
+{
+    if (cpuid() == 0) {
+        pgcache_test();
+        inodes = saved;
+    }
+}
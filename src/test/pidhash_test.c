@@ -0,0 +1,78 @@
+/**
+ * Pid hash and zombie queue: root starts many procs, each sleeping on
+ * a semaphore that is never posted, then kills them one by one by pid
+ * and waits for all of them. Killing and reaping should not get slower
+ * as the number of procs grows. The ticks per kill and per wait are
+ * printed.
+ */
+#include <kernel/proc.h>
+#include <kernel/sched.h>
+#include <kernel/printk.h>
+#include <aarch64/intrinsic.h>
+
+#define NPROC 1000
+
+extern Proc root_proc;
+static Semaphore never;
+static int pids[NPROC];
+static volatile int nsleep;
+
+static void sleeper_entry(u64 i)
+{
+    __atomic_add_fetch(&nsleep, 1, __ATOMIC_SEQ_CST);
+    // only returns when alerted by kill().
+    ASSERT(!wait_sem(&never));
+    ASSERT(thisproc()->killed);
+    exit((int)i);
+}
+
+static void rt_entry()
+{
+    while (nsleep < NPROC) {
+        yield();
+    }
+    ASSERT(kill(-1) == -1);
+
+    // kill the last started first, the worst case for a tree walk.
+    u64 start = get_timestamp();
+    for (int i = NPROC - 1; i >= 0; i--) {
+        ASSERT(kill(pids[i]) == 0);
+    }
+    u64 tkill = get_timestamp() - start;
+
+    start = get_timestamp();
+    static bool seen[NPROC];
+    for (int i = 0; i < NPROC; i++) {
+        int code;
+        int pid = wait(&code);
+        ASSERT(code >= 0 && code < NPROC);
+        ASSERT(pid == pids[code] && !seen[code]);
+        seen[code] = true;
+    }
+    u64 twait = get_timestamp() - start;
+    int code;
+    ASSERT(wait(&code) == -1);
+    // reaped procs are gone from the hash.
+    ASSERT(kill(pids[0]) == -1);
+
+    printk("%d procs: %lld ticks per kill, %lld ticks per wait\n", NPROC,
+           (i64)(tkill / NPROC), (i64)(twait / NPROC));
+    printk("pidhash test PASS\n");
+    exit(0);
+}
+
+void test_init()
+{
+    init_sem(&never, 0);
+    root_proc.kcontext.x0 = (uint64_t)rt_entry;
+    for (int i = 0; i < NPROC; i++) {
+        Proc *p = create_proc();
+        ASSERT(p != NULL);
+        pids[i] = start_proc(p, sleeper_entry, i);
+    }
+}
+
+void run_test()
+{
+    yield();
+}
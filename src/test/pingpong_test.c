@@ -0,0 +1,74 @@
+/**
+ * Context-switch latency: two procs bounce a token through a pair
+ * of semaphores. Sleeping must not touch the allocator, so the
+ * malloc counters stay the same over the whole run.
+ */
+#include <kernel/proc.h>
+#include <kernel/sched.h>
+#include <kernel/printk.h>
+#include <common/sem.h>
+#include <fdutil/malloc.h>
+#include <aarch64/intrinsic.h>
+
+/** Round trips */
+#define NROUND 10000
+
+static Semaphore ping, pong;
+static Proc *pping, *ppong;
+
+// allocations served by all cpus
+static u64 malloc_ops(void)
+{
+    u64 ret = 0;
+    for (int i = 0; i < NCPU; i++) {
+        struct malloc_stat st;
+        malloc_stat(i, &st);
+        ret += st.nhit + st.nrefill;
+    }
+    return ret;
+}
+
+static void ping_entry(u64 unused __attribute__((unused)))
+{
+    u64 nops = malloc_ops();
+    u64 start = get_timestamp();
+    for (int i = 0; i < NROUND; i++) {
+        post_sem(&ping);
+        unalertable_wait_sem(&pong);
+    }
+    u64 elapse = get_timestamp() - start;
+    ASSERT(malloc_ops() == nops);
+    printk("%lld round trips in %lld ticks, %lld ticks each\n",
+           (i64)NROUND, (i64)elapse, (i64)(elapse / NROUND));
+    printk("pingpong test PASS\n");
+    exit(0);
+}
+
+static void pong_entry(u64 unused __attribute__((unused)))
+{
+    for (int i = 0; i < NROUND; i++) {
+        unalertable_wait_sem(&ping);
+        post_sem(&pong);
+    }
+    exit(0);
+}
+
+void test_init(void)
+{
+    init_sem(&ping, 0);
+    init_sem(&pong, 0);
+    pping = create_proc();
+    ppong = create_proc();
+    ASSERT(pping != NULL && ppong != NULL);
+    start_proc(ppong, pong_entry, 0);
+    start_proc(pping, ping_entry, 0);
+}
+
+void run_test()
+{
+    if (cpuid() == 0) {
+        printk("pingpong test\n");
+    }
+    yield();
+    release_sched_lock();
+}
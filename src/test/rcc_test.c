@@ -1,8 +1,9 @@
-/** This tests the implementation of RCC configuration.
+/** This tests the per-cpu run queues.
  * 
  * We create several(but not many) threads, ideally given 
  * enough time, they will be scheduled to multiple cores
- * to run.
+ * to run. The elapsed ticks and the queue statistics of
+ * each cpu are printed at the end.
  * 
  * See kernel/config.h for more info.
  */
@@ -11,9 +12,11 @@
 #define NPROC 8
 
 #include <kernel/sched.h>
+#include <aarch64/intrinsic.h>
 
 extern Proc root_proc;
 Proc *pr[NPROC];
+static u64 start;
 
 static void pc_entry()
 {
@@ -34,12 +37,16 @@ static void rt_entry()
         ASSERT(pid >= 0);
         printk("(%d) excited with %d.\n", pid, code);
     }
+    printk("%d procs done in %lld ticks\n", NPROC,
+           (i64)(get_timestamp() - start));
+    sched_dump();
     exit(0);
 }
 
 void test_init()
 {
     root_proc.kcontext.x0 = (uint64_t)rt_entry;
+    start = get_timestamp();
 
     for (int i = 0; i < NPROC; i++) {
         pr[i] = create_proc();
@@ -0,0 +1,72 @@
+/**
+ * Test memory reclaim: pages held by caches come back
+ * through the shrinkers, and are accounted per shrinker.
+ */
+#include "test.h"
+#include "test_util.h"
+#include "sync.h"
+#include <common/debug.h>
+#include <kernel/mem.h>
+#include <kernel/printk.h>
+#include <kernel/reclaim.h>
+#include <kernel/slab.h>
+#include <fdutil/palloc.h>
+#include <fdutil/stddef.h>
+
+/** Objects each cpu allocates */
+#define NOBJ 256
+
+struct obj {
+    char data[500];
+};
+
+static KmemCache obj_cache = KMEM_CACHE_INIT("reclaim_test", struct obj, NULL);
+static void *objs[NCPU][NOBJ];
+
+static void reclaim_test(void)
+{
+    TEST_START;
+    const int cpu = cpuid();
+
+    // leave spare slabs and zeroed pages behind.
+    for (int i = 0; i < NOBJ; i++) {
+        objs[cpu][i] = kmem_cache_alloc(&obj_cache);
+        ASSERT(objs[cpu][i] != NULL);
+    }
+    for (int i = 0; i < NOBJ; i++) {
+        kmem_cache_free(&obj_cache, objs[cpu][i]);
+    }
+    while (fill_zeroed_pages())
+        ;
+    sync(1);
+
+    if (cpu == 0) {
+        struct kmem_cache_stat st;
+        kmem_cache_stat(&obj_cache, &st);
+        ASSERT(st.active == 0 && st.slabs > 0);
+        usize nfree = palloc_nfree();
+
+        usize n = reclaim_pages(palloc_npage());
+        ASSERT(n > 0);
+        ASSERT(palloc_nfree() >= nfree);
+        kmem_cache_stat(&obj_cache, &st);
+        ASSERT(st.slabs == 0);
+
+        struct reclaim_stat rst;
+        reclaim_stat(&rst);
+        ASSERT(rst.ndirect == 1 && rst.nfail == 0);
+        reclaim_dump();
+        TEST_END;
+    }
+}
+
+void test_init(void)
+{
+    sync_init();
+    init_reclaim();
+}
+
+void run_test()
+{
+    reclaim_test();
+}
@@ -0,0 +1,100 @@
+/**
+ * Reader-writer lock: a proc on each cpu but one reads under the shared
+ * side over and over, like procs reading the same binary, while the last
+ * one writes now and then. Readers must overlap, a writer must be alone,
+ * and with writer preference the writer is not starved by the readers.
+ * The most readers seen at once and the sleep counts are printed.
+ */
+#include <kernel/proc.h>
+#include <kernel/sched.h>
+#include <kernel/printk.h>
+#include <common/rwlock.h>
+#include <aarch64/intrinsic.h>
+
+#define NREADER (NCPU - 1)
+/** Acquisitions by each reader */
+#define NREAD 20000
+/** Acquisitions by the writer */
+#define NWRITE 200
+/** Length of the critical section, in loop iterations */
+#define NWORK 200
+
+extern Proc root_proc;
+static RWLock rw;
+static volatile int inside, max_inside;
+static volatile bool writing;
+static volatile int nreader_done;
+static int writes_before_done;
+
+static void reader_entry(u64 unused __attribute__((unused)))
+{
+    for (int i = 0; i < NREAD; i++) {
+        acquire_rwlock_read(&rw);
+        ASSERT(!writing);
+        int n = __atomic_add_fetch(&inside, 1, __ATOMIC_SEQ_CST);
+        if (n > max_inside)
+            max_inside = n;
+        for (volatile int j = 0; j < NWORK; j++)
+            ;
+        __atomic_sub_fetch(&inside, 1, __ATOMIC_SEQ_CST);
+        release_rwlock_read(&rw);
+    }
+    __atomic_add_fetch(&nreader_done, 1, __ATOMIC_SEQ_CST);
+    exit(0);
+}
+
+static void writer_entry(u64 unused __attribute__((unused)))
+{
+    for (int i = 0; i < NWRITE; i++) {
+        acquire_rwlock_write(&rw);
+        ASSERT(holding_rwlock_write(&rw));
+        ASSERT(inside == 0);
+        writing = true;
+        for (volatile int j = 0; j < NWORK; j++)
+            ;
+        writing = false;
+        if (nreader_done == 0)
+            writes_before_done++;
+        release_rwlock_write(&rw);
+        for (volatile int j = 0; j < NWORK * 10; j++)
+            ;
+    }
+    exit(0);
+}
+
+static void rt_entry()
+{
+    int code;
+    for (int i = 0; i < NREADER + 1; i++) {
+        ASSERT(wait(&code) >= 0);
+    }
+    ASSERT(NREADER < 2 || max_inside > 1);
+
+    struct rwlock_stat st;
+    rwlock_stat(&st);
+    printk("max readers at once %d, writes while reading %d/%d\n",
+           max_inside, writes_before_done, NWRITE);
+    printk("read %lld, write %lld, reader sleep %lld, writer sleep %lld\n",
+           (i64)st.nread, (i64)st.nwrite, (i64)st.nrsleep, (i64)st.nwsleep);
+    printk("rwlock test PASS\n");
+    exit(0);
+}
+
+void test_init()
+{
+    init_rwlock(&rw, true);
+    root_proc.kcontext.x0 = (uint64_t)rt_entry;
+    for (int i = 0; i < NREADER; i++) {
+        Proc *p = create_proc();
+        ASSERT(p != NULL);
+        start_proc(p, reader_entry, 0);
+    }
+    Proc *p = create_proc();
+    ASSERT(p != NULL);
+    start_proc(p, writer_entry, 0);
+}
+
+void run_test()
+{
+    yield();
+}
@@ -0,0 +1,103 @@
+/**
+ * Test the typed object caches: objects come back constructed,
+ * never overlap, and the statistics add up after all are freed.
+ */
+#include "test.h"
+#include "test_util.h"
+#include "range.h"
+#include "sync.h"
+#include <common/debug.h>
+#include <kernel/printk.h>
+#include <kernel/slab.h>
+#include <fdutil/stddef.h>
+
+/** Objects each cpu allocates */
+#define NOBJ 64
+/** Rounds of alloc/free */
+#define NROUND 4
+
+#define OBJ_MAGIC 0x0b1ec7
+
+struct obj {
+    int magic; // set by the constructor, must survive a free
+    int owner; // cpu that allocated it
+    char pad[232];
+};
+
+/** Number of constructor calls */
+static volatile u64 nctor;
+
+static void obj_ctor(void *p)
+{
+    struct obj *o = p;
+    o->magic = OBJ_MAGIC;
+    o->owner = -1;
+    __atomic_add_fetch(&nctor, 1, __ATOMIC_RELAXED);
+}
+
+static KmemCache obj_cache = KMEM_CACHE_INIT("slab_test", struct obj, obj_ctor);
+
+typedef struct range range_t;
+static range_t rgs[NOBJ * NCPU];
+
+static void slab_test(void)
+{
+    TEST_START;
+    const int cpu = cpuid();
+
+    for (int r = 0; r < NROUND; r++) {
+        // alloc phase
+        for (int i = 0; i < NOBJ; i++) {
+            struct obj *o = kmem_cache_alloc(&obj_cache);
+            ASSERT(o != NULL);
+            ASSERT(o->magic == OBJ_MAGIC && o->owner == -1);
+            o->owner = cpu;
+            const int idx = i + NOBJ * cpu;
+            rgs[idx].valid = 1;
+            rgs[idx].size = sizeof(struct obj);
+            rgs[idx].start = o;
+        }
+        sync(1 + 2 * r);
+
+        if (cpu == 0) {
+            struct kmem_cache_stat st;
+            kmem_cache_stat(&obj_cache, &st);
+            ASSERT(st.active == NOBJ * NCPU);
+            for (int i = 0; i < NOBJ * NCPU; i++) {
+                ASSERT(rg_find(&rgs[0], &rgs[i], NOBJ * NCPU) == RG_ERR);
+            }
+        }
+
+        // free phase: give back in the constructed state.
+        for (int i = 0; i < NOBJ; i++) {
+            struct obj *o = rgs[i + NOBJ * cpu].start;
+            ASSERT(o->owner == cpu);
+            o->owner = -1;
+            kmem_cache_free(&obj_cache, o);
+        }
+        sync(2 + 2 * r);
+    }
+
+    if (cpu == 0) {
+        struct kmem_cache_stat st;
+        kmem_cache_stat(&obj_cache, &st);
+        ASSERT(st.active == 0);
+        ASSERT(st.free > 0 && st.slabs > 0);
+        // objects are constructed when their slab is created.
+        ASSERT(nctor >= (u64)NOBJ * NCPU);
+        printk("%lld constructor calls for %lld allocations\n", (i64)nctor,
+               (i64)NOBJ * NCPU * NROUND);
+        kmem_cache_dump();
+        TEST_END;
+    }
+}
+
+void test_init(void)
+{
+    sync_init();
+}
+
+void run_test()
+{
+    slab_test();
+}
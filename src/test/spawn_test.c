@@ -0,0 +1,257 @@
+/**
+ * Test spawn(): a child built straight from an executable inherits all
+ * open files without a map, exactly the mapped ones with a map, and a
+ * path that cannot be loaded fails without leaving a child or a
+ * reference behind. The file system lives in memory: the root
+ * directory holds "prog", a program spinning in user space, and "bad",
+ * which is not an ELF. Inode references are counted by number.
+ */
+#include "test.h"
+#include "test_util.h"
+#include <common/debug.h>
+#include <common/list.h>
+#include <common/string.h>
+#include <fs/file1206.h>
+#include <kernel/exec1207.h>
+#include <kernel/mem.h>
+#include <kernel/pgcache.h>
+#include <kernel/printk.h>
+#include <kernel/proc.h>
+
+extern Proc root_proc;
+
+#define DIR_NO 1
+#define PROG_NO 2
+#define BAD_NO 3
+#define NFILE 4
+
+/** The program: one text page at PROG_VA, after the headers */
+#define PROG_VA 0x400000
+#define PROG_SIZE (2 * PAGE_SIZE)
+/** b . */
+#define INSN_SPIN 0x14000000u
+
+static Inode files[NFILE];
+static int nref[NFILE];
+static u8 image[PROG_SIZE];
+static InodeTree saved;
+
+static usize fake_read(Inode *inode, u8 *dest, usize offset, usize count)
+{
+    ASSERT(offset + count <= inode->entry.num_bytes);
+    if (inode == &files[PROG_NO]) {
+        memcpy(dest, image + offset, count);
+    } else {
+        memset(dest, 0, count);
+    }
+    return count;
+}
+
+static usize fake_lookup(Inode *inode, const char *name, usize *index)
+{
+    ASSERT(inode == &files[DIR_NO] && index == NULL);
+    if (strncmp(name, "prog", FILE_NAME_MAX_LENGTH) == 0) {
+        return PROG_NO;
+    }
+    if (strncmp(name, "bad", FILE_NAME_MAX_LENGTH) == 0) {
+        return BAD_NO;
+    }
+    return 0;
+}
+
+static Inode *fake_get(usize inode_no)
+{
+    ASSERT(inode_no > 0 && inode_no < NFILE);
+    __atomic_fetch_add(&nref[inode_no], 1, __ATOMIC_RELAXED);
+    return &files[inode_no];
+}
+
+static Inode *fake_share(Inode *inode)
+{
+    __atomic_fetch_add(&nref[inode - files], 1, __ATOMIC_RELAXED);
+    return inode;
+}
+
+static void fake_put(OpContext *ctx __attribute__((unused)), Inode *inode)
+{
+    int n = __atomic_sub_fetch(&nref[inode - files], 1, __ATOMIC_RELAXED);
+    ASSERT(n >= 0);
+}
+
+static void fake_lock(Inode *inode __attribute__((unused)))
+{
+}
+
+static void build_image(void)
+{
+    Elf64_Ehdr *eh = (Elf64_Ehdr *)image;
+    eh->e_ident[0] = 0x7f;
+    eh->e_ident[1] = 'E';
+    eh->e_ident[2] = 'L';
+    eh->e_ident[3] = 'F';
+    eh->e_machine = EM_AARCH64;
+    eh->e_entry = PROG_VA;
+    eh->e_phoff = sizeof(Elf64_Ehdr);
+    eh->e_phentsize = sizeof(Elf64_Phdr);
+    eh->e_phnum = 1;
+
+    Elf64_Phdr *ph = (Elf64_Phdr *)(image + eh->e_phoff);
+    ph->p_type = PT_LOAD;
+    ph->p_flags = PF_R | PF_X;
+    ph->p_offset = PAGE_SIZE;
+    ph->p_vaddr = PROG_VA;
+    ph->p_filesz = ph->p_memsz = sizeof(u32);
+    ph->p_align = PAGE_SIZE;
+
+    *(u32 *)(image + PAGE_SIZE) = INSN_SPIN;
+}
+
+static Proc *child_of(int pid)
+{
+    Proc *p = thisproc(), *ret = NULL;
+    acquire_spinlock(&p->lock);
+    for (struct list_elem *e = list_begin(&p->children);
+         e != list_end(&p->children); e = list_next(e)) {
+        Proc *c = list_entry(e, Proc, ptnode);
+        if (c->pid == pid) {
+            ret = c;
+        }
+    }
+    release_spinlock(&p->lock);
+    ASSERT(ret != NULL);
+    return ret;
+}
+
+static bool no_child(void)
+{
+    Proc *p = thisproc();
+    acquire_spinlock(&p->lock);
+    bool ret = list_empty(&p->children) && list_empty(&p->zombies);
+    release_spinlock(&p->lock);
+    return ret;
+}
+
+// kill the spinning child and wait for it. Only its own syscalls
+// touch its open files, and a killed proc does not close them, so
+// they are dropped here.
+static void reap(int pid)
+{
+    Proc *c = child_of(pid);
+    for (int i = 0; i < MAXOFILE; i++) {
+        if (c->ofile.ofile[i] != NULL) {
+            fclose(c->ofile.ofile[i]);
+            c->ofile.ofile[i] = NULL;
+        }
+    }
+    ASSERT(kill(pid) == 0);
+    int code;
+    ASSERT(wait(&code) == pid);
+    ASSERT(code == -1);
+}
+
+static void spawn_test(void)
+{
+    TEST_START;
+    Proc *p = thisproc();
+    char *argv[] = { "prog", "-x", NULL };
+    File *f[3];
+    for (int i = 0; i < 3; i++) {
+        f[i] = falloc();
+        ASSERT(f[i] != NULL);
+        p->ofile.ofile[i] = f[i];
+    }
+
+    // errors: no such file, not an executable.
+    ASSERT(spawn("none", argv, NULL, 0) == -1);
+    ASSERT(spawn("bad", argv, NULL, 0) == -1);
+    ASSERT(nref[PROG_NO] == 0 && nref[BAD_NO] == 0);
+    ASSERT(no_child());
+    for (int i = 0; i < 3; i++) {
+        ASSERT(f[i]->ref == 1);
+    }
+
+    // no map: every open file is inherited.
+    int pid = spawn("prog", argv, NULL, 0);
+    ASSERT(pid > 0);
+    Proc *c = child_of(pid);
+    for (int i = 0; i < MAXOFILE; i++) {
+        ASSERT(c->ofile.ofile[i] == (i < 3 ? f[i] : NULL));
+    }
+    for (int i = 0; i < 3; i++) {
+        ASSERT(f[i]->ref == 2);
+    }
+    reap(pid);
+
+    // child fd i is fd fdmap[i], negative ones are closed.
+    const int swap[] = { 2, -1, 0 };
+    pid = spawn("prog", argv, swap, 3);
+    ASSERT(pid > 0);
+    c = child_of(pid);
+    ASSERT(c->ofile.ofile[0] == f[2]);
+    ASSERT(c->ofile.ofile[1] == NULL);
+    ASSERT(c->ofile.ofile[2] == f[0]);
+    ASSERT(f[0]->ref == 2 && f[1]->ref == 1 && f[2]->ref == 2);
+    reap(pid);
+
+    // fds past nfd are closed.
+    const int one[] = { 1 };
+    pid = spawn("prog", argv, one, 1);
+    ASSERT(pid > 0);
+    c = child_of(pid);
+    for (int i = 0; i < MAXOFILE; i++) {
+        ASSERT(c->ofile.ofile[i] == (i == 0 ? f[1] : NULL));
+    }
+    reap(pid);
+
+    // the children dropped the program with their pgdirs.
+    ASSERT(no_child());
+    ASSERT(nref[PROG_NO] == 0);
+    for (int i = 0; i < 3; i++) {
+        ASSERT(f[i]->ref == 1);
+        fclose(f[i]);
+        p->ofile.ofile[i] = NULL;
+    }
+
+    pgcache_drop(&files[PROG_NO]);
+    p->cwd = NULL;
+    inodes = saved;
+    TEST_END;
+}
+
+static void rt_entry()
+{
+    spawn_test();
+    exit(0);
+}
+
+void test_init(void)
+{
+    for (int i = 1; i < NFILE; i++) {
+        files[i].valid = true;
+        files[i].entry.type = i == DIR_NO ? INODE_DIRECTORY : INODE_REGULAR;
+        files[i].entry.num_bytes = PROG_SIZE;
+        files[i].pages = NULL;
+        nref[i] = 0;
+    }
+    build_image();
+
+    saved = inodes;
+    inodes.root = &files[DIR_NO];
+    inodes.read = fake_read;
+    inodes.lookup = fake_lookup;
+    inodes.get = fake_get;
+    inodes.share = fake_share;
+    inodes.put = fake_put;
+    inodes.lock = fake_lock;
+    inodes.unlock = fake_lock;
+    inodes.lock_shared = fake_lock;
+    inodes.unlock_shared = fake_lock;
+    // the root proc runs in the root directory.
+    root_proc.cwd = &files[DIR_NO];
+    root_proc.kcontext.x0 = (uint64_t)rt_entry;
+}
+
+void run_test()
+{
+    yield();
+}
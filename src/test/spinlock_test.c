@@ -0,0 +1,68 @@
+/**
+ * Test the ticket spinlock: all cpus increment a shared counter under
+ * the lock, none of the increments is lost, and each cpu gets the lock
+ * about as often as the others while they all compete.
+ */
+#include "test.h"
+#include "test_util.h"
+#include "sync.h"
+#include <common/debug.h>
+#include <common/spinlock.h>
+#include <kernel/printk.h>
+
+/** Acquisitions by each cpu */
+#define NITER 100000
+/** Window to check fairness in, must be short enough that
+ * all cpus are still competing. */
+#define NWINDOW 1000
+
+static SpinLock lock;
+static u64 counter;
+/** Acquisitions of each cpu in the first NWINDOW * NCPU */
+static u64 nearly[NCPU];
+
+static void spinlock_test(void)
+{
+    TEST_START;
+    const int cpu = cpuid();
+
+    if (cpu == 0) {
+        init_spinlock(&lock);
+        ASSERT(try_acquire_spinlock(&lock));
+        ASSERT(!try_acquire_spinlock(&lock));
+        release_spinlock(&lock);
+    }
+    sync(1);
+
+    for (int i = 0; i < NITER; i++) {
+        acquire_spinlock(&lock);
+        if (counter < (u64)NWINDOW * NCPU) {
+            nearly[cpu]++;
+        }
+        counter++;
+        release_spinlock(&lock);
+    }
+    sync(2);
+
+    if (cpu == 0) {
+        ASSERT(counter == (u64)NITER * NCPU);
+        for (int i = 0; i < NCPU; i++) {
+            printk("cpu %d: %lld of the first %lld acquisitions\n", i,
+                   (i64)nearly[i], (i64)NWINDOW * NCPU);
+            // served in turn: nobody is starved.
+            ASSERT(nearly[i] >= NWINDOW / 4);
+        }
+        lock_stat_dump(5, false);
+        TEST_END;
+    }
+}
+
+void test_init(void)
+{
+    sync_init();
+}
+
+void run_test()
+{
+    spinlock_test();
+}
@@ -0,0 +1,66 @@
+/**
+ * Tickless idle: while the root proc sleeps on a timer for a while,
+ * the other cpus have nothing to run and should take almost no timer
+ * interrupts. The per-cpu interrupt counts are printed at the end.
+ */
+#include <kernel/proc.h>
+#include <kernel/sched.h>
+#include <kernel/printk.h>
+#include <common/sem.h>
+#include <driver/interrupt.h>
+#include <aarch64/intrinsic.h>
+
+/** Time to sleep, in ms */
+#define SLEEP_MS 1000
+/** Bound of timer interrupts on an idle cpu while sleeping. A 10ms
+ * tick would take SLEEP_MS / 10. */
+#define MAX_IDLE_IRQ 10
+
+extern Proc root_proc;
+static Semaphore done;
+static struct timer wakeup;
+
+static void wakeup_handler(struct timer *t __attribute__((unused)))
+{
+    post_sem(&done);
+}
+
+static void rt_entry()
+{
+    u64 before[NCPU], after[NCPU];
+    const int cid = cpuid();
+    for (int i = 0; i < NCPU; i++) {
+        before[i] = interrupt_count(i, TIMER_IRQ);
+    }
+
+    wakeup.elapse = SLEEP_MS;
+    wakeup.handler = wakeup_handler;
+    set_cpu_timer(&wakeup);
+    unalertable_wait_sem(&done);
+
+    for (int i = 0; i < NCPU; i++) {
+        after[i] = interrupt_count(i, TIMER_IRQ);
+    }
+    for (int i = 0; i < NCPU; i++) {
+        printk("cpu %d: %lld timer interrupts in %d ms\n", i,
+               (i64)(after[i] - before[i]), SLEEP_MS);
+        if (i != cid) {
+            ASSERT(after[i] - before[i] <= MAX_IDLE_IRQ);
+        }
+    }
+    interrupt_dump();
+    sched_dump();
+    printk("tickless test PASS\n");
+    exit(0);
+}
+
+void test_init()
+{
+    init_sem(&done, 0);
+    root_proc.kcontext.x0 = (uint64_t)rt_entry;
+}
+
+void run_test()
+{
+    yield();
+}
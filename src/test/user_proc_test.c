@@ -16,9 +16,8 @@ void vm_test()
 {
     printk("vm_test\n");
     static void *p[100000];
-    extern RefCount kalloc_page_cnt;
     struct pgdir pg;
-    int p0 = kalloc_page_cnt.count;
+    int p0 = kalloc_page_count();
     init_pgdir(&pg);
     for (u64 i = 0; i < 100000; i++) {
         p[i] = kalloc_page();
@@ -35,7 +34,7 @@ void vm_test()
     attach_pgdir(&pg);
     for (u64 i = 0; i < 100000; i++)
         kfree_page(p[i]);
-    ASSERT(kalloc_page_cnt.count == p0);
+    ASSERT(kalloc_page_count() == p0);
     printk("vm_test PASS\n");
 }
 
@@ -25,9 +25,8 @@ static void vm_test_cp()
 {
     printk("vm_test\n");
     static void *p[100000];
-    extern RefCount kalloc_page_cnt;
     struct pgdir pg;
-    int p0 = kalloc_page_cnt.count;
+    int p0 = kalloc_page_count();
     init_pgdir(&pg);
     for (u64 i = 0; i < 100000; i++) {
         p[i] = kalloc_page();
@@ -44,7 +43,7 @@ static void vm_test_cp()
     attach_pgdir(&pg);
     for (u64 i = 0; i < 100000; i++)
         kfree_page(p[i]);
-    ASSERT(kalloc_page_cnt.count == p0);
+    ASSERT(kalloc_page_count() == p0);
     printk("vm_test PASS\n");
 }
 
@@ -0,0 +1,94 @@
+/**
+ * Test vmalloc: areas are virtually contiguous, keep their contents
+ * when resized and are separated by guard pages.
+ */
+#include "test.h"
+#include "test_util.h"
+#include "sync.h"
+#include <common/debug.h>
+#include <kernel/printk.h>
+#include <kernel/vmalloc.h>
+#include <aarch64/mmu.h>
+
+/** Pages of the first allocation of each cpu */
+#define NPAGE 16
+/** Rounds of resizing */
+#define NROUND 8
+
+static u8 *bufs[NCPU];
+
+static void fill(u8 *p, usize from, usize to, int cpu)
+{
+    for (usize i = from; i < to; i++) {
+        p[i] = (u8)(i * 7 + cpu);
+    }
+}
+
+static void check(u8 *p, usize from, usize to, int cpu)
+{
+    for (usize i = from; i < to; i++) {
+        ASSERT(p[i] == (u8)(i * 7 + cpu));
+    }
+}
+
+static void vmalloc_test(void)
+{
+    TEST_START;
+    const int cpu = cpuid();
+
+    usize size = NPAGE * PAGE_SIZE;
+    u8 *p = vmalloc(size);
+    ASSERT(p != NULL);
+    ASSERT((u64)p >= VMALLOC_START && (u64)p + size <= VMALLOC_END);
+    ASSERT(vmalloc_size(p) == size);
+    fill(p, 0, size, cpu);
+    bufs[cpu] = p;
+    sync(1);
+
+    if (cpu == 0) {
+        // no overlap, and at least a guard page in between.
+        for (int i = 0; i < NCPU; i++) {
+            for (int j = 0; j < NCPU; j++) {
+                if (i != j && bufs[i] < bufs[j]) {
+                    ASSERT(bufs[i] + size + PAGE_SIZE <= bufs[j]);
+                }
+            }
+        }
+    }
+    sync(2);
+
+    for (int r = 0; r < NROUND; r++) {
+        // grow, which moves the area if a neighbour is in the way.
+        usize nsize = size + (r + 1) * PAGE_SIZE + 100;
+        u8 *q = vrealloc(p, nsize);
+        ASSERT(q != NULL);
+        check(q, 0, size, cpu);
+        fill(q, size, nsize, cpu);
+        p = q;
+        size = nsize;
+    }
+    // shrink in place.
+    u8 *q = vrealloc(p, PAGE_SIZE);
+    ASSERT(q == p);
+    check(q, 0, PAGE_SIZE, cpu);
+    vfree(q);
+    sync(3);
+
+    if (cpu == 0) {
+        struct vmalloc_stat st;
+        vmalloc_stat(&st);
+        ASSERT(st.narea == 0 && st.npage == 0);
+        printk("vmalloc: %lld pages of level 3 tables\n", (i64)st.nptpage);
+        TEST_END;
+    }
+}
+
+void test_init(void)
+{
+    sync_init();
+}
+
+void run_test()
+{
+    vmalloc_test();
+}
@@ -0,0 +1,86 @@
+/**
+ * Wakeup latency: a waker posts a semaphore that a sleeper on
+ * another cpu waits on, and the sleeper measures the time from
+ * the post until it runs again. The cpu of the sleeper is idle in
+ * wfi without a tick, so it relies on the reschedule IPI.
+ */
+#include <kernel/proc.h>
+#include <kernel/sched.h>
+#include <kernel/printk.h>
+#include <common/sem.h>
+#include <aarch64/intrinsic.h>
+
+/** Wakeups measured */
+#define NROUND 1000
+/** Time the waker spins before each post, in us, so that the
+ * cpu of the sleeper has gone idle. */
+#define SPIN_US 200
+/** Bound of the average latency, in us */
+#define MAX_AVG_US 2500
+
+static Semaphore wake, ack;
+static volatile u64 posted; // timestamp of the last post
+static volatile int waker_cpu;
+
+static void spin_us(u64 us)
+{
+    u64 end = get_timestamp() + get_clock_frequency() * us / 1000000;
+    while (get_timestamp() < end)
+        ;
+}
+
+static void waker_entry(u64 unused __attribute__((unused)))
+{
+    for (int i = 0; i < NROUND; i++) {
+        spin_us(SPIN_US);
+        waker_cpu = cpuid();
+        posted = get_timestamp();
+        post_sem(&wake);
+        unalertable_wait_sem(&ack);
+    }
+    exit(0);
+}
+
+static void sleeper_entry(u64 unused __attribute__((unused)))
+{
+    u64 total = 0, worst = 0;
+    int ncross = 0;
+    for (int i = 0; i < NROUND; i++) {
+        unalertable_wait_sem(&wake);
+        // only wakeups that cross cpus need an IPI.
+        if (waker_cpu != (int)cpuid()) {
+            u64 lat = get_timestamp() - posted;
+            total += lat;
+            worst = MAX(worst, lat);
+            ncross++;
+        }
+        post_sem(&ack);
+    }
+
+    const u64 us = get_clock_frequency() / 1000000;
+    printk("%d cross-cpu wakeups of %d, avg %lld us, max %lld us\n",
+           ncross, NROUND, (i64)(ncross ? total / ncross / us : 0),
+           (i64)(worst / us));
+    sched_dump();
+    if (ncross > 0) {
+        ASSERT(total / ncross / us < MAX_AVG_US);
+    }
+    printk("wakeup test PASS\n");
+    exit(0);
+}
+
+void test_init(void)
+{
+    init_sem(&wake, 0);
+    init_sem(&ack, 0);
+    Proc *pw = create_proc();
+    Proc *ps = create_proc();
+    ASSERT(pw != NULL && ps != NULL);
+    start_proc(ps, sleeper_entry, 0);
+    start_proc(pw, waker_entry, 0);
+}
+
+void run_test()
+{
+    yield();
+}
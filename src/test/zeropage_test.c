@@ -0,0 +1,95 @@
+/**
+ * Test the zero page in user mappings: read faults on private
+ * anonymous memory map the shared zero page read-only, the first write
+ * replaces it by a zeroed page of its own, and shared memory never
+ * maps it.
+ */
+#include "test.h"
+#include "test_util.h"
+#include <common/debug.h>
+#include <kernel/exec1207.h>
+#include <kernel/mem.h>
+#include <kernel/mmap1217.h>
+#include <kernel/printk.h>
+#include <kernel/pt.h>
+#include <aarch64/mmu.h>
+
+#define PRIV_VA 0x200000
+#define SHARED_VA 0x400000
+#define NPAGES 16
+
+static struct section *add_section(struct pgdir *pd, u64 start, u32 flags)
+{
+    struct section *sec = alloc_section();
+    ASSERT(sec != NULL);
+    sec->start = start;
+    sec->npages = NPAGES;
+    sec->flags = flags;
+    pgdir_add_section(pd, sec);
+    return sec;
+}
+
+static void *page_of(struct pgdir *pd, u64 va)
+{
+    PTEntry *pte = get_pte(pd, va, false);
+    ASSERT(pte != NULL && (*pte & PTE_VALID));
+    return (void *)P2K(PTE_ADDRESS(*pte));
+}
+
+static void zeropage_test(void)
+{
+    TEST_START;
+    struct zero_page_stat st0, st1;
+    zero_page_stat(&st0);
+
+    struct pgdir pd;
+    init_pgdir(&pd);
+    struct section *priv = add_section(&pd, PRIV_VA, PF_R | PF_W);
+    struct section *shared = add_section(&pd, SHARED_VA, PF_R | PF_W | PF_S);
+
+    // reads share the zero page.
+    for (int i = 0; i < NPAGES; i++) {
+        const u64 va = PRIV_VA + i * PAGE_SIZE;
+        ASSERT(section_install(&pd, priv, va, false) == 0);
+        ASSERT(*get_pte(&pd, va, false) & PTE_RO);
+        ASSERT(kpage_is_zero(page_of(&pd, va)));
+    }
+    // reading it again changes nothing.
+    const PTEntry old = *get_pte(&pd, PRIV_VA, false);
+    ASSERT(section_install(&pd, priv, PRIV_VA, false) == 0);
+    ASSERT(*get_pte(&pd, PRIV_VA, false) == old);
+    zero_page_stat(&st1);
+    ASSERT(st1.nmap - st0.nmap >= NPAGES);
+
+    // the first write gets a zeroed page of its own.
+    ASSERT(section_install(&pd, priv, PRIV_VA, true) == 0);
+    ASSERT((*get_pte(&pd, PRIV_VA, false) & PTE_RO) == 0);
+    u64 *pg = page_of(&pd, PRIV_VA);
+    ASSERT(!kpage_is_zero(pg));
+    for (int i = 0; i < PAGE_SIZE / 8; i++) {
+        ASSERT(pg[i] == 0);
+    }
+    pg[0] = 0xdeadbeef;
+    ASSERT(*(u64 *)page_of(&pd, PRIV_VA + PAGE_SIZE) == 0);
+    zero_page_stat(&st1);
+    ASSERT(st1.ncow - st0.ncow >= 1);
+
+    // shared memory never maps it, writes must be seen by all.
+    ASSERT(section_install(&pd, shared, SHARED_VA, false) == 0);
+    ASSERT(!kpage_is_zero(page_of(&pd, SHARED_VA)));
+    ASSERT((*get_pte(&pd, SHARED_VA, false) & PTE_RO) == 0);
+
+    free_pgdir(&pd);
+    TEST_END;
+}
+
+void test_init(void)
+{
+}
+
+void run_test()
+{
+    if (cpuid() == 0) {
+        zeropage_test();
+    }
+}
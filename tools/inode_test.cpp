@@ -240,6 +240,34 @@ void test_small_file()
     assert_eq(mock.count_inodes(), 1);
 }
 
+void test_pgcache()
+{
+    mock.begin_op(ctx);
+    usize ino = inodes.alloc(ctx, INODE_REGULAR);
+    mock.end_op(ctx);
+
+    // stands for the cached pages of mapped content.
+    static int cached;
+    auto *p = inodes.get(ino);
+    inodes.lock(p);
+    p->pages = reinterpret_cast<struct pgcache *>(&cached);
+
+    // reads keep the cache, writes drop it.
+    u8 buf[1] = { 0xcc };
+    inodes.read(p, buf, 0, 1);
+    assert_true(p->pages != NULL);
+    mock.begin_op(ctx);
+    inodes.write(ctx, p, buf, 0, 1);
+    mock.end_op(ctx);
+    assert_true(p->pages == NULL);
+
+    inodes.unlock(p);
+    mock.begin_op(ctx);
+    inodes.put(ctx, p);
+    mock.end_op(ctx);
+    assert_eq(mock.count_inodes(), 1);
+}
+
 void test_large_file()
 {
     mock.begin_op(ctx);
@@ -429,6 +457,7 @@ int main()
         { "touch", adhoc::test_touch },
         { "share", adhoc::test_share },
         { "small_file", adhoc::test_small_file },
+        { "pgcache", adhoc::test_pgcache },
         { "large_file", adhoc::test_large_file },
         { "dir", adhoc::test_dir },
     };
@@ -1,5 +1,6 @@
 extern "C" {
 #include <common/defines.h>
+#include <kernel/slab.h>
 }
 
 #include "map.hpp"
@@ -21,4 +22,17 @@ void kfree(void *object)
 {
     free(object);
 }
+
+void *kmem_cache_alloc(KmemCache *cache)
+{
+    void *object = malloc(cache->size);
+    if (object != nullptr && cache->ctor != nullptr)
+        cache->ctor(object);
+    return object;
+}
+
+void kmem_cache_free(KmemCache *, void *object)
+{
+    free(object);
+}
 }
@@ -3,6 +3,7 @@
 #include "errno.h"
 
 #include <condition_variable>
+#include <shared_mutex>
 #include <semaphore.h>
 #include <time.h>
 #include <cassert>
@@ -40,6 +41,13 @@ struct Signal {
 
 Map<void *, Mutex> mtx_map;
 
+struct RWMutex {
+    bool writing;
+    std::shared_mutex mutex;
+};
+
+Map<void *, RWMutex> rw_map;
+
 thread_local int holding = 0;
 static struct Blocker {
     sem_t sem;
@@ -174,4 +182,133 @@ int post_all_sem(Semaphore *x)
 }
 #undef sa
 #undef sb
+
+// the kernel mutex, a sleeping lock with an owner.
+struct KernelMutex;
+void init_mutex(KernelMutex *x)
+{
+    mtx_map.try_add(x);
+}
+bool try_acquire_mutex(KernelMutex *x)
+{
+    auto &m = mtx_map[x];
+    if (!m.mutex.try_lock())
+        return false;
+    m.locked = true;
+    return true;
+}
+void acquire_mutex(KernelMutex *x)
+{
+    if (holding) {
+        if constexpr (MockLockConfig::SpinLockForbidsWait)
+            assert(0);
+        blocker.v();
+    }
+    mtx_map[x].lock();
+    if (holding) {
+        blocker.p();
+    }
+}
+void release_mutex(KernelMutex *x)
+{
+    mtx_map[x].unlock();
+}
+bool holding_mutex(KernelMutex *x)
+{
+    return mtx_map[x].locked;
+}
+
+// the kernel reader-writer lock.
+struct RWLock;
+void init_rwlock(RWLock *x, bool prefer_writer [[maybe_unused]])
+{
+    rw_map.try_add(x);
+}
+}
+
+template <typename F> static void rw_wait(F &&f)
+{
+    if (holding) {
+        if constexpr (MockLockConfig::SpinLockForbidsWait)
+            assert(0);
+        blocker.v();
+    }
+    f();
+    if (holding) {
+        blocker.p();
+    }
+}
+
+extern "C" {
+void acquire_rwlock_read(RWLock *x)
+{
+    rw_wait([&] { rw_map[x].mutex.lock_shared(); });
+}
+void release_rwlock_read(RWLock *x)
+{
+    rw_map[x].mutex.unlock_shared();
+}
+void acquire_rwlock_write(RWLock *x)
+{
+    auto &m = rw_map[x];
+    rw_wait([&] { m.mutex.lock(); });
+    m.writing = true;
+}
+void release_rwlock_write(RWLock *x)
+{
+    auto &m = rw_map[x];
+    m.writing = false;
+    m.mutex.unlock();
+}
+bool holding_rwlock_write(RWLock *x)
+{
+    return rw_map[x].writing;
+}
+
+struct WaitQueue;
+#define wa(x) ((uint64_t *)x)[0]
+#define wb(x) ((uint64_t *)x)[1]
+// sleepers take tickets in wa, wakeups serve them in wb.
+void init_waitq(WaitQueue *x)
+{
+    wa(x) = 0;
+    wb(x) = 0;
+}
+bool waitq_sleep(WaitQueue *x, SpinLock *lock, bool alertable [[maybe_unused]])
+{
+    auto t = wa(x)++;
+    int t0 = time(NULL);
+    while (wb(x) <= t) {
+        if (time(NULL) - t0 > MockLockConfig::WaitTimeoutSeconds) {
+            return false;
+        }
+        release_spinlock(lock);
+        if (holding) {
+            if constexpr (MockLockConfig::SpinLockForbidsWait)
+                assert(0);
+            blocker.v();
+        }
+        usleep(5);
+        if (holding) {
+            blocker.p();
+        }
+        acquire_spinlock(lock);
+    }
+    return true;
+}
+bool waitq_wake_one(WaitQueue *x)
+{
+    if (wb(x) == wa(x))
+        return false;
+    wb(x)++;
+    return true;
+}
+int waitq_wake_all(WaitQueue *x)
+{
+    int ret = wa(x) - wb(x);
+    wb(x) = wa(x);
+    return ret;
+}
+#undef wa
+#undef wb
 }
@@ -0,0 +1,110 @@
+#include "syscall.h"
+
+// forkbench
+// time fork(), and the first write after it, as the resident heap grows.
+// the child exits at once, so the cost is the one of the parent.
+
+#define MB (1ull << 20)
+#define NROUND 8
+
+static const u64 sizes[] = { 0, 1 * MB, 4 * MB, 16 * MB, 64 * MB };
+
+static char line[128];
+static int len;
+
+static void puts_(const char *s)
+{
+    for (; *s != 0; s++) {
+        line[len++] = *s;
+    }
+}
+
+// append v right-aligned in a field of width w, and a space.
+static void putu(u64 v, int w)
+{
+    char buf[24];
+    int n = 0;
+    do {
+        buf[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v > 0);
+    for (int i = n; i < w; i++) {
+        line[len++] = ' ';
+    }
+    while (n > 0) {
+        line[len++] = buf[--n];
+    }
+    line[len++] = ' ';
+}
+
+static void flush()
+{
+    line[len++] = '\n';
+    sys_write(1, line, len);
+    len = 0;
+}
+
+static u64 now()
+{
+    u64 t;
+    asm volatile("isb; mrs %0, cntvct_el0" : "=r"(t) : : "memory");
+    return t;
+}
+
+static u64 to_us(u64 ticks)
+{
+    u64 freq;
+    asm volatile("mrs %0, cntfrq_el0" : "=r"(freq));
+    return ticks * 1000000 / freq;
+}
+
+int main(int argc, char **argv)
+{
+    char *heap = sys_sbrk(0);
+    u64 rss = 0;
+
+    puts_(" RSS(KB)  FORK(us) WRITE(us)");
+    flush();
+    for (u32 s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        // grow the heap and touch it, so that all of it is resident.
+        if (sizes[s] > rss) {
+            if (sys_sbrk(sizes[s] - rss) != (void *)(heap + sizes[s])) {
+                puts_("forkbench: sbrk fail");
+                flush();
+                return 1;
+            }
+            for (u64 off = rss; off < sizes[s]; off += 4096) {
+                heap[off] = 1;
+            }
+            rss = sizes[s];
+        }
+
+        u64 fork_ticks = 0, write_ticks = 0;
+        for (int r = 0; r < NROUND; r++) {
+            u64 t = now();
+            int pid = sys_fork();
+            fork_ticks += now() - t;
+            if (pid < 0) {
+                puts_("forkbench: fork fail");
+                flush();
+                return 1;
+            }
+            if (pid == 0) {
+                sys_exit(0);
+            }
+            // the first write breaks the sharing.
+            if (rss > 0) {
+                t = now();
+                heap[0]++;
+                write_ticks += now() - t;
+            }
+            int code;
+            sys_wait(&code);
+        }
+        putu(rss / 1024, 8);
+        putu(to_us(fork_ticks) / NROUND, 9);
+        putu(to_us(write_ticks) / NROUND, 9);
+        flush();
+    }
+    return 0;
+}
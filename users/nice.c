@@ -0,0 +1,56 @@
+#include "syscall.h"
+
+static void Puts(const char *s)
+{
+    unsigned long len = 0;
+    for (len = 0; s[len] != 0; len++) {
+    }
+    sys_write(2, s, len);
+}
+
+// parse an optionally negative decimal number.
+static int parse_int(const char *s, int *val)
+{
+    int neg = 0, v = 0;
+    if (*s == '-') {
+        neg = 1;
+        s++;
+    }
+    if (*s == 0) {
+        return -1;
+    }
+    for (; *s != 0; s++) {
+        if (*s < '0' || *s > '9') {
+            return -1;
+        }
+        v = v * 10 + (*s - '0');
+    }
+    *val = neg ? -v : v;
+    return 0;
+}
+
+// nice [-n inc] cmd [args...]
+// run cmd with its nice value raised by inc, 10 by default.
+int main(int argc, char **argv)
+{
+    int inc = 10, i = 1;
+    if (argc > 2 && argv[1][0] == '-' && argv[1][1] == 'n' &&
+        argv[1][2] == 0) {
+        if (parse_int(argv[2], &inc) != 0) {
+            Puts("nice: bad increment\n");
+            return 1;
+        }
+        i = 3;
+    }
+    if (i >= argc) {
+        Puts("Usage: nice [-n inc] cmd [args...]\n");
+        return 1;
+    }
+
+    sys_nice(inc);
+    sys_execve(argv[i], &argv[i]);
+    Puts("nice: cannot execute ");
+    Puts(argv[i]);
+    Puts("\n");
+    return 1;
+}
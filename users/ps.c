@@ -0,0 +1,158 @@
+#include "syscall.h"
+
+#define MAXPROC 256
+
+static struct acct_proc procs[MAXPROC];
+static struct acct_cpu cpus[16];
+
+// a row has at most 16 fields, each of up to 20 digits, a sign and a
+// space: u64 counters do not fit in their columns forever.
+static char line[16 * 22 + 1];
+static int len;
+
+static void puts_(const char *s)
+{
+    for (; *s != 0; s++) {
+        line[len++] = *s;
+    }
+}
+
+// append v right-aligned in a field of width w, and a space.
+static void putu(u64 v, int w)
+{
+    char buf[24];
+    int n = 0;
+    do {
+        buf[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v > 0);
+    for (int i = n; i < w; i++) {
+        line[len++] = ' ';
+    }
+    while (n > 0) {
+        line[len++] = buf[--n];
+    }
+    line[len++] = ' ';
+}
+
+static void puti(int v, int w)
+{
+    if (v >= 0) {
+        putu(v, w);
+        return;
+    }
+    int n = 1;
+    for (int t = -v; t > 0; t /= 10) {
+        n++;
+    }
+    for (int i = n; i < w; i++) {
+        line[len++] = ' ';
+    }
+    line[len++] = '-';
+    putu(-v, 0);
+}
+
+static void flush()
+{
+    line[len++] = '\n';
+    sys_write(1, line, len);
+    len = 0;
+}
+
+static char state_char(int state)
+{
+    switch (state) {
+    case RUNNABLE:
+        return 'R';
+    case RUNNING:
+        return 'O';
+    case SLEEPING:
+        return 'S';
+    case DEEPSLEEPING:
+        return 'D';
+    case ZOMBIE:
+        return 'Z';
+    default:
+        return '?';
+    }
+}
+
+static void show_cpus()
+{
+    int n = sys_getacct(ACCT_CPU, cpus, 16);
+    if (n < 0) {
+        puts_("ps: getacct fail");
+        flush();
+        return;
+    }
+    puts_("CPU NRUN  BUSY(ms)  IDLE(ms)   SWITCH    FAULT");
+    flush();
+    for (int i = 0; i < n && i < 16; i++) {
+        putu(i, 3);
+        putu(cpus[i].nrun, 4);
+        putu(cpus[i].busy_us / 1000, 9);
+        putu(cpus[i].idle_us / 1000, 9);
+        putu(cpus[i].nswitch, 8);
+        putu(cpus[i].nfault, 8);
+        flush();
+    }
+}
+
+static void show_procs()
+{
+    int n = sys_getacct(ACCT_PROC, procs, MAXPROC);
+    if (n < 0) {
+        puts_("ps: getacct fail");
+        flush();
+        return;
+    }
+    int m = n < MAXPROC ? n : MAXPROC;
+
+    // sort by pid.
+    for (int i = 1; i < m; i++) {
+        struct acct_proc t = procs[i];
+        int j = i;
+        for (; j > 0 && procs[j - 1].pid > t.pid; j--) {
+            procs[j] = procs[j - 1];
+        }
+        procs[j] = t;
+    }
+
+    puts_("  PID  PPID S  NI CPU  RUN(ms) WAIT(ms)   VCSW  IVCSW  FAULT"
+          "     READ    WRITE");
+    flush();
+    for (int i = 0; i < m; i++) {
+        struct acct_proc *p = &procs[i];
+        putu(p->pid, 5);
+        puti(p->ppid, 5);
+        line[len++] = state_char(p->state);
+        line[len++] = ' ';
+        puti(p->nice, 3);
+        putu(p->cpu, 3);
+        putu(p->run_us / 1000, 8);
+        putu(p->wait_us / 1000, 8);
+        putu(p->nvcsw, 6);
+        putu(p->nivcsw, 6);
+        putu(p->nfault, 6);
+        putu(p->rbytes, 8);
+        putu(p->wbytes, 8);
+        flush();
+    }
+    if (n > m) {
+        putu(n - m, 0);
+        puts_("more not shown");
+        flush();
+    }
+}
+
+// ps [-c]
+// list the accounting of all processes, and of all cpus with -c.
+int main(int argc, char **argv)
+{
+    if (argc > 1 && argv[1][0] == '-' && argv[1][1] == 'c' &&
+        argv[1][2] == 0) {
+        show_cpus();
+    }
+    show_procs();
+    return 0;
+}
@@ -4,7 +4,7 @@
 static char buf[512];
 
 static void system(char *cmd);
-static void Execve(char *exe, char **argv);
+static int Spawn(char *exe, char **argv);
 static int strcmp(const char *a, const char *b);
 static char *strcpy(char *dst, const char *src);
 
@@ -60,17 +60,14 @@ static void system(char *cmd)
         return;
     }
 
-    int id = sys_fork();
+    int id = Spawn(argv[0], argv);
     if (id < 0) {
         // fail
+        sys_print("execve FAIL", 11);
         return;
     }
-    if (id == 0) {
-        Execve(argv[0], argv);
-    } else {
-        // block execution
-        sys_wait(&id);
-    }
+    // block execution
+    sys_wait(&id);
 }
 
 static int strcmp(const char *a, const char *b)
@@ -85,20 +82,21 @@ static int strcmp(const char *a, const char *b)
     return (int)a[i] - (int)b[i];
 }
 
-// safely do execve.
-static void Execve(char *exe, char **argv)
+// start exe in a child, which inherits all open files.
+// Returns the pid of the child.
+static int Spawn(char *exe, char **argv)
 {
     // search path option 0: cwd
-    sys_execve(exe, argv);
+    int id = sys_spawn(exe, argv, NULL, 0);
+    if (id >= 0) {
+        return id;
+    }
 
     // search path option 1: /bin/
     static char pth[64];
     char *pt = strcpy(pth, "/bin/");
     strcpy(pt, exe);
-    sys_execve((const char *)pth, argv);
-
-    sys_print("execve FAIL", 11);
-    sys_exit(1);
+    return sys_spawn((const char *)pth, argv, NULL, 0);
 }
 
 // Returns the dst after copy(*dst = 0).
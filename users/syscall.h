@@ -101,6 +101,40 @@ extern int sys_fstat(int fd, InodeEntry *buf);
 extern int sys_pipe(int *buf);
 extern int sys_dup2(int old, int new);
 extern void *sys_sbrk(isize growth);
+extern int sys_nice(int inc);
+extern int sys_getacct(int which, void *buf, int n);
+extern int sys_spawn(const char *path, char **argv, const int *fdmap,
+                     int nfd);
+
+// in kernel/acct.h
+#define ACCT_PROC 0
+#define ACCT_CPU 1
+
+struct acct_proc {
+    int pid;
+    int ppid;
+    int state; // enum procstate
+    int nice;
+    int cpu; // the cpu it last ran on
+    u64 run_us; // time on a cpu
+    u64 wait_us; // time runnable in a run queue
+    u64 nvcsw; // voluntary switches: went to sleep
+    u64 nivcsw; // involuntary switches: preempted or yielded
+    u64 nfault; // user page faults
+    u64 rbytes; // bytes returned by read
+    u64 wbytes; // bytes accepted by write
+};
+
+struct acct_cpu {
+    int nrun; // runnable procs in its queue
+    u64 busy_us; // time running procs
+    u64 idle_us; // time in the idle proc
+    u64 nswitch; // context switches
+    u64 nfault; // user page faults
+};
+
+// in kernel/proc.h
+enum procstate { UNUSED, RUNNABLE, RUNNING, SLEEPING, DEEPSLEEPING, ZOMBIE };
 
 // exec1207.h
 /** The initial stack position.
@@ -213,4 +247,8 @@ void *sys_mmap(void *addr, u64 length, int prot, int flags, int fd,
 
 int sys_munmap(void *addr, u64 len);
 
+// pages mapped around a page fault of the mapping at addr,
+// -1 to only return the old value.
+int sys_mwindow(void *addr, int npages);
+
 #endif // _USER_SYSCALL_
@@ -375,11 +375,15 @@ struct backcmd {
 
 int fork1(void); // Fork but panics on failure.
 void panic(char *);
+void syntax(char *);
 struct cmd *parsecmd(char *);
+void freecmd(struct cmd *);
 
-// wrapper of execve, this will first search
-// in current directory and then the /bin/ dir.
-void exec(char *exe, char **argv)
+// set by syntax() when parsecmd() fails.
+int parseerr;
+
+// the second place where programs are searched, "/bin/exe".
+char *binpath(char *exe)
 {
     static char buf[64];
     int i;
@@ -394,11 +398,126 @@ void exec(char *exe, char **argv)
         pt[i] = exe[i];
     }
     pt[i] = 0;
+    return buf;
+}
 
+// wrapper of execve, this will first search
+// in current directory and then the /bin/ dir.
+void exec(char *exe, char **argv)
+{
     // first: cwd
-    sys_execve(pt, argv);
+    sys_execve(exe, argv);
     // second: /bin/exe
-    sys_execve((char *)buf, argv);
+    sys_execve(binpath(exe), argv);
+}
+
+// the fds passed to spawned programs: stdin, stdout and stderr.
+#define NSTDFD 3
+
+// Whether cmd contains a list, which spawncmd() runs by waiting.
+int haslist(struct cmd *cmd)
+{
+    switch (cmd->type) {
+    case LIST:
+        return 1;
+    case REDIR:
+        return haslist(((struct redircmd *)cmd)->cmd);
+    case PIPE:
+        return haslist(((struct pipecmd *)cmd)->left) ||
+               haslist(((struct pipecmd *)cmd)->right);
+    default:
+        return 0;
+    }
+}
+
+// Whether cmd can be run by spawncmd(), without forking the shell.
+int spawnable(struct cmd *cmd)
+{
+    struct listcmd *lcmd;
+    struct pipecmd *pcmd;
+    struct redircmd *rcmd;
+
+    switch (cmd->type) {
+    case EXEC:
+        return 1;
+    case REDIR:
+        rcmd = (struct redircmd *)cmd;
+        return rcmd->fd < NSTDFD && spawnable(rcmd->cmd);
+    case PIPE:
+        pcmd = (struct pipecmd *)cmd;
+        // a list waits for its left side, which would block on a full
+        // pipe with no reader yet: run it in a forked subshell.
+        if (haslist(pcmd->left) || haslist(pcmd->right))
+            return 0;
+        return spawnable(pcmd->left) && spawnable(pcmd->right);
+    case LIST:
+        lcmd = (struct listcmd *)cmd;
+        return spawnable(lcmd->left) && spawnable(lcmd->right);
+    default:
+        // background jobs must not be waited for.
+        return 0;
+    }
+}
+
+// Start cmd with fd i of its programs being fdmap[i] of the shell.
+// Returns the number of children to wait for.
+int spawncmd(struct cmd *cmd, int *fdmap)
+{
+    int p[2], map[NSTDFD];
+    int i, fd, n;
+    struct execcmd *ecmd;
+    struct listcmd *lcmd;
+    struct pipecmd *pcmd;
+    struct redircmd *rcmd;
+
+    for (i = 0; i < NSTDFD; i++)
+        map[i] = fdmap[i];
+
+    switch (cmd->type) {
+    default:
+        panic("spawncmd");
+
+    case EXEC:
+        ecmd = (struct execcmd *)cmd;
+        if (ecmd->argv[0] == 0)
+            return 0;
+        if (sys_spawn(ecmd->argv[0], ecmd->argv, map, NSTDFD) < 0 &&
+            sys_spawn(binpath(ecmd->argv[0]), ecmd->argv, map, NSTDFD) < 0) {
+            fprintf(2, "exec %s failed\n", ecmd->argv[0]);
+            return 0;
+        }
+        return 1;
+
+    case REDIR:
+        rcmd = (struct redircmd *)cmd;
+        if ((fd = open(rcmd->file, rcmd->mode)) < 0) {
+            fprintf(2, "open %s failed\n", rcmd->file);
+            return 0;
+        }
+        map[rcmd->fd] = fd;
+        n = spawncmd(rcmd->cmd, map);
+        close(fd);
+        return n;
+
+    case LIST:
+        lcmd = (struct listcmd *)cmd;
+        for (n = spawncmd(lcmd->left, map); n > 0; n--)
+            wait(0);
+        return spawncmd(lcmd->right, map);
+
+    case PIPE:
+        pcmd = (struct pipecmd *)cmd;
+        if (pipe(p) < 0)
+            panic("pipe");
+        map[1] = p[1];
+        n = spawncmd(pcmd->left, map);
+        map[1] = fdmap[1];
+        map[0] = p[0];
+        n += spawncmd(pcmd->right, map);
+        close(p[0]);
+        close(p[1]);
+        return n;
+    }
 }
 
 // Execute cmd.  Never returns.
@@ -500,7 +619,9 @@ int main(void)
     console.nrd = console.nwrt = 0;
 
     static char buf[100];
-    int fd;
+    static int stdfd[NSTDFD] = { 0, 1, 2 };
+    struct cmd *cmd;
+    int fd, n;
 
     // Ensure that three file descriptors are open.
     while ((fd = open("/dev/console", O_RDWR)) >= 0) {
@@ -519,9 +640,19 @@ int main(void)
                 fprintf(2, "cannot cd %s\n", buf + 3);
             continue;
         }
-        if (fork1() == 0)
-            runcmd(parsecmd(buf));
-        wait(0);
+        cmd = parsecmd(buf);
+        if (parseerr) {
+            // go on with the next command.
+        } else if (spawnable(cmd)) {
+            // no need to clone the shell only to exec.
+            for (n = spawncmd(cmd, stdfd); n > 0; n--)
+                wait(0);
+        } else {
+            if (fork1() == 0)
+                runcmd(cmd);
+            wait(0);
+        }
+        freecmd(cmd);
     }
     exit(0);
 }
@@ -532,6 +663,13 @@ void panic(char *s)
     exit(1);
 }
 
+// Report a syntax error, parsecmd() goes on and tells by parseerr.
+void syntax(char *s)
+{
+    fprintf(2, "%s\n", s);
+    parseerr = 1;
+}
+
 int fork1(void)
 {
     int pid;
@@ -676,12 +814,13 @@ struct cmd *parsecmd(char *s)
     char *es;
     struct cmd *cmd;
 
+    parseerr = 0;
     es = s + strlen(s);
     cmd = parseline(&s, es);
     peek(&s, es, "");
     if (s != es) {
         fprintf(2, "leftovers: %s\n", s);
-        panic("syntax");
+        syntax("syntax");
     }
     nulterminate(cmd);
     return cmd;
@@ -723,7 +862,7 @@ struct cmd *parseredirs(struct cmd *cmd, char **ps, char *es)
     while (peek(ps, es, "<>")) {
         tok = gettoken(ps, es, 0, 0);
         if (gettoken(ps, es, &q, &eq) != 'a')
-            panic("missing file for redirection");
+            syntax("missing file for redirection");
         switch (tok) {
         case '<':
             cmd = redircmd(cmd, q, eq, O_RDONLY, 0);
@@ -748,7 +887,7 @@ struct cmd *parseblock(char **ps, char *es)
     gettoken(ps, es, 0, 0);
     cmd = parseline(ps, es);
     if (!peek(ps, es, ")"))
-        panic("syntax - missing )");
+        syntax("syntax - missing )");
     gettoken(ps, es, 0, 0);
     cmd = parseredirs(cmd, ps, es);
     return cmd;
@@ -772,13 +911,17 @@ struct cmd *parseexec(char **ps, char *es)
     while (!peek(ps, es, "|)&;")) {
         if ((tok = gettoken(ps, es, &q, &eq)) == 0)
             break;
-        if (tok != 'a')
-            panic("syntax");
+        if (tok != 'a') {
+            syntax("syntax");
+            break;
+        }
+        if (argc >= MAXARGS - 1) {
+            syntax("too many args");
+            break;
+        }
         cmd->argv[argc] = q;
         cmd->eargv[argc] = eq;
         argc++;
-        if (argc >= MAXARGS)
-            panic("too many args");
         ret = parseredirs(ret, ps, es);
     }
     cmd->argv[argc] = 0;
@@ -831,3 +974,40 @@ struct cmd *nulterminate(struct cmd *cmd)
     }
     return cmd;
 }
+
+// Free the nodes of a parsed command.
+void freecmd(struct cmd *cmd)
+{
+    struct backcmd *bcmd;
+    struct listcmd *lcmd;
+    struct pipecmd *pcmd;
+    struct redircmd *rcmd;
+
+    if (cmd == 0)
+        return;
+
+    switch (cmd->type) {
+    case REDIR:
+        rcmd = (struct redircmd *)cmd;
+        freecmd(rcmd->cmd);
+        break;
+
+    case PIPE:
+        pcmd = (struct pipecmd *)cmd;
+        freecmd(pcmd->left);
+        freecmd(pcmd->right);
+        break;
+
+    case LIST:
+        lcmd = (struct listcmd *)cmd;
+        freecmd(lcmd->left);
+        freecmd(lcmd->right);
+        break;
+
+    case BACK:
+        bcmd = (struct backcmd *)cmd;
+        freecmd(bcmd->cmd);
+        break;
+    }
+    free(cmd);
+}